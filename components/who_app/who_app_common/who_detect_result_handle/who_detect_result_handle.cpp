@@ -3,27 +3,27 @@
 #include "who_lvgl_utils.hpp"
 #endif
 #include "dl_image_pixel_cvt_dispatch.hpp"
+#include <algorithm>
 
 namespace who {
 namespace detect {
 void draw_detect_results_on_img(const dl::image::img_t &img,
-                                const std::list<dl::detect::result_t> &detect_res,
+                                const detect_results_t &detect_res,
                                 const std::vector<std::vector<uint8_t>> &palette)
 {
-    for (const auto &res : detect_res) {
-        dl::image::draw_hollow_rectangle(img, res.box[0], res.box[1], res.box[2], res.box[3], palette[res.category], 2);
-        if (!res.keypoint.empty()) {
-            assert(res.keypoint.size() == 10);
-            for (int i = 0; i < 5; i++) {
-                dl::image::draw_point(img, res.keypoint[2 * i], res.keypoint[2 * i + 1], palette[res.category], 3);
-            }
+    for (int i = 0; i < detect_res.n; i++) {
+        const int16_t *box = detect_res.box[i];
+        const auto &color = palette[detect_res.category[i]];
+        dl::image::draw_hollow_rectangle(img, box[0], box[1], box[2], box[3], color, 2);
+        for (int j = 0; j + 1 < detect_res.n_keypoints; j += 2) {
+            dl::image::draw_point(img, detect_res.keypoint[i][j], detect_res.keypoint[i][j + 1], color, 3);
         }
     }
 }
 
 #if !BSP_CONFIG_NO_GRAPHIC_LIB
 void draw_detect_results_on_canvas(lv_obj_t *canvas,
-                                   const std::list<dl::detect::result_t> &detect_res,
+                                   const detect_results_t &detect_res,
                                    const std::vector<lv_color_t> &palette)
 {
     lv_draw_rect_dsc_t rect_dsc;
@@ -41,30 +41,27 @@ void draw_detect_results_on_canvas(lv_obj_t *canvas,
     lv_layer_t layer;
     lv_canvas_init_layer(canvas, &layer);
     lv_area_t coords_rect;
-    for (const auto &res : detect_res) {
-        coords_rect = {res.box[0], res.box[1], res.box[2], res.box[3]};
-        rect_dsc.border_color = palette[res.category];
+    for (int i = 0; i < detect_res.n; i++) {
+        const int16_t *box = detect_res.box[i];
+        coords_rect = {box[0], box[1], box[2], box[3]};
+        rect_dsc.border_color = palette[detect_res.category[i]];
         lv_draw_rect(&layer, &rect_dsc, &coords_rect);
-        if (!res.keypoint.empty()) {
-            arc_dsc.color = palette[res.category];
-            assert(res.keypoint.size() == 10);
-            for (int i = 0; i < 5; i++) {
-                arc_dsc.center.x = res.keypoint[2 * i];
-                arc_dsc.center.y = res.keypoint[2 * i + 1];
-                lv_draw_arc(&layer, &arc_dsc);
-            }
+        arc_dsc.color = palette[detect_res.category[i]];
+        for (int j = 0; j + 1 < detect_res.n_keypoints; j += 2) {
+            arc_dsc.center.x = detect_res.keypoint[i][j];
+            arc_dsc.center.y = detect_res.keypoint[i][j + 1];
+            lv_draw_arc(&layer, &arc_dsc);
         }
     }
     lv_canvas_finish_layer(canvas, &layer);
 }
 #endif
 
-void print_detect_results(const std::list<dl::detect::result_t> &detect_res)
+void print_detect_results(const detect_results_t &detect_res)
 {
-    int i = 0;
     const char *TAG = "detect";
     if (!detect_res.empty()) {
-        if (detect_res.begin()->keypoint.empty()) {
+        if (!detect_res.n_keypoints) {
             ESP_LOGI(TAG, "----------------------------------------");
         } else {
             ESP_LOGI(
@@ -73,32 +70,33 @@ void print_detect_results(const std::list<dl::detect::result_t> &detect_res)
                 "---------------------------------------------------");
         }
     }
-    for (const auto &r : detect_res) {
-        if (r.keypoint.empty()) {
-            ESP_LOGI(TAG, "%d, bbox: [%f, %d, %d, %d, %d]", i, r.score, r.box[0], r.box[1], r.box[2], r.box[3]);
+    for (int i = 0; i < detect_res.n; i++) {
+        const float score = detect_res.score[i];
+        const int16_t *box = detect_res.box[i];
+        const int16_t *kpt = detect_res.keypoint[i];
+        if (detect_res.n_keypoints != detect_results_t::MAX_KEYPOINTS) {
+            ESP_LOGI(TAG, "%d, bbox: [%f, %d, %d, %d, %d]", i, score, box[0], box[1], box[2], box[3]);
         } else {
-            assert(r.keypoint.size() == 10);
             ESP_LOGI(TAG,
                      "%d, bbox: [%f, %d, %d, %d, %d], left_eye: [%d, %d], left_mouth: [%d, %d], nose: [%d, %d], "
                      "right_eye: [%d, %d], right_mouth: [%d, %d]",
                      i,
-                     r.score,
-                     r.box[0],
-                     r.box[1],
-                     r.box[2],
-                     r.box[3],
-                     r.keypoint[0],
-                     r.keypoint[1],
-                     r.keypoint[2],
-                     r.keypoint[3],
-                     r.keypoint[4],
-                     r.keypoint[5],
-                     r.keypoint[6],
-                     r.keypoint[7],
-                     r.keypoint[8],
-                     r.keypoint[9]);
+                     score,
+                     box[0],
+                     box[1],
+                     box[2],
+                     box[3],
+                     kpt[0],
+                     kpt[1],
+                     kpt[2],
+                     kpt[3],
+                     kpt[4],
+                     kpt[5],
+                     kpt[6],
+                     kpt[7],
+                     kpt[8],
+                     kpt[9]);
         }
-        i++;
     }
 }
 } // namespace detect
@@ -108,7 +106,18 @@ namespace lcd_disp {
 WhoDetectResultLCDDisp::WhoDetectResultLCDDisp(task::WhoTask *task,
                                                lv_obj_t *canvas,
                                                const std::vector<std::vector<uint8_t>> &palette) :
-    m_task(task), m_res_mutex(xSemaphoreCreateMutex()), m_result(), m_canvas(canvas)
+    m_task(task),
+    m_res_mutex(xSemaphoreCreateMutex()),
+    m_results_head(0),
+    m_n_results(0),
+    m_result(),
+    m_has_result(false),
+    m_n_disp_frames(0),
+    m_n_no_result(0),
+    m_n_synced(0),
+    m_max_lag(0),
+    m_lag_sum(0),
+    m_canvas(canvas)
 {
     m_palette = cvt_to_lv_palette(palette);
 }
@@ -116,7 +125,15 @@ WhoDetectResultLCDDisp::WhoDetectResultLCDDisp(task::WhoTask *task,
 WhoDetectResultLCDDisp::WhoDetectResultLCDDisp(task::WhoTask *task, const std::vector<std::vector<uint8_t>> &palette) :
     m_task(task),
     m_res_mutex(xSemaphoreCreateMutex()),
+    m_results_head(0),
+    m_n_results(0),
     m_result(),
+    m_has_result(false),
+    m_n_disp_frames(0),
+    m_n_no_result(0),
+    m_n_synced(0),
+    m_max_lag(0),
+    m_lag_sum(0),
     m_rgb888_palette(palette),
     m_rgb565_palette(palette.size(), std::vector<uint8_t>(2))
 {
@@ -143,7 +160,15 @@ WhoDetectResultLCDDisp::~WhoDetectResultLCDDisp()
 void WhoDetectResultLCDDisp::save_detect_result(const detect::WhoDetect::result_t &result)
 {
     xSemaphoreTake(m_res_mutex, portMAX_DELAY);
-    m_results.push(result);
+    if (m_n_results == MAX_PENDING_RESULTS) {
+        m_results_head = (m_results_head + 1) % MAX_PENDING_RESULTS;
+        m_n_results--;
+    }
+    auto &back = m_results[(m_results_head + m_n_results) % MAX_PENDING_RESULTS];
+    back = result;
+    // Only the timestamp is needed to sync with the displayed frame, don't keep the detected fb from recycling.
+    back.fb.reset();
+    m_n_results++;
     xSemaphoreGive(m_res_mutex);
 }
 
@@ -162,33 +187,114 @@ void WhoDetectResultLCDDisp::lcd_disp_cb(who::cam::cam_fb_t *fb)
     };
     struct timeval t1 = fb->timestamp;
     // If detect fps higher than display fps, the result queue may be more than 1. May happen when using lvgl.
-    while (!m_results.empty()) {
-        detect::WhoDetect::result_t result = m_results.front();
+    while (m_n_results) {
+        const auto &result = m_results[m_results_head];
         if (!compare_timestamp(t1, result.timestamp)) {
             m_result = result;
-            m_results.pop();
+            m_has_result = true;
+            m_results_head = (m_results_head + 1) % MAX_PENDING_RESULTS;
+            m_n_results--;
+#if WHO_TRACKER_ENABLED
+            if (m_tracker) {
+                m_tracker->update(m_result);
+            }
+#endif
         } else {
             break;
         }
     }
     xSemaphoreGive(m_res_mutex);
+    update_sync_stats(fb);
+    const detect::detect_results_t *det_res = &m_result.det_res;
+#if WHO_TRACKER_ENABLED
+    if (m_tracker) {
+        predict_tracks(fb);
+        det_res = &m_tracked_res;
+    }
+#endif
 #if BSP_CONFIG_NO_GRAPHIC_LIB
     if (fb->format == cam::cam_fb_fmt_t::CAM_FB_FMT_RGB565) {
-        detect::draw_detect_results_on_img(*fb, m_result.det_res, m_rgb565_palette);
+        detect::draw_detect_results_on_img(*fb, *det_res, m_rgb565_palette);
     } else if (fb->format == cam::cam_fb_fmt_t::CAM_FB_FMT_RGB888) {
-        detect::draw_detect_results_on_img(*fb, m_result.det_res, m_rgb888_palette);
+        detect::draw_detect_results_on_img(*fb, *det_res, m_rgb888_palette);
     }
 #else
-    detect::draw_detect_results_on_canvas(m_canvas, m_result.det_res, m_palette);
+    detect::draw_detect_results_on_canvas(m_canvas, *det_res, m_palette);
 #endif
 }
 
+#if WHO_TRACKER_ENABLED
+void WhoDetectResultLCDDisp::predict_tracks(const who::cam::cam_fb_t *fb)
+{
+    int n = m_tracker->predict(fb->timestamp, m_tracks.data(), m_tracks.size());
+    m_tracked_res.n = n;
+    m_tracked_res.n_keypoints = 0;
+    for (int i = 0; i < n; i++) {
+        const auto &t = m_tracks[i];
+        m_tracked_res.category[i] = t.category;
+        m_tracked_res.score[i] = t.score;
+        // Extrapolated boxes may leave the frame.
+        int16_t *box = m_tracked_res.box[i];
+        box[0] = std::clamp(t.box[0], 0, fb->width - 1);
+        box[1] = std::clamp(t.box[1], 0, fb->height - 1);
+        box[2] = std::clamp(t.box[2], 0, fb->width - 1);
+        box[3] = std::clamp(t.box[3], 0, fb->height - 1);
+    }
+}
+#endif
+
 void WhoDetectResultLCDDisp::cleanup()
 {
     xSemaphoreTake(m_res_mutex, portMAX_DELAY);
-    std::queue<detect::WhoDetect::result_t>().swap(m_results);
-    m_result = {};
+    // The pending results hold no fb, see save_detect_result().
+    m_results_head = 0;
+    m_n_results = 0;
+    m_result.det_res.clear();
+    m_has_result = false;
     xSemaphoreGive(m_res_mutex);
+#if WHO_TRACKER_ENABLED
+    m_tracked_res.clear();
+    if (m_tracker) {
+        m_tracker->reset();
+    }
+#endif
+}
+
+void WhoDetectResultLCDDisp::update_sync_stats(const who::cam::cam_fb_t *fb)
+{
+    m_n_disp_frames.fetch_add(1, std::memory_order_relaxed);
+    if (!m_has_result) {
+        m_n_no_result.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // Both seqs are assigned by the fetch node the displayed and the detected frames come from.
+    uint32_t lag = fb->trace.seq - m_result.trace.seq;
+    if (!lag) {
+        m_n_synced.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (lag > m_max_lag.load(std::memory_order_relaxed)) {
+        m_max_lag.store(lag, std::memory_order_relaxed);
+    }
+    m_lag_sum.fetch_add(lag, std::memory_order_relaxed);
+}
+
+WhoDetectResultLCDDisp::sync_stats_t WhoDetectResultLCDDisp::get_sync_stats(bool reset)
+{
+    sync_stats_t stats;
+    stats.n_frames = m_n_disp_frames.load(std::memory_order_relaxed);
+    stats.n_no_result = m_n_no_result.load(std::memory_order_relaxed);
+    stats.n_synced = m_n_synced.load(std::memory_order_relaxed);
+    stats.max_lag = m_max_lag.load(std::memory_order_relaxed);
+    uint32_t n_with_result = stats.n_frames - stats.n_no_result;
+    stats.mean_lag = n_with_result ? (float)m_lag_sum.load(std::memory_order_relaxed) / n_with_result : 0;
+    if (reset) {
+        m_n_disp_frames = 0;
+        m_n_no_result = 0;
+        m_n_synced = 0;
+        m_max_lag = 0;
+        m_lag_sum = 0;
+    }
+    return stats;
 }
 } // namespace lcd_disp
 } // namespace who
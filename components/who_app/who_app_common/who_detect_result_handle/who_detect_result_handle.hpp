@@ -1,26 +1,44 @@
 #pragma once
 #include "who_detect.hpp"
-#include <queue>
 #include "bsp/esp-bsp.h"
+#if WHO_TRACKER_ENABLED
+#include "who_tracker.hpp"
+#include <memory>
+#endif
 
 namespace who {
 namespace detect {
 void draw_detect_results_on_img(const dl::image::img_t &img,
-                                const std::list<dl::detect::result_t> &detect_res,
+                                const detect_results_t &detect_res,
                                 const std::vector<std::vector<uint8_t>> &palette);
 
 #if !BSP_CONFIG_NO_GRAPHIC_LIB
 void draw_detect_results_on_canvas(lv_obj_t *canvas,
-                                   const std::list<dl::detect::result_t> &detect_res,
+                                   const detect_results_t &detect_res,
                                    const std::vector<lv_color_t> &palette);
 #endif
 
-void print_detect_results(const std::list<dl::detect::result_t> &detect_res);
+void print_detect_results(const detect_results_t &detect_res);
 } // namespace detect
 
 namespace lcd_disp {
 class WhoDetectResultLCDDisp {
 public:
+    // Results waiting for their frame to be displayed. The oldest one is dropped when full, it would be replaced by the
+    // newer ones on the next displayed frame anyway.
+    static inline constexpr int MAX_PENDING_RESULTS = 4;
+
+    // The lag of a displayed frame is its seq minus the seq of the frame the drawn result is detected on.
+    typedef struct {
+        uint32_t n_frames;
+        // Frames displayed before any result.
+        uint32_t n_no_result;
+        // Frames displayed with the result of the frame itself.
+        uint32_t n_synced;
+        uint32_t max_lag;
+        float mean_lag;
+    } sync_stats_t;
+
 #if !BSP_CONFIG_NO_GRAPHIC_LIB
     WhoDetectResultLCDDisp(task::WhoTask *task, lv_obj_t *canvas, const std::vector<std::vector<uint8_t>> &palette);
 #else
@@ -30,12 +48,41 @@ public:
     void save_detect_result(const detect::WhoDetect::result_t &result);
     void lcd_disp_cb(who::cam::cam_fb_t *fb);
     void cleanup();
+    // The result drawn on the last displayed frame, only valid in the lcd disp task.
+    const detect::WhoDetect::result_t &get_disp_result() { return m_result; }
+    sync_stats_t get_sync_stats(bool reset = false);
+#if WHO_TRACKER_ENABLED
+    // Draw the boxes of tracker predicted at every displayed frame, instead of the last result. The results are fed to
+    // tracker in the lcd disp task, so the detect fps can be far below the camera fps. Set before run.
+    void set_tracker(std::unique_ptr<tracker::WhoTracker> tracker) { m_tracker = std::move(tracker); }
+#endif
 
 private:
+    void update_sync_stats(const who::cam::cam_fb_t *fb);
+#if WHO_TRACKER_ENABLED
+    // Fills m_tracked_res with the tracks predicted at the timestamp of fb.
+    void predict_tracks(const who::cam::cam_fb_t *fb);
+#endif
+
     task::WhoTask *m_task;
     SemaphoreHandle_t m_res_mutex;
-    std::queue<detect::WhoDetect::result_t> m_results;
+    // A ring of m_n_results from m_results_head.
+    std::array<detect::WhoDetect::result_t, MAX_PENDING_RESULTS> m_results;
+    int m_results_head;
+    int m_n_results;
     detect::WhoDetect::result_t m_result;
+    // Whether m_result comes from a detected frame rather than the initial empty one.
+    bool m_has_result;
+    std::atomic<uint32_t> m_n_disp_frames;
+    std::atomic<uint32_t> m_n_no_result;
+    std::atomic<uint32_t> m_n_synced;
+    std::atomic<uint32_t> m_max_lag;
+    std::atomic<uint64_t> m_lag_sum;
+#if WHO_TRACKER_ENABLED
+    std::unique_ptr<tracker::WhoTracker> m_tracker;
+    std::array<tracker::track_t, tracker::WhoTracker::MAX_TRACKS> m_tracks;
+    detect::detect_results_t m_tracked_res;
+#endif
 #if BSP_CONFIG_NO_GRAPHIC_LIB
     std::vector<std::vector<uint8_t>> m_rgb888_palette;
     std::vector<std::vector<uint8_t>> m_rgb565_palette;
@@ -2,21 +2,36 @@
 
 namespace who {
 namespace app {
-WhoDetectAppBase::WhoDetectAppBase(frame_cap::WhoFrameCap *frame_cap) :
-    m_frame_cap(frame_cap), m_detect(new detect::WhoDetect("Detect", m_frame_cap->get_last_node()))
+WhoDetectAppBase::WhoDetectAppBase(frame_cap::WhoFrameCap *frame_cap,
+                                   frame_cap::WhoFrameCapNode *detect_frame_cap_node) :
+    m_frame_cap(frame_cap),
+    m_detect(new detect::WhoDetect("Detect",
+                                   detect_frame_cap_node ? detect_frame_cap_node : m_frame_cap->get_last_node()))
 {
     WhoApp::add_task_group(frame_cap);
     WhoApp::add_task(m_detect);
 }
 
-void WhoDetectAppBase::set_model(dl::detect::Detect *model)
+void WhoDetectAppBase::set_model(dl::detect::Detect *model, detect::DetectStages *stages)
 {
-    m_detect->set_model(model);
+    m_detect->set_model(model, stages);
 }
 
 void WhoDetectAppBase::set_fps(float fps)
 {
     m_detect->set_fps(fps);
 }
+
+void WhoDetectAppBase::set_staged(BaseType_t stage_core)
+{
+    m_detect->set_staged(stage_core);
+}
+
+void WhoDetectAppBase::set_motion_gate(float threshold, int refresh_interval)
+{
+    auto motion_node =
+        m_frame_cap->add_node<frame_cap::WhoMotionNode>(m_detect->get_frame_cap_node(), "FrameCapMotion");
+    m_detect->set_motion_gate(motion_node, threshold, refresh_interval);
+}
 } // namespace app
 } // namespace who
@@ -6,10 +6,22 @@ namespace who {
 namespace app {
 class WhoDetectAppBase : public WhoApp {
 public:
-    WhoDetectAppBase(frame_cap::WhoFrameCap *frame_cap);
+    // Detect on the last node of frame_cap if detect_frame_cap_node is nullptr.
+    WhoDetectAppBase(frame_cap::WhoFrameCap *frame_cap, frame_cap::WhoFrameCapNode *detect_frame_cap_node = nullptr);
     // inject model after constructor, make it possible to create model after other resources are requested.
-    void set_model(dl::detect::Detect *model);
+    void set_model(dl::detect::Detect *model, detect::DetectStages *stages = nullptr);
+    template <typename T>
+        requires std::derived_from<T, dl::detect::Detect> && std::derived_from<T, detect::DetectStages>
+    void set_model(T *model)
+    {
+        m_detect->set_model(model);
+    }
     void set_fps(float fps);
+    // See WhoDetect::set_staged().
+    void set_staged(BaseType_t stage_core = 0);
+    // Branch a WhoMotionNode off the detected frames and skip the model on the static ones, see
+    // WhoDetect::set_motion_gate(). Only before run().
+    void set_motion_gate(float threshold, int refresh_interval = 0);
 
 protected:
     frame_cap::WhoFrameCap *m_frame_cap;
@@ -1,12 +1,14 @@
 #include "who_detect_app_lcd.hpp"
 #include "who_yield2idle.hpp"
+#include <algorithm>
 
 namespace who {
 namespace app {
 WhoDetectAppLCD::WhoDetectAppLCD(const std::vector<std::vector<uint8_t>> &palette,
                                  frame_cap::WhoFrameCap *frame_cap,
-                                 frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node) :
-    WhoDetectAppBase(frame_cap)
+                                 frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node,
+                                 frame_cap::WhoFrameCapNode *detect_frame_cap_node) :
+    WhoDetectAppBase(frame_cap, detect_frame_cap_node), m_planner(nullptr)
 {
     if (!lcd_disp_frame_cap_node) {
         lcd_disp_frame_cap_node = frame_cap->get_last_node();
@@ -21,27 +23,90 @@ WhoDetectAppLCD::WhoDetectAppLCD(const std::vector<std::vector<uint8_t>> &palett
 #endif
     m_detect->set_detect_result_cb(std::bind(&WhoDetectAppLCD::detect_result_cb, this, std::placeholders::_1));
     m_detect->set_cleanup_func(std::bind(&WhoDetectAppLCD::cleanup, this));
+    m_lcd_disp_frame_cap_node = lcd_disp_frame_cap_node;
 
-    auto detect_frame_cap_node = frame_cap->get_last_node();
-#if CONFIG_SOC_PPA_SUPPORTED
+    detect_frame_cap_node = m_detect->get_frame_cap_node();
     if (lcd_disp_frame_cap_node != detect_frame_cap_node) {
-        if (detect_frame_cap_node->get_type() == "PPAResizeNode" &&
-            detect_frame_cap_node->get_prev_node() == lcd_disp_frame_cap_node) {
-            float rescale_x = dl::image::get_ppa_scale(lcd_disp_frame_cap_node->get_fb_width(),
-                                                       detect_frame_cap_node->get_fb_width());
-            float rescale_y = dl::image::get_ppa_scale(lcd_disp_frame_cap_node->get_fb_height(),
-                                                       detect_frame_cap_node->get_fb_height());
-            m_detect->set_rescale_params(rescale_x,
-                                         rescale_y,
-                                         lcd_disp_frame_cap_node->get_fb_width(),
-                                         lcd_disp_frame_cap_node->get_fb_height());
-        } else {
-            ESP_LOGE("WhoDetectAppLCD", "Wrong frame cap node.");
+        set_rescale_params(detect_frame_cap_node, lcd_disp_frame_cap_node);
+    }
+}
+
+void WhoDetectAppLCD::set_rescale_params(frame_cap::WhoFrameCapNode *detect_frame_cap_node,
+                                         frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node)
+{
+    typedef struct {
+        frame_cap::WhoFrameCapNode *node;
+        // Scale of the node the walk starts from relative to this ancestor.
+        float scale_x;
+        float scale_y;
+        // Edges in between.
+        int depth;
+    } ancestor_t;
+    // Walk up all the prev nodes, a node with several prev nodes gets frames from each of them. Breadth first, so that
+    // the first path found to an ancestor is the shortest. The results are mapped back to the prev node of a crop node
+    // by WhoDetect, so uncropped is set on the detect side to restart the scale there.
+    auto get_ancestors = [](frame_cap::WhoFrameCapNode *node, bool uncropped) {
+        std::vector<ancestor_t> ancestors = {{node, 1, 1, 0}};
+        for (size_t i = 0; i < ancestors.size(); i++) {
+            ancestor_t cur = ancestors[i];
+            for (const auto &prev_node : cur.node->get_prev_nodes()) {
+                float scale_x = 1, scale_y = 1;
+                if (!uncropped || !cur.node->is_crop_node()) {
+                    cur.node->get_scale(prev_node, scale_x, scale_y);
+                    scale_x *= cur.scale_x;
+                    scale_y *= cur.scale_y;
+                }
+                auto it = std::find_if(ancestors.begin(), ancestors.end(), [prev_node](const ancestor_t &ancestor) {
+                    return ancestor.node == prev_node;
+                });
+                if (it == ancestors.end()) {
+                    ancestors.push_back({prev_node, scale_x, scale_y, cur.depth + 1});
+                } else if (it->scale_x != scale_x || it->scale_y != scale_y) {
+                    ESP_LOGW("WhoDetectAppLCD",
+                             "The frames of %s reach %s at different scales.",
+                             prev_node->get_name().c_str(),
+                             ancestors[0].node->get_name().c_str());
+                }
+            }
+        }
+        return ancestors;
+    };
+    auto detect_ancestors = get_ancestors(detect_frame_cap_node, true);
+    auto lcd_disp_ancestors = get_ancestors(lcd_disp_frame_cap_node, false);
+    // The nearest common ancestor, the scales of both nodes are relative to it.
+    const ancestor_t *detect_ancestor = nullptr, *lcd_disp_ancestor = nullptr;
+    for (const auto &a : detect_ancestors) {
+        for (const auto &b : lcd_disp_ancestors) {
+            if (a.node == b.node &&
+                (!detect_ancestor || a.depth + b.depth < detect_ancestor->depth + lcd_disp_ancestor->depth)) {
+                detect_ancestor = &a;
+                lcd_disp_ancestor = &b;
+            }
         }
     }
-#else
-    assert(lcd_disp_frame_cap_node == detect_frame_cap_node);
-#endif
+    if (!detect_ancestor) {
+        ESP_LOGE("WhoDetectAppLCD", "Wrong frame cap node.");
+        return;
+    }
+    float rescale_x = detect_ancestor->scale_x / lcd_disp_ancestor->scale_x;
+    float rescale_y = detect_ancestor->scale_y / lcd_disp_ancestor->scale_y;
+    if (rescale_x != 1 || rescale_y != 1) {
+        m_detect->set_rescale_params(rescale_x,
+                                     rescale_y,
+                                     lcd_disp_frame_cap_node->get_fb_width(),
+                                     lcd_disp_frame_cap_node->get_fb_height());
+    }
+}
+
+void WhoDetectAppLCD::enable_planner(uint32_t warm_up_ms, uint32_t interval_ms)
+{
+    if (m_planner) {
+        return;
+    }
+    m_planner = new frame_cap::WhoFrameCapPlanner("FrameCapPlanner", m_frame_cap, warm_up_ms, interval_ms);
+    // The displayed frame has to stay in the ringbuf until its detect result is ready.
+    m_planner->add_sync(m_lcd_disp_frame_cap_node, m_detect);
+    WhoApp::add_task(m_planner);
 }
 
 WhoDetectAppLCD::~WhoDetectAppLCD()
@@ -57,6 +122,9 @@ bool WhoDetectAppLCD::run()
     }
     ret &= m_lcd_disp->run(2560, 2, 0);
     ret &= m_detect->run(4096, 2, 1);
+    if (m_planner) {
+        ret &= m_planner->run(3072, 1, 0);
+    }
     return ret;
 }
 
@@ -1,17 +1,25 @@
 #pragma once
 #include "who_detect_app_base.hpp"
 #include "who_detect_result_handle.hpp"
+#include "who_frame_cap_planner.hpp"
 #include "who_frame_lcd_disp.hpp"
 
 namespace who {
 namespace app {
 class WhoDetectAppLCD : public WhoDetectAppBase {
 public:
+    // The last node of frame_cap is displayed and detected by default. If they differ, the results are mapped to the
+    // displayed frames through the nearest node both of them come from.
     WhoDetectAppLCD(const std::vector<std::vector<uint8_t>> &palette,
                     frame_cap::WhoFrameCap *frame_cap,
-                    frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr);
+                    frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr,
+                    frame_cap::WhoFrameCapNode *detect_frame_cap_node = nullptr);
     ~WhoDetectAppLCD();
+    // Report the ringbuf_len and fb_count the pipeline needs to keep the displayed frames in sync with the results,
+    // call it before run(). See WhoFrameCapPlanner.
+    void enable_planner(uint32_t warm_up_ms = 3000, uint32_t interval_ms = 10000);
     bool run() override;
+    lcd_disp::WhoDetectResultLCDDisp *get_result_lcd_disp() { return m_result_lcd_disp; }
 
 protected:
     virtual void detect_result_cb(const detect::WhoDetect::result_t &result);
@@ -19,8 +27,13 @@ protected:
     virtual void cleanup();
 
 private:
+    void set_rescale_params(frame_cap::WhoFrameCapNode *detect_frame_cap_node,
+                            frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node);
+
     lcd_disp::WhoFrameLCDDisp *m_lcd_disp;
     lcd_disp::WhoDetectResultLCDDisp *m_result_lcd_disp;
+    frame_cap::WhoFrameCapNode *m_lcd_disp_frame_cap_node;
+    frame_cap::WhoFrameCapPlanner *m_planner;
 };
 } // namespace app
 } // namespace who
@@ -4,7 +4,9 @@
 
 namespace who {
 namespace app {
-WhoDetectAppTerm::WhoDetectAppTerm(frame_cap::WhoFrameCap *frame_cap) : WhoDetectAppBase(frame_cap)
+WhoDetectAppTerm::WhoDetectAppTerm(frame_cap::WhoFrameCap *frame_cap,
+                                   frame_cap::WhoFrameCapNode *detect_frame_cap_node) :
+    WhoDetectAppBase(frame_cap, detect_frame_cap_node)
 {
     m_detect->set_detect_result_cb(std::bind(&WhoDetectAppTerm::detect_result_cb, this, std::placeholders::_1));
 }
@@ -5,7 +5,7 @@ namespace who {
 namespace app {
 class WhoDetectAppTerm : public WhoDetectAppBase {
 public:
-    WhoDetectAppTerm(frame_cap::WhoFrameCap *frame_cap);
+    WhoDetectAppTerm(frame_cap::WhoFrameCap *frame_cap, frame_cap::WhoFrameCapNode *detect_frame_cap_node = nullptr);
     bool run() override;
 
 protected:
@@ -6,8 +6,11 @@ LV_FONT_DECLARE(montserrat_bold_26);
 
 namespace who {
 namespace app {
-WhoQRCodeAppLCD::WhoQRCodeAppLCD(frame_cap::WhoFrameCap *frame_cap) :
-    WhoQRCodeAppTerm(frame_cap), m_lcd_disp(new lcd_disp::WhoFrameLCDDisp("LCDDisp", frame_cap->get_last_node()))
+WhoQRCodeAppLCD::WhoQRCodeAppLCD(frame_cap::WhoFrameCap *frame_cap,
+                                 frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node) :
+    WhoQRCodeAppTerm(frame_cap),
+    m_lcd_disp(new lcd_disp::WhoFrameLCDDisp(
+        "LCDDisp", lcd_disp_frame_cap_node ? lcd_disp_frame_cap_node : frame_cap->get_last_node()))
 {
     WhoApp::add_task(m_lcd_disp);
     m_lcd_disp->set_lcd_disp_cb(std::bind(&WhoQRCodeAppLCD::lcd_disp_cb, this, std::placeholders::_1));
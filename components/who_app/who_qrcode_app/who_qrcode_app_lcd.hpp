@@ -7,7 +7,9 @@ namespace who {
 namespace app {
 class WhoQRCodeAppLCD : public WhoQRCodeAppTerm {
 public:
-    WhoQRCodeAppLCD(frame_cap::WhoFrameCap *frame_cap);
+    // The qrcode is scanned on the last node, which may be a WhoGrayNode. Frames of lcd_disp_frame_cap_node are
+    // displayed, the last node by default.
+    WhoQRCodeAppLCD(frame_cap::WhoFrameCap *frame_cap, frame_cap::WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr);
     ~WhoQRCodeAppLCD();
     bool run() override;
 
@@ -0,0 +1,37 @@
+#include "who_activation_lut.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <cmath>
+
+namespace who {
+namespace detect {
+// Exponents of int8 tensors in esp-dl stay well within this range.
+static constexpr int MIN_EXPONENT = -24;
+static constexpr int MAX_EXPONENT = 7;
+
+Int8ActivationLUT::Int8ActivationLUT(int exponent) : m_exponent(exponent)
+{
+    float scale = std::ldexp(1.f, exponent);
+    for (int q = -128; q < 128; q++) {
+        m_sigmoid[(uint8_t)q] = sigmoid_f(q * scale);
+        m_softplus[(uint8_t)q] = softplus_f(q * scale);
+    }
+}
+
+const Int8ActivationLUT *Int8ActivationLUT::get(int exponent)
+{
+    if (exponent < MIN_EXPONENT || exponent > MAX_EXPONENT) {
+        return nullptr;
+    }
+    static Int8ActivationLUT *luts[MAX_EXPONENT - MIN_EXPONENT + 1] = {};
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    auto &lut = luts[exponent - MIN_EXPONENT];
+    if (!lut) {
+        lut = new Int8ActivationLUT(exponent);
+    }
+    xSemaphoreGive(mutex);
+    return lut;
+}
+} // namespace detect
+} // namespace who
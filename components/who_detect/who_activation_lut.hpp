@@ -0,0 +1,49 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+namespace who {
+namespace detect {
+// The activations the anchor-based detect heads decode with. Saturated, so that they are finite for any input.
+inline float sigmoid_f(float x)
+{
+    if (x >= 80.0f) {
+        return 1.0f;
+    }
+    if (x <= -80.0f) {
+        return 0.0f;
+    }
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+inline float softplus_f(float x)
+{
+    if (x > 20.0f) {
+        return x;
+    }
+    if (x < -20.0f) {
+        return std::exp(x);
+    }
+    return std::log1p(std::exp(x));
+}
+
+// sigmoid_f() and softplus_f() of the 256 values of an int8 tensor of one exponent, so that a quantized head decodes
+// with lookups instead of exp and log. The tables are built on the first get() of an exponent, at model load, and
+// shared by every postprocessor. There are no int16 tables, 64K entries each would not fit in internal ram.
+class Int8ActivationLUT {
+public:
+    static const Int8ActivationLUT *get(int exponent);
+    int get_exponent() const { return m_exponent; }
+    float sigmoid(int8_t q) const { return m_sigmoid[(uint8_t)q]; }
+    float softplus(int8_t q) const { return m_softplus[(uint8_t)q]; }
+
+private:
+    Int8ActivationLUT(int exponent);
+
+    int m_exponent;
+    // Indexed by the bits of q, so that the lookup needs no offset.
+    float m_sigmoid[256];
+    float m_softplus[256];
+};
+} // namespace detect
+} // namespace who
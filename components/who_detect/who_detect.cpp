@@ -1,17 +1,90 @@
 #include "who_detect.hpp"
+#include "esp_timer.h"
+
+using namespace who::cam;
 
 namespace who {
 namespace detect {
+WhoDetectInferWorker::WhoDetectInferWorker(const std::string &name,
+                                           DetectStages *stages,
+                                           EventGroupHandle_t done_event_group,
+                                           EventBits_t done_bit) :
+    task::WhoTask(name),
+    m_stages(stages),
+    m_done_event_group(done_event_group),
+    m_done_bit(done_bit),
+    m_slots(xQueueCreate(1, sizeof(int))),
+    m_start_us(0),
+    m_end_us(0)
+{
+}
+
+WhoDetectInferWorker::~WhoDetectInferWorker()
+{
+    vQueueDelete(m_slots);
+}
+
+bool WhoDetectInferWorker::stop_async()
+{
+    if (task::WhoTask::stop_async()) {
+        // Wake up the task waiting for a slot.
+        int slot = -1;
+        xQueueSend(m_slots, &slot, portMAX_DELAY);
+        return true;
+    }
+    return false;
+}
+
+void WhoDetectInferWorker::submit(int slot)
+{
+    xQueueSend(m_slots, &slot, portMAX_DELAY);
+}
+
+void WhoDetectInferWorker::task()
+{
+    while (true) {
+        int slot = -1;
+        xQueueReceive(m_slots, &slot, portMAX_DELAY);
+        if (slot < 0) {
+            break;
+        }
+        m_start_us = esp_timer_get_time();
+        m_stages->infer_slot(slot);
+        m_end_us = esp_timer_get_time();
+        xEventGroupSetBits(m_done_event_group, m_done_bit);
+    }
+    xEventGroupSetBits(m_event_group, TASK_STOPPED);
+    vTaskDelete(NULL);
+}
+
 WhoDetect::WhoDetect(const std::string &name, frame_cap::WhoFrameCapNode *frame_cap_node) :
     task::WhoTask(name),
     m_frame_cap_node(frame_cap_node),
     m_model(nullptr),
+    m_stages(nullptr),
     m_interval(0),
     m_inv_rescale_x(0),
     m_inv_rescale_y(0),
     m_rescale_max_w(0),
     m_rescale_max_h(0),
-    m_result_cb_mutex(xSemaphoreCreateRecursiveMutex())
+    m_pyramid_node(nullptr),
+    m_pyramid_level(0),
+    m_pyramid_w(0),
+    m_pyramid_h(0),
+    m_roi_node(nullptr),
+    m_roi_margin(0),
+    m_roi_ttl(0),
+    m_motion_node(nullptr),
+    m_motion_thr(0),
+    m_refresh_interval(0),
+    m_skip_run(0),
+    m_has_last_res(false),
+    m_result(),
+    m_infer_cnt(0),
+    m_skip_cnt(0),
+    m_result_cb_mutex(xSemaphoreCreateRecursiveMutex()),
+    m_stage_core(-1),
+    m_infer_worker(nullptr)
 {
     frame_cap_node->add_new_frame_signal_subscriber(this);
 }
@@ -19,14 +92,18 @@ WhoDetect::WhoDetect(const std::string &name, frame_cap::WhoFrameCapNode *frame_
 WhoDetect::~WhoDetect()
 {
     vSemaphoreDelete(m_result_cb_mutex);
+    if (m_infer_worker) {
+        delete m_infer_worker;
+    }
     if (m_model) {
         delete m_model;
     }
 }
 
-void WhoDetect::set_model(dl::detect::Detect *model)
+void WhoDetect::set_model(dl::detect::Detect *model, DetectStages *stages)
 {
     m_model = model;
+    m_stages = stages;
 }
 
 void WhoDetect::set_rescale_params(float rescale_x, float rescale_y, uint16_t rescale_max_w, uint16_t rescale_max_h)
@@ -37,6 +114,37 @@ void WhoDetect::set_rescale_params(float rescale_x, float rescale_y, uint16_t re
     m_rescale_max_h = rescale_max_h;
 }
 
+void WhoDetect::set_pyramid_level(int level, uint16_t w, uint16_t h)
+{
+    if (m_frame_cap_node->get_type() != "PyramidNode") {
+        ESP_LOGE("WhoDetect", "%s is not a pyramid node.", m_frame_cap_node->get_name().c_str());
+        return;
+    }
+    m_pyramid_node = static_cast<frame_cap::WhoPyramidNode *>(m_frame_cap_node);
+    m_pyramid_level = level;
+    m_pyramid_w = w;
+    m_pyramid_h = h;
+}
+
+void WhoDetect::set_roi_feedback(frame_cap::WhoROICropNode *roi_node, float margin, int ttl)
+{
+    m_roi_node = roi_node;
+    m_roi_margin = margin;
+    m_roi_ttl = ttl;
+}
+
+void WhoDetect::set_motion_gate(frame_cap::WhoMotionNode *motion_node, float threshold, int refresh_interval)
+{
+    m_motion_node = motion_node;
+    m_motion_thr = threshold;
+    m_refresh_interval = refresh_interval;
+}
+
+void WhoDetect::set_staged(BaseType_t stage_core)
+{
+    m_stage_core = stage_core;
+}
+
 void WhoDetect::set_fps(float fps)
 {
     if (fps > 0) {
@@ -56,8 +164,23 @@ void WhoDetect::set_cleanup_func(const std::function<void()> &cleanup_func)
     m_cleanup = cleanup_func;
 }
 
+void WhoDetect::resolve_pyramid_level()
+{
+    // The pyramid node lays out its levels in run(), which may come after this task starts. A frame from it means the
+    // levels are there.
+    if (m_pyramid_node && m_pyramid_level < 0) {
+        m_pyramid_level = m_pyramid_node->find_level(m_pyramid_w, m_pyramid_h);
+    }
+}
+
 void WhoDetect::task()
 {
+    if (m_infer_worker) {
+        task_staged();
+        m_infer_worker->stop();
+        xEventGroupSetBits(m_event_group, TASK_STOPPED);
+        vTaskDelete(NULL);
+    }
     TickType_t last_wake_time = xTaskGetTickCount();
     while (true) {
         EventBits_t event_bits =
@@ -75,18 +198,29 @@ void WhoDetect::task()
                 continue;
             }
         }
-        auto fb = m_frame_cap_node->cam_fb_peek();
+        auto fb = m_frame_cap_node->cam_fb_acquire();
+        if (!fb) {
+            continue;
+        }
+        resolve_pyramid_level();
         struct timeval timestamp = fb->timestamp;
         dl::image::img_t img = static_cast<dl::image::img_t>(*fb);
-        auto &res = m_model->run(img);
-        if (m_inv_rescale_x && m_inv_rescale_y && m_rescale_max_w && m_rescale_max_h) {
-            rescale_detect_result(res);
+        cam_fb_crop_t crop = fb->crop;
+        if (m_pyramid_node) {
+            img = m_pyramid_node->get_level(*fb, m_pyramid_level);
+            crop = m_pyramid_node->get_level_crop(m_pyramid_level).compose(fb->crop);
         }
-        if (m_result_cb) {
-            xSemaphoreTakeRecursive(m_result_cb_mutex, portMAX_DELAY);
-            m_result_cb({res, timestamp, img});
-            xSemaphoreGiveRecursive(m_result_cb_mutex);
+        // fb is shared with the other subscribers, stamp a copy of its trace.
+        cam_fb_trace_t trace = fb->trace;
+        bool skip = is_static(fb->trace.seq);
+        if (skip) {
+            m_skip_cnt.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            auto &res = run_model(img, trace);
+            m_infer_cnt.fetch_add(1, std::memory_order_relaxed);
+            apply_detect_result(res, crop);
         }
+        call_result_cb(timestamp, img, fb, trace);
         if (m_interval) {
             vTaskDelayUntil(&last_wake_time, m_interval);
         }
@@ -95,23 +229,210 @@ void WhoDetect::task()
     vTaskDelete(NULL);
 }
 
-void WhoDetect::rescale_detect_result(std::list<dl::detect::result_t> &result)
+void WhoDetect::task_staged()
 {
-    for (auto &r : result) {
-        r.box[0] *= m_inv_rescale_x;
-        r.box[1] *= m_inv_rescale_y;
-        r.box[2] *= m_inv_rescale_x;
-        r.box[3] *= m_inv_rescale_y;
-        r.limit_box(m_rescale_max_w, m_rescale_max_h);
-        if (!r.keypoint.empty()) {
-            assert(r.keypoint.size() == 10);
-            for (int i = 0; i < 5; i++) {
-                r.keypoint[2 * i] *= m_inv_rescale_x;
-                r.keypoint[2 * i + 1] *= m_inv_rescale_y;
+    // When the last frame was taken, the first frame is due right away.
+    TickType_t last_frame_time = xTaskGetTickCount() - m_interval;
+    // Slot of the frame being inferred and of the preprocessed frame waiting for it, -1 if none.
+    int infer_slot = -1;
+    int ready_slot = -1;
+    auto tracer = frame_cap::WhoFrameTracer::get_instance();
+    while (true) {
+        EventBits_t event_bits = xEventGroupWaitBits(
+            m_event_group, NEW_FRAME | INFER_DONE | TASK_PAUSE | TASK_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (event_bits & (TASK_STOP | TASK_PAUSE)) {
+            // The slots are reused after resume, wait for the frame being inferred and drop the frames in flight.
+            if (infer_slot >= 0 && !(event_bits & INFER_DONE)) {
+                xEventGroupWaitBits(m_event_group, INFER_DONE, pdTRUE, pdFALSE, portMAX_DELAY);
+            }
+            m_staged_frames[0].fb.reset();
+            m_staged_frames[1].fb.reset();
+            infer_slot = -1;
+            ready_slot = -1;
+            if (event_bits & TASK_STOP) {
+                break;
+            }
+            xEventGroupSetBits(m_event_group, TASK_PAUSED);
+            EventBits_t pause_event_bits =
+                xEventGroupWaitBits(m_event_group, TASK_RESUME | TASK_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+            if (pause_event_bits & TASK_STOP) {
+                break;
+            } else {
+                last_frame_time = xTaskGetTickCount() - m_interval;
+                continue;
+            }
+        }
+        if (event_bits & INFER_DONE) {
+            int done_slot = infer_slot;
+            // Keep the model busy, the next frame is inferred while this one is postprocessed.
+            infer_slot = ready_slot;
+            ready_slot = -1;
+            if (infer_slot >= 0) {
+                m_infer_worker->submit(infer_slot);
+            }
+            finish_staged_frame(m_staged_frames[done_slot], done_slot);
+        }
+        if (!(event_bits & NEW_FRAME) || ready_slot >= 0) {
+            continue;
+        }
+        // Skip the frames before the next one is due instead of sleeping, so that INFER_DONE is still served.
+        if (m_interval && xTaskGetTickCount() - last_frame_time < m_interval) {
+            continue;
+        }
+        last_frame_time = xTaskGetTickCount();
+        auto fb = m_frame_cap_node->cam_fb_acquire();
+        if (!fb) {
+            continue;
+        }
+        resolve_pyramid_level();
+        if (is_static(fb->trace.seq)) {
+            m_skip_cnt.fetch_add(1, std::memory_order_relaxed);
+            // The result to re-emit is not known yet while a frame is in flight, the frame is dropped without one.
+            if (infer_slot < 0) {
+                cam_fb_trace_t trace = fb->trace;
+                dl::image::img_t img = m_pyramid_node ? m_pyramid_node->get_level(*fb, m_pyramid_level)
+                                                      : static_cast<dl::image::img_t>(*fb);
+                call_result_cb(fb->timestamp, img, fb, trace);
             }
-            r.limit_keypoint(m_rescale_max_w, m_rescale_max_h);
+            continue;
         }
+        int slot = infer_slot == 0 ? 1 : 0;
+        staged_frame_t &frame = m_staged_frames[slot];
+        frame.img = static_cast<dl::image::img_t>(*fb);
+        frame.crop = fb->crop;
+        if (m_pyramid_node) {
+            frame.img = m_pyramid_node->get_level(*fb, m_pyramid_level);
+            frame.crop = m_pyramid_node->get_level_crop(m_pyramid_level).compose(fb->crop);
+        }
+        frame.timestamp = fb->timestamp;
+        frame.trace = fb->trace;
+        frame.fb = std::move(fb);
+        int64_t start_us = esp_timer_get_time();
+        m_stages->preprocess_slot(frame.img, slot);
+        frame.trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS, start_us, esp_timer_get_time());
+        tracer->record(frame.trace, cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS);
+        if (infer_slot < 0) {
+            infer_slot = slot;
+            m_infer_worker->submit(slot);
+        } else {
+            ready_slot = slot;
+        }
+    }
+}
+
+void WhoDetect::finish_staged_frame(staged_frame_t &frame, int slot)
+{
+    auto tracer = frame_cap::WhoFrameTracer::get_instance();
+    frame.trace.stamp(
+        cam_fb_stage_t::CAM_FB_STAGE_INFER, m_infer_worker->get_start_us(), m_infer_worker->get_end_us());
+    tracer->record(frame.trace, cam_fb_stage_t::CAM_FB_STAGE_INFER);
+    int64_t start_us = esp_timer_get_time();
+    auto &res = m_stages->postprocess_slot(frame.img, slot);
+    frame.trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS, start_us, esp_timer_get_time());
+    tracer->record(frame.trace, cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS);
+    m_infer_cnt.fetch_add(1, std::memory_order_relaxed);
+    apply_detect_result(res, frame.crop);
+    call_result_cb(frame.timestamp, frame.img, frame.fb, frame.trace);
+    frame.fb.reset();
+}
+
+void WhoDetect::apply_detect_result(const std::list<dl::detect::result_t> &result, const cam_fb_crop_t &crop)
+{
+    auto &det_res = m_result.det_res;
+    det_res.assign(result);
+    // Results of a cropped frame are mapped back to the frame it is cropped from, rescale is relative to that one.
+    if (!crop.is_identity()) {
+        uncrop_detect_result(det_res, crop);
+    }
+    if (m_roi_node) {
+        feed_back_rois(det_res);
     }
+    if (m_inv_rescale_x && m_inv_rescale_y && m_rescale_max_w && m_rescale_max_h) {
+        rescale_detect_result(det_res);
+    }
+    m_has_last_res = true;
+}
+
+void WhoDetect::call_result_cb(const struct timeval &timestamp,
+                               const dl::image::img_t &img,
+                               const frame_cap::WhoFrameRef &fb,
+                               cam_fb_trace_t &trace)
+{
+    if (!m_result_cb) {
+        return;
+    }
+    xSemaphoreTakeRecursive(m_result_cb_mutex, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+    trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB, start_us, 0);
+    m_result.timestamp = timestamp;
+    m_result.img = img;
+    m_result.fb = fb;
+    m_result.trace = trace;
+    m_result_cb(m_result);
+    // Don't keep the frame from recycling until the next result.
+    m_result.fb.reset();
+    trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB, start_us, esp_timer_get_time());
+    xSemaphoreGiveRecursive(m_result_cb_mutex);
+    frame_cap::WhoFrameTracer::get_instance()->record(trace, cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB);
+}
+
+std::list<dl::detect::result_t> &WhoDetect::run_model(const dl::image::img_t &img, cam_fb_trace_t &trace)
+{
+    auto tracer = frame_cap::WhoFrameTracer::get_instance();
+    int64_t t0 = esp_timer_get_time();
+    if (!m_stages) {
+        auto &res = m_model->run(img);
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_INFER, t0, esp_timer_get_time());
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_INFER);
+        return res;
+    }
+    m_stages->preprocess(img);
+    int64_t t1 = esp_timer_get_time();
+    m_stages->infer();
+    int64_t t2 = esp_timer_get_time();
+    auto &res = m_stages->postprocess(img);
+    int64_t t3 = esp_timer_get_time();
+    trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS, t0, t1);
+    trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_INFER, t1, t2);
+    trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS, t2, t3);
+    tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS);
+    tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_INFER);
+    tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS);
+    return res;
+}
+
+bool WhoDetect::is_static(uint32_t seq)
+{
+    if (!m_motion_node || !m_has_last_res) {
+        return false;
+    }
+    frame_cap::WhoMotionNode::motion_t motion;
+    // Run the model if the motion node falls behind.
+    bool skip = m_motion_node->get_motion(seq, motion) && motion.score < m_motion_thr;
+    if (skip && m_refresh_interval && m_skip_run >= m_refresh_interval) {
+        skip = false;
+    }
+    m_skip_run = skip ? m_skip_run + 1 : 0;
+    return skip;
+}
+
+void WhoDetect::uncrop_detect_result(detect_results_t &result, const cam::cam_fb_crop_t &crop)
+{
+    result.transform(crop.scale_x, crop.scale_y, crop.offset_x, crop.offset_y);
+}
+
+void WhoDetect::feed_back_rois(const detect_results_t &result)
+{
+    std::vector<std::vector<int>> boxes;
+    for (int i = 0; i < result.n; i++) {
+        boxes.push_back({result.box[i][0], result.box[i][1], result.box[i][2], result.box[i][3]});
+    }
+    m_roi_node->set_dynamic_rois(boxes, m_roi_margin, m_roi_ttl);
+}
+
+void WhoDetect::rescale_detect_result(detect_results_t &result)
+{
+    result.transform(m_inv_rescale_x, m_inv_rescale_y, 0, 0, m_rescale_max_w, m_rescale_max_h);
 }
 
 bool WhoDetect::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
@@ -120,6 +441,26 @@ bool WhoDetect::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPri
         ESP_LOGE("WhoDetect", "detect model is nullptr, please call set_model() first.");
         return false;
     }
+    dl::image::pix_type_t pix_type;
+    if (!cam::cam_fb_fmt2dl_pix_fmt(m_frame_cap_node->get_fb_format(), pix_type)) {
+        ESP_LOGE("WhoDetect", "The frames of %s can't be detected on.", m_frame_cap_node->get_name().c_str());
+        return false;
+    }
+    if (m_stage_core >= 0 && !m_infer_worker) {
+        if (m_stages && m_stages->init_slots() >= 2) {
+            m_infer_worker = new WhoDetectInferWorker(get_name() + "Infer", m_stages, m_event_group, INFER_DONE);
+        } else {
+            ESP_LOGW("WhoDetect", "The model does not support the staged mode, run it unstaged.");
+            m_stage_core = -1;
+        }
+    }
+    if (m_infer_worker) {
+        // The worker is stopped by the staged task when it stops.
+        if (!m_infer_worker->run(uxStackDepth, uxPriority, xCoreID)) {
+            return false;
+        }
+        return task::WhoTask::run(uxStackDepth, uxPriority, m_stage_core);
+    }
     return task::WhoTask::run(uxStackDepth, uxPriority, xCoreID);
 }
 
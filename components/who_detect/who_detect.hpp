@@ -1,23 +1,85 @@
 #pragma once
 #include "dl_detect_base.hpp"
+#include "who_detect_result.hpp"
+#include "who_detect_stages.hpp"
 #include "who_frame_cap.hpp"
+#include <concepts>
 
 namespace who {
 namespace detect {
+// Runs infer_slot() of the staged mode of WhoDetect on a core of its own.
+class WhoDetectInferWorker : public task::WhoTask {
+public:
+    WhoDetectInferWorker(const std::string &name,
+                         DetectStages *stages,
+                         EventGroupHandle_t done_event_group,
+                         EventBits_t done_bit);
+    ~WhoDetectInferWorker();
+    bool stop_async() override;
+    // done_bit is set in done_event_group when the slot is inferred.
+    void submit(int slot);
+    int64_t get_start_us() { return m_start_us; }
+    int64_t get_end_us() { return m_end_us; }
+
+private:
+    void task() override;
+    DetectStages *m_stages;
+    EventGroupHandle_t m_done_event_group;
+    EventBits_t m_done_bit;
+    QueueHandle_t m_slots;
+    // Of the last slot, read after done_bit is set.
+    int64_t m_start_us;
+    int64_t m_end_us;
+};
+
 class WhoDetect : public task::WhoTask {
 public:
     static inline constexpr EventBits_t NEW_FRAME = frame_cap::WhoFrameCapNode::NEW_FRAME;
+    static inline constexpr EventBits_t INFER_DONE = NEW_FRAME << 1;
 
     typedef struct {
-        std::list<dl::detect::result_t> det_res;
+        detect_results_t det_res;
         struct timeval timestamp;
         dl::image::img_t img;
+        // Keeps img valid after the result callback returns.
+        frame_cap::WhoFrameRef fb;
+        // Trace of fb with the detect stages stamped. Only the enter stamp of the result callback stage is set when the
+        // callback is called.
+        cam::cam_fb_trace_t trace;
     } result_t;
 
     WhoDetect(const std::string &name, frame_cap::WhoFrameCapNode *frame_cap_node);
     ~WhoDetect();
-    void set_model(dl::detect::Detect *model);
+    // Pass stages to trace preprocess, infer and postprocess separately, otherwise the whole run is traced as infer.
+    void set_model(dl::detect::Detect *model, DetectStages *stages = nullptr);
+    template <typename T>
+        requires std::derived_from<T, dl::detect::Detect> && std::derived_from<T, DetectStages>
+    void set_model(T *model)
+    {
+        set_model(model, model);
+    }
+    frame_cap::WhoFrameCapNode *get_frame_cap_node() { return m_frame_cap_node; }
     void set_rescale_params(float rescale_x, float rescale_y, uint16_t rescale_max_w, uint16_t rescale_max_h);
+    // The frame cap node must be a WhoPyramidNode. Detect on one level of its frames, the results are mapped back to
+    // the frame the pyramid is built from. level -1 means the smallest level that is at least w x h.
+    void set_pyramid_level(int level, uint16_t w = 0, uint16_t h = 0);
+    // Zoom roi_node onto the boxes of every non-empty result. The boxes are in the frame roi_node crops from, so the
+    // frames detected here must be cropped by roi_node or come from the same parent frame.
+    void set_roi_feedback(frame_cap::WhoROICropNode *roi_node, float margin = 0.5f, int ttl = 3);
+    // Skip the model and re-emit the previous result for the frames whose motion score from motion_node is below
+    // threshold. motion_node must branch from an ancestor of the detected node, so that the frames share the seq. If
+    // refresh_interval is not 0, the model still runs after that many skipped frames in a row.
+    void set_motion_gate(frame_cap::WhoMotionNode *motion_node, float threshold, int refresh_interval = 0);
+    // Overlap the stages of consecutive frames if the model supports DetectStages::init_slots(). Preprocess and
+    // postprocess run on stage_core, while infer stays on the core passed to run(). The results come out in frame
+    // order. Frames arriving while a frame waits for infer are skipped, and so are the static frames of the motion
+    // gate while a frame is in flight, see get_skip_cnt(). Only before the first run.
+    void set_staged(BaseType_t stage_core = 0);
+    // Frames the model ran on.
+    uint32_t get_infer_cnt() { return m_infer_cnt.load(std::memory_order_relaxed); }
+    // Static frames the motion gate kept from the model, including the ones dropped without a result in staged mode.
+    // The frames arriving while a frame waits for infer are never taken from the frame cap node and are not counted.
+    uint32_t get_skip_cnt() { return m_skip_cnt.load(std::memory_order_relaxed); }
     void set_fps(float fps);
     void set_detect_result_cb(const std::function<void(const result_t &)> &result_cb);
     void set_cleanup_func(const std::function<void()> &cleanup_func);
@@ -26,20 +88,64 @@ public:
     bool pause_async() override;
 
 private:
+    typedef struct {
+        frame_cap::WhoFrameRef fb;
+        dl::image::img_t img;
+        cam::cam_fb_crop_t crop;
+        struct timeval timestamp;
+        cam::cam_fb_trace_t trace;
+    } staged_frame_t;
+
     void task() override;
+    void task_staged();
+    void resolve_pyramid_level();
     void cleanup() override;
-    void rescale_detect_result(std::list<dl::detect::result_t> &result);
+    // Copies the results of the model into m_result, maps them to the frame, and feeds them back to the roi node.
+    void apply_detect_result(const std::list<dl::detect::result_t> &result, const cam::cam_fb_crop_t &crop);
+    // Calls the result callback with the results in m_result.
+    void call_result_cb(const struct timeval &timestamp,
+                        const dl::image::img_t &img,
+                        const frame_cap::WhoFrameRef &fb,
+                        cam::cam_fb_trace_t &trace);
+    void finish_staged_frame(staged_frame_t &frame, int slot);
+    // Maps the results on a frame cropped out of another frame back to that frame.
+    static void uncrop_detect_result(detect_results_t &result, const cam::cam_fb_crop_t &crop);
+    void rescale_detect_result(detect_results_t &result);
+    void feed_back_rois(const detect_results_t &result);
+    bool is_static(uint32_t seq);
+    std::list<dl::detect::result_t> &run_model(const dl::image::img_t &img, cam::cam_fb_trace_t &trace);
 
     frame_cap::WhoFrameCapNode *m_frame_cap_node;
     dl::detect::Detect *m_model;
+    DetectStages *m_stages;
     TickType_t m_interval;
     float m_inv_rescale_x;
     float m_inv_rescale_y;
     uint16_t m_rescale_max_w;
     uint16_t m_rescale_max_h;
+    frame_cap::WhoPyramidNode *m_pyramid_node;
+    int m_pyramid_level;
+    uint16_t m_pyramid_w;
+    uint16_t m_pyramid_h;
+    frame_cap::WhoROICropNode *m_roi_node;
+    float m_roi_margin;
+    int m_roi_ttl;
+    frame_cap::WhoMotionNode *m_motion_node;
+    float m_motion_thr;
+    int m_refresh_interval;
+    int m_skip_run;
+    bool m_has_last_res;
+    // Preallocated for the results of every frame, det_res is kept for the motion gate to re-emit.
+    result_t m_result;
+    std::atomic<uint32_t> m_infer_cnt;
+    std::atomic<uint32_t> m_skip_cnt;
     std::function<void(const result_t &)> m_result_cb;
     std::function<void()> m_cleanup;
     SemaphoreHandle_t m_result_cb_mutex;
+    // -1 if not staged.
+    BaseType_t m_stage_core;
+    WhoDetectInferWorker *m_infer_worker;
+    staged_frame_t m_staged_frames[2];
 };
 } // namespace detect
 } // namespace who
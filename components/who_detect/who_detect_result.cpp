@@ -0,0 +1,102 @@
+#include "who_detect_result.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace who {
+namespace detect {
+detect_results_t &detect_results_t::operator=(const detect_results_t &other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    n = other.n;
+    n_keypoints = other.n_keypoints;
+    memcpy(box, other.box, sizeof(box[0]) * n);
+    memcpy(score, other.score, sizeof(score[0]) * n);
+    memcpy(category, other.category, sizeof(category[0]) * n);
+    if (n_keypoints) {
+        memcpy(keypoint, other.keypoint, sizeof(keypoint[0]) * n);
+    }
+    return *this;
+}
+
+bool detect_results_t::push_back(const dl::detect::result_t &res)
+{
+    if (n == MAX_RESULTS) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        box[n][i] = res.box[i];
+    }
+    score[n] = res.score;
+    category[n] = res.category;
+    if (n == 0) {
+        n_keypoints = std::min((int)res.keypoint.size(), MAX_KEYPOINTS);
+    }
+    for (int i = 0; i < n_keypoints; i++) {
+        keypoint[n][i] = i < res.keypoint.size() ? res.keypoint[i] : 0;
+    }
+    n++;
+    return true;
+}
+
+void detect_results_t::assign(const std::list<dl::detect::result_t> &res)
+{
+    n = 0;
+    n_keypoints = 0;
+    for (const auto &r : res) {
+        if (!push_back(r)) {
+            break;
+        }
+    }
+}
+
+void detect_results_t::to_list(std::list<dl::detect::result_t> &res) const
+{
+    res.resize(n);
+    auto it = res.begin();
+    for (int i = 0; i < n; i++, it++) {
+        it->category = category[i];
+        it->score = score[i];
+        it->box.assign(box[i], box[i] + 4);
+        it->keypoint.assign(keypoint[i], keypoint[i] + n_keypoints);
+    }
+}
+
+// Coordinates are interleaved x, y, so even and odd elements take the x and y params.
+static void transform_xy(int16_t *xy,
+                         int len,
+                         float scale_x,
+                         float scale_y,
+                         float offset_x,
+                         float offset_y,
+                         int max_w,
+                         int max_h)
+{
+    const float scale[2] = {scale_x, scale_y};
+    const float offset[2] = {offset_x, offset_y};
+    for (int i = 0; i < len; i++) {
+        xy[i] = (int)(xy[i] * scale[i & 1] + offset[i & 1]);
+    }
+    if (!max_w || !max_h) {
+        return;
+    }
+    const int16_t max[2] = {(int16_t)(max_w - 1), (int16_t)(max_h - 1)};
+    for (int i = 0; i < len; i++) {
+        xy[i] = std::clamp<int16_t>(xy[i], 0, max[i & 1]);
+    }
+}
+
+void detect_results_t::transform(float scale_x, float scale_y, float offset_x, float offset_y, int max_w, int max_h)
+{
+    transform_xy(&box[0][0], n * 4, scale_x, scale_y, offset_x, offset_y, max_w, max_h);
+    if (n_keypoints == MAX_KEYPOINTS) {
+        transform_xy(&keypoint[0][0], n * MAX_KEYPOINTS, scale_x, scale_y, offset_x, offset_y, max_w, max_h);
+    } else {
+        for (int i = 0; i < n; i++) {
+            transform_xy(keypoint[i], n_keypoints, scale_x, scale_y, offset_x, offset_y, max_w, max_h);
+        }
+    }
+}
+} // namespace detect
+} // namespace who
@@ -0,0 +1,40 @@
+#pragma once
+#include "dl_detect_base.hpp"
+
+namespace who {
+namespace detect {
+// The results of a frame as a fixed capacity structure of arrays. Unlike the list of dl::detect::result_t returned by
+// the models, it is copied by value without heap allocation, and coordinates are mapped in one pass over each array.
+// Only the first n entries of the arrays are valid, and only those are copied.
+struct detect_results_t {
+    static inline constexpr int MAX_RESULTS = 32;
+    // 5 points of x, y.
+    static inline constexpr int MAX_KEYPOINTS = 10;
+
+    int n;
+    // Keypoint coordinates of every result, 0 if the model has none.
+    int n_keypoints;
+    // x1, y1, x2, y2.
+    int16_t box[MAX_RESULTS][4];
+    float score[MAX_RESULTS];
+    int16_t category[MAX_RESULTS];
+    int16_t keypoint[MAX_RESULTS][MAX_KEYPOINTS];
+
+    detect_results_t() : n(0), n_keypoints(0) {}
+    detect_results_t(const detect_results_t &other) { *this = other; }
+    detect_results_t &operator=(const detect_results_t &other);
+    int size() const { return n; }
+    bool empty() const { return !n; }
+    void clear() { n = 0; }
+    // Returns false if full.
+    bool push_back(const dl::detect::result_t &res);
+    // The models sort the list in descending score, the results beyond MAX_RESULTS are the worst ones and dropped.
+    void assign(const std::list<dl::detect::result_t> &res);
+    // For the esp-dl apis which take a list, e.g. the recognizer. Nodes already in res are reused.
+    void to_list(std::list<dl::detect::result_t> &res) const;
+    // x * scale_x + offset_x and y * scale_y + offset_y for every box and keypoint, then clipped to
+    // [0, max_w - 1] x [0, max_h - 1] unless max_w or max_h is 0.
+    void transform(float scale_x, float scale_y, float offset_x, float offset_y, int max_w = 0, int max_h = 0);
+};
+} // namespace detect
+} // namespace who
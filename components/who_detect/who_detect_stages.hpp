@@ -0,0 +1,36 @@
+#pragma once
+#include "dl_detect_base.hpp"
+
+namespace who {
+namespace detect {
+// Optional interface of a detect model which splits run() into its stages, so that WhoDetect can trace them one by
+// one. The stages are called in order on the same img, postprocess() returns the same list as run().
+class DetectStages {
+public:
+    virtual ~DetectStages() = default;
+    virtual void preprocess(const dl::image::img_t &img) = 0;
+    virtual void infer() = 0;
+    virtual std::list<dl::detect::result_t> &postprocess(const dl::image::img_t &img) = 0;
+
+    // Staged mode of WhoDetect, where preprocess of a frame, infer of the one before and postprocess of the one before
+    // that overlap. The model keeps a copy of its input and output per slot, so that the stages of different frames do
+    // not share buffers. A frame goes through the three stages below with the same slot. Returns the number of slots
+    // allocated, 0 if the model does not support it.
+    virtual int init_slots() { return 0; }
+    virtual void preprocess_slot(const dl::image::img_t &img, int slot) {}
+    virtual void infer_slot(int slot) {}
+    virtual std::list<dl::detect::result_t> &postprocess_slot(const dl::image::img_t &img, int slot)
+    {
+        return postprocess(img);
+    }
+
+    // Shared preprocessing of WhoMultiDetect, for the models which preprocess with a dl::image::ImagePreprocessor.
+    // Models returning the same non-zero key turn a frame into the same input, so only the first one preprocesses it.
+    // The others call adopt_preprocessed() with its preprocessor instead of preprocess(): they copy its model input and
+    // take the resize and crop of the frame from it in postprocess().
+    virtual uint32_t get_preprocess_key() { return 0; }
+    virtual dl::image::ImagePreprocessor *get_image_preprocessor() { return nullptr; }
+    virtual void adopt_preprocessed(dl::image::ImagePreprocessor *src) {}
+};
+} // namespace detect
+} // namespace who
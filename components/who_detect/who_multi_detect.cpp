@@ -0,0 +1,301 @@
+#include "who_multi_detect.hpp"
+#include "esp_timer.h"
+#include <algorithm>
+
+using namespace who::cam;
+
+#if CONFIG_IDF_TARGET_ESP32P4
+static constexpr uint32_t s_resize_caps = 0;
+#else
+static constexpr uint32_t s_resize_caps = dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+#endif
+
+namespace who {
+namespace detect {
+WhoMultiDetect::WhoMultiDetect(const std::string &name, frame_cap::WhoFrameCapNode *frame_cap_node) :
+    task::WhoTask(name),
+    m_frame_cap_node(frame_cap_node),
+    m_schedule(schedule_t::SCHEDULE_FPS),
+    m_budget_us(0),
+    m_next_model(0),
+    m_shared_cnt(0),
+    m_inv_rescale_x(0),
+    m_inv_rescale_y(0),
+    m_rescale_max_w(0),
+    m_rescale_max_h(0),
+    m_result_cb_mutex(xSemaphoreCreateRecursiveMutex()),
+    m_result()
+{
+    frame_cap_node->add_new_frame_signal_subscriber(this);
+}
+
+WhoMultiDetect::~WhoMultiDetect()
+{
+    vSemaphoreDelete(m_result_cb_mutex);
+    for (auto &m : m_models) {
+        delete m.model;
+    }
+    for (auto &input : m_inputs) {
+        if (input.pool) {
+            input.pool->put(input.fb);
+            delete input.pool;
+        }
+    }
+}
+
+int WhoMultiDetect::add_model(dl::detect::Detect *model, DetectStages *stages, float fps, int priority)
+{
+    auto &m = m_models.emplace_back();
+    m.model = model;
+    m.stages = stages;
+    m.input = -1;
+    m.interval_us = fps > 0 ? (int64_t)(1000000.f / fps) : 0;
+    m.priority = priority;
+    m.next_run_us = 0;
+    m.n_skipped = 0;
+    m.run_us = 0;
+    m.infer_cnt = 0;
+    return m_models.size() - 1;
+}
+
+void WhoMultiDetect::set_model_input_shape(int model_idx, uint16_t w, uint16_t h)
+{
+    auto it = std::find_if(m_inputs.begin(), m_inputs.end(), [w, h](const input_t &input) {
+        return input.width == w && input.height == h;
+    });
+    if (it == m_inputs.end()) {
+        m_inputs.push_back(
+            {w, h, frame_cap::WhoImageResizer(frame_cap::resize_interp_t::RESIZE_INTERP_BILINEAR, s_resize_caps)});
+        it = m_inputs.end() - 1;
+    }
+    m_models[model_idx].input = it - m_inputs.begin();
+}
+
+void WhoMultiDetect::set_rescale_params(float rescale_x,
+                                        float rescale_y,
+                                        uint16_t rescale_max_w,
+                                        uint16_t rescale_max_h)
+{
+    m_inv_rescale_x = 1.f / rescale_x;
+    m_inv_rescale_y = 1.f / rescale_y;
+    m_rescale_max_w = rescale_max_w;
+    m_rescale_max_h = rescale_max_h;
+}
+
+void WhoMultiDetect::set_schedule(schedule_t schedule, int budget_ms)
+{
+    m_schedule = schedule;
+    m_budget_us = budget_ms * 1000;
+}
+
+void WhoMultiDetect::set_detect_result_cb(int model_idx,
+                                          const std::function<void(const WhoDetect::result_t &)> &result_cb)
+{
+    xSemaphoreTakeRecursive(m_result_cb_mutex, portMAX_DELAY);
+    m_models[model_idx].result_cb = result_cb;
+    xSemaphoreGiveRecursive(m_result_cb_mutex);
+}
+
+void WhoMultiDetect::set_cleanup_func(const std::function<void()> &cleanup_func)
+{
+    m_cleanup = cleanup_func;
+}
+
+void WhoMultiDetect::task()
+{
+    std::vector<int> order;
+    while (true) {
+        EventBits_t event_bits =
+            xEventGroupWaitBits(m_event_group, NEW_FRAME | TASK_PAUSE | TASK_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+        if (event_bits & TASK_STOP) {
+            break;
+        } else if (event_bits & TASK_PAUSE) {
+            xEventGroupSetBits(m_event_group, TASK_PAUSED);
+            EventBits_t pause_event_bits =
+                xEventGroupWaitBits(m_event_group, TASK_RESUME | TASK_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+            if (pause_event_bits & TASK_STOP) {
+                break;
+            } else {
+                continue;
+            }
+        }
+        auto fb = m_frame_cap_node->cam_fb_acquire();
+        if (!fb) {
+            continue;
+        }
+        dl::image::img_t img = static_cast<dl::image::img_t>(*fb);
+        int64_t start_us = esp_timer_get_time();
+        schedule(start_us, order);
+        m_preprocessed.clear();
+        for (auto &input : m_inputs) {
+            input.ready = false;
+        }
+        for (int idx : order) {
+            // The first model always runs, so that a budget smaller than any model does not stall the detection.
+            int64_t elapsed_us = esp_timer_get_time() - start_us;
+            if (m_schedule == schedule_t::SCHEDULE_PRIORITY && m_budget_us && idx != order.front() &&
+                elapsed_us + m_models[idx].run_us > m_budget_us) {
+                m_models[idx].n_skipped++;
+                continue;
+            }
+            run_model(idx, fb, img);
+        }
+    }
+    xEventGroupSetBits(m_event_group, TASK_STOPPED);
+    vTaskDelete(NULL);
+}
+
+void WhoMultiDetect::schedule(int64_t now_us, std::vector<int> &order)
+{
+    order.clear();
+    int n = m_models.size();
+    switch (m_schedule) {
+    case schedule_t::SCHEDULE_ROUND_ROBIN:
+        order.push_back(m_next_model);
+        m_next_model = (m_next_model + 1) % n;
+        break;
+    case schedule_t::SCHEDULE_FPS:
+        for (int i = 0; i < n; i++) {
+            auto &m = m_models[i];
+            if (now_us < m.next_run_us) {
+                continue;
+            }
+            // Keep the cadence, unless the model fell behind by more than an interval.
+            m.next_run_us = std::max(m.next_run_us + m.interval_us, now_us);
+            order.push_back(i);
+        }
+        break;
+    case schedule_t::SCHEDULE_PRIORITY:
+        for (int i = 0; i < n; i++) {
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+            return m_models[a].priority + m_models[a].n_skipped > m_models[b].priority + m_models[b].n_skipped;
+        });
+        break;
+    }
+}
+
+void WhoMultiDetect::run_model(int idx, const frame_cap::WhoFrameRef &fb, const dl::image::img_t &img)
+{
+    auto &m = m_models[idx];
+    auto tracer = frame_cap::WhoFrameTracer::get_instance();
+    // fb is shared with the other subscribers and the other models, stamp a copy of its trace.
+    cam_fb_trace_t trace = fb->trace;
+    int64_t t0 = esp_timer_get_time();
+    dl::image::img_t model_img = img;
+    if (m.input >= 0 && !get_input(m.input, *fb, model_img)) {
+        return;
+    }
+    std::list<dl::detect::result_t> *res;
+    if (!m.stages) {
+        res = &m.model->run(model_img);
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_INFER, t0, esp_timer_get_time());
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_INFER);
+    } else {
+        uint32_t key = m.stages->get_preprocess_key();
+        auto it = std::find_if(m_preprocessed.begin(), m_preprocessed.end(), [key, &m](const preprocessed_t &p) {
+            return p.key == key && p.input == m.input;
+        });
+        if (key && it != m_preprocessed.end()) {
+            m.stages->adopt_preprocessed(it->stages->get_image_preprocessor());
+            m_shared_cnt.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m.stages->preprocess(model_img);
+            if (key && m.stages->get_image_preprocessor()) {
+                m_preprocessed.push_back({key, m.input, m.stages});
+            }
+        }
+        int64_t t1 = esp_timer_get_time();
+        m.stages->infer();
+        int64_t t2 = esp_timer_get_time();
+        res = &m.stages->postprocess(model_img);
+        int64_t t3 = esp_timer_get_time();
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS, t0, t1);
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_INFER, t1, t2);
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS, t2, t3);
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS);
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_INFER);
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS);
+    }
+    m.run_us = esp_timer_get_time() - t0;
+    m.n_skipped = 0;
+    m.infer_cnt.fetch_add(1, std::memory_order_relaxed);
+    xSemaphoreTakeRecursive(m_result_cb_mutex, portMAX_DELAY);
+    if (m.result_cb) {
+        auto &det_res = m_result.det_res;
+        det_res.assign(*res);
+        // Results on a resized frame are mapped back to the frame, those of a cropped frame to the frame it is cropped
+        // from, rescale is relative to that one.
+        if (m.input >= 0) {
+            det_res.transform((float)img.width / model_img.width, (float)img.height / model_img.height, 0, 0);
+        }
+        const cam_fb_crop_t &crop = fb->crop;
+        if (!crop.is_identity()) {
+            det_res.transform(crop.scale_x, crop.scale_y, crop.offset_x, crop.offset_y);
+        }
+        if (m_inv_rescale_x && m_inv_rescale_y && m_rescale_max_w && m_rescale_max_h) {
+            det_res.transform(m_inv_rescale_x, m_inv_rescale_y, 0, 0, m_rescale_max_w, m_rescale_max_h);
+        }
+        int64_t start_us = esp_timer_get_time();
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB, start_us, 0);
+        m_result.timestamp = fb->timestamp;
+        m_result.img = img;
+        m_result.fb = fb;
+        m_result.trace = trace;
+        m.result_cb(m_result);
+        m_result.fb.reset();
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB, start_us, esp_timer_get_time());
+        tracer->record(trace, cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB);
+    }
+    xSemaphoreGiveRecursive(m_result_cb_mutex);
+}
+
+bool WhoMultiDetect::get_input(int input_idx, const cam_fb_t &fb, dl::image::img_t &img)
+{
+    auto &input = m_inputs[input_idx];
+    if (input.ready) {
+        m_shared_cnt.fetch_add(1, std::memory_order_relaxed);
+    } else if (input.resizer.resize(fb, *input.fb)) {
+        input.ready = true;
+    } else {
+        return false;
+    }
+    img = *input.fb;
+    return true;
+}
+
+bool WhoMultiDetect::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    if (m_models.empty()) {
+        ESP_LOGE("WhoMultiDetect", "No detect model, please call add_model() first.");
+        return false;
+    }
+    dl::image::pix_type_t pix_type;
+    if (!cam::cam_fb_fmt2dl_pix_fmt(m_frame_cap_node->get_fb_format(), pix_type)) {
+        ESP_LOGE("WhoMultiDetect", "The frames of %s can't be detected on.", m_frame_cap_node->get_name().c_str());
+        return false;
+    }
+    for (auto &input : m_inputs) {
+        if (input.pool) {
+            continue;
+        }
+        dl::image::img_t img = {.data = nullptr, .width = input.width, .height = input.height, .pix_type = pix_type};
+        input.pool = frame_cap::WhoFramePool::create(img, 1);
+        if (!input.pool) {
+            ESP_LOGE("WhoMultiDetect", "Failed to allocate the %dx%d model input.", input.width, input.height);
+            return false;
+        }
+        input.fb = input.pool->get();
+    }
+    return task::WhoTask::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+void WhoMultiDetect::cleanup()
+{
+    if (m_cleanup) {
+        m_cleanup();
+    }
+}
+} // namespace detect
+} // namespace who
@@ -0,0 +1,110 @@
+#pragma once
+#include "who_detect.hpp"
+#include <deque>
+
+namespace who {
+namespace detect {
+// Runs several detect models on the frames of one frame cap node, instead of a WhoDetect task per model each
+// subscribing to the node. Models sharing a preprocess key, see DetectStages::get_preprocess_key(), preprocess a frame
+// once between them. The models which preprocess inside run() share the resize of the frame to their input shape
+// instead, see set_model_input_shape().
+class WhoMultiDetect : public task::WhoTask {
+public:
+    static inline constexpr EventBits_t NEW_FRAME = frame_cap::WhoFrameCapNode::NEW_FRAME;
+
+    enum class schedule_t {
+        // One model per frame, in turn.
+        SCHEDULE_ROUND_ROBIN,
+        // Every model at the fps it is added with, all of them on every frame if fps is 0.
+        SCHEDULE_FPS,
+        // The models in descending priority until the budget of the frame is spent. A model skipped n frames in a row
+        // is ranked as priority + n, so that it is not starved.
+        SCHEDULE_PRIORITY,
+    };
+
+    WhoMultiDetect(const std::string &name, frame_cap::WhoFrameCapNode *frame_cap_node);
+    ~WhoMultiDetect();
+    // Returns the index of the model. fps is for SCHEDULE_FPS, priority for SCHEDULE_PRIORITY.
+    int add_model(dl::detect::Detect *model, DetectStages *stages = nullptr, float fps = 0, int priority = 0);
+    template <typename T>
+        requires std::derived_from<T, dl::detect::Detect> && std::derived_from<T, DetectStages>
+    int add_model(T *model, float fps = 0, int priority = 0)
+    {
+        return add_model(model, model, fps, priority);
+    }
+    // Resize the frames to w x h before the model runs, once for all the models of the same shape, so that the
+    // preprocessor of the model only converts the pixels. The results are mapped back to the frame. Only before the
+    // first run.
+    void set_model_input_shape(int model_idx, uint16_t w, uint16_t h);
+    void set_rescale_params(float rescale_x, float rescale_y, uint16_t rescale_max_w, uint16_t rescale_max_h);
+    // budget_ms is the time per frame of SCHEDULE_PRIORITY, at least the first model runs. Only before the first run.
+    void set_schedule(schedule_t schedule, int budget_ms = 0);
+    void set_detect_result_cb(int model_idx, const std::function<void(const WhoDetect::result_t &)> &result_cb);
+    void set_cleanup_func(const std::function<void()> &cleanup_func);
+    uint32_t get_infer_cnt(int model_idx) { return m_models[model_idx].infer_cnt.load(std::memory_order_relaxed); }
+    // Number of times a model took a frame preprocessed by another model of the same preprocess key, or resized for
+    // another model of the same input shape.
+    uint32_t get_shared_preprocess_cnt() { return m_shared_cnt.load(std::memory_order_relaxed); }
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+
+private:
+    struct model_t {
+        dl::detect::Detect *model;
+        DetectStages *stages;
+        // Index in m_inputs, -1 to run on the frame itself.
+        int input;
+        int64_t interval_us;
+        int priority;
+        int64_t next_run_us;
+        int n_skipped;
+        // Of the last run, to tell if the model fits in the rest of the budget.
+        int64_t run_us;
+        std::atomic<uint32_t> infer_cnt;
+        std::function<void(const WhoDetect::result_t &)> result_cb;
+    };
+
+    // A frame resized to the input shape of some models.
+    struct input_t {
+        uint16_t width;
+        uint16_t height;
+        frame_cap::WhoImageResizer resizer;
+        frame_cap::WhoFramePool *pool;
+        cam::cam_fb_t *fb;
+        // Whether fb holds the current frame.
+        bool ready;
+    };
+
+    struct preprocessed_t {
+        uint32_t key;
+        int input;
+        DetectStages *stages;
+    };
+
+    void task() override;
+    void cleanup() override;
+    // Indices of the models to run on the frame, in order.
+    void schedule(int64_t now_us, std::vector<int> &order);
+    void run_model(int idx, const frame_cap::WhoFrameRef &fb, const dl::image::img_t &img);
+    // The frame resized to m_inputs[input_idx], resized on the first call per frame.
+    bool get_input(int input_idx, const cam::cam_fb_t &fb, dl::image::img_t &img);
+
+    frame_cap::WhoFrameCapNode *m_frame_cap_node;
+    std::deque<model_t> m_models;
+    std::vector<input_t> m_inputs;
+    schedule_t m_schedule;
+    int64_t m_budget_us;
+    int m_next_model;
+    // Models which preprocessed the current frame, by preprocess key and input.
+    std::vector<preprocessed_t> m_preprocessed;
+    std::atomic<uint32_t> m_shared_cnt;
+    float m_inv_rescale_x;
+    float m_inv_rescale_y;
+    uint16_t m_rescale_max_w;
+    uint16_t m_rescale_max_h;
+    std::function<void()> m_cleanup;
+    SemaphoreHandle_t m_result_cb_mutex;
+    // Preallocated for the results of every model.
+    WhoDetect::result_t m_result;
+};
+} // namespace detect
+} // namespace who
@@ -0,0 +1,23 @@
+#pragma once
+#include "dl_image.hpp"
+#include <list>
+#include <vector>
+
+// The detect interface of esp-dl, for the linux target only. There is no model runtime on the host, a Detect is
+// implemented in plain code, e.g. by the SynthDetect of pipeline_stress.
+namespace dl {
+namespace detect {
+struct result_t {
+    int category;
+    float score;
+    std::vector<int> box;
+    std::vector<int> keypoint;
+};
+
+class Detect {
+public:
+    virtual ~Detect() {}
+    virtual std::list<result_t> &run(const dl::image::img_t &img) = 0;
+};
+} // namespace detect
+} // namespace dl
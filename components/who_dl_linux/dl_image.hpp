@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The image types of esp-dl the pipeline components use, for the linux target only.
+namespace dl {
+namespace image {
+typedef enum {
+    DL_IMAGE_PIX_TYPE_RGB888 = 0,
+    DL_IMAGE_PIX_TYPE_RGB565,
+    DL_IMAGE_PIX_TYPE_GRAY,
+} pix_type_t;
+
+const uint32_t DL_IMAGE_CAP_RGB_SWAP = 1 << 0;
+const uint32_t DL_IMAGE_CAP_RGB565_BIG_ENDIAN = 1 << 1;
+
+typedef struct {
+    void *data;
+    uint16_t width;
+    uint16_t height;
+    pix_type_t pix_type;
+} img_t;
+
+class ImagePreprocessor;
+
+inline size_t get_pix_byte_size(pix_type_t pix_type)
+{
+    switch (pix_type) {
+    case DL_IMAGE_PIX_TYPE_RGB888:
+        return 3;
+    case DL_IMAGE_PIX_TYPE_RGB565:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+inline size_t get_img_byte_size(const img_t &img)
+{
+    return (size_t)img.width * img.height * get_pix_byte_size(img.pix_type);
+}
+
+inline size_t align_up(size_t num, size_t align)
+{
+    return (num + align - 1) & ~(align - 1);
+}
+} // namespace image
+} // namespace dl
@@ -14,6 +14,49 @@ bool WhoFrameCap::run(std::vector<std::tuple<const configSTACK_DEPTH_TYPE, UBase
     return ret;
 }
 
+void WhoFrameCap::add_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child)
+{
+    WhoFrameCapEdge *edge = new WhoFrameCapEdge(parent, child, parent->get_default_edge_config());
+    child->add_prev_edge(edge);
+    parent->add_next_edge(edge);
+    m_edges.emplace_back(edge);
+}
+
+WhoFrameCapEdge *WhoFrameCap::get_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child)
+{
+    auto it = std::find_if(m_edges.begin(), m_edges.end(), [parent, child](const auto &edge) -> bool {
+        return edge->prev_node == parent && edge->next_node == child;
+    });
+    if (it != m_edges.end()) {
+        return *it;
+    }
+    ESP_LOGE(TAG, "No edge from %s to %s.", parent->get_name().c_str(), child->get_name().c_str());
+    return nullptr;
+}
+
+bool WhoFrameCap::config_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child, const edge_config_t &cfg)
+{
+    if (cfg.depth < 1 || cfg.keep_every_n < 1) {
+        ESP_LOGE(TAG, "Edge depth and keep_every_n must be at least 1.");
+        return false;
+    }
+    WhoFrameCapEdge *edge = get_edge(parent, child);
+    if (!edge) {
+        return false;
+    }
+    if (parent->is_active() || child->is_active()) {
+        ESP_LOGE(TAG, "Edge can only be configured before the nodes run.");
+        return false;
+    }
+    if (cfg.depth != edge->config.depth) {
+        vQueueDelete(edge->queue);
+        edge->queue = xQueueCreate(cfg.depth, sizeof(who::cam::cam_fb_t *));
+    }
+    edge->config = cfg;
+    child->update_in_sem();
+    return true;
+}
+
 WhoFrameCapNode *WhoFrameCap::get_node(const std::string &name)
 {
     auto it = std::find_if(
@@ -1,35 +1,68 @@
 #pragma once
 #include "who_frame_cap_node.hpp"
+#include <type_traits>
 
 namespace who {
 namespace frame_cap {
+// Whether the first arg of add_node() is the parent(s) of the new node rather than a node ctor arg.
+template <typename... Args>
+struct is_parent_arg : std::false_type {};
+template <typename First, typename... Rest>
+struct is_parent_arg<First, Rest...>
+    : std::bool_constant<std::is_convertible_v<First, WhoFrameCapNode *> ||
+                         std::is_convertible_v<First, const std::vector<WhoFrameCapNode *> &>> {};
+
 class WhoFrameCap : public task::WhoTaskGroup {
 public:
     ~WhoFrameCap()
     {
         WhoTaskGroup::destroy();
-        for (auto queue : m_queues) {
-            vQueueDelete(queue);
+        for (auto edge : m_edges) {
+            delete edge;
         }
     }
 
+    // Link the new node after the last added node, calling it in order builds a linear pipeline.
     template <typename T, typename... Args>
-    void add_node(Args &&...args)
+        requires(!is_parent_arg<Args...>::value)
+    T *add_node(Args &&...args)
     {
-        T *node = new T(std::forward<Args>(args)...);
+        std::vector<WhoFrameCapNode *> parents;
         if (!m_nodes.empty()) {
-            auto &prev_node = m_nodes.back();
-            QueueHandle_t queue = xQueueCreate(1, sizeof(who::cam::cam_fb_t *));
-            node->set_in_queue(queue);
-            node->set_prev_node(prev_node);
-            prev_node->set_out_queue(queue);
-            prev_node->set_next_node(node);
-            m_queues.emplace_back(queue);
+            parents.emplace_back(m_nodes.back());
+        }
+        return add_node<T>(parents, std::forward<Args>(args)...);
+    }
+
+    // Link the new node after parent. A parent with several children feeds each of them through its own queue.
+    template <typename T, typename... Args>
+    T *add_node(WhoFrameCapNode *parent, Args &&...args)
+    {
+        std::vector<WhoFrameCapNode *> parents;
+        if (parent) {
+            parents.emplace_back(parent);
+        }
+        return add_node<T>(parents, std::forward<Args>(args)...);
+    }
+
+    // Link the new node after all the parents, it takes frames from them in turn.
+    template <typename T, typename... Args>
+    T *add_node(const std::vector<WhoFrameCapNode *> &parents, Args &&...args)
+    {
+        T *node = new T(std::forward<Args>(args)...);
+        for (const auto &parent : parents) {
+            add_edge(parent, node);
         }
         m_nodes.emplace_back(node);
         WhoTaskGroup::register_task(node);
+        return node;
     }
 
+    // Change the queue depth and the backpressure policy of the edge from parent to child, only before the nodes run.
+    bool config_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child, const edge_config_t &cfg);
+    WhoFrameCapEdge *get_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child);
+    std::vector<WhoFrameCapEdge *> get_all_edges() { return m_edges; }
+
     bool run(std::vector<std::tuple<const configSTACK_DEPTH_TYPE, UBaseType_t, const BaseType_t>> args);
 
     WhoFrameCapNode *get_node(const std::string &name);
@@ -38,8 +71,10 @@ public:
     std::vector<WhoFrameCapNode *> get_all_nodes() { return m_nodes; }
 
 private:
+    void add_edge(WhoFrameCapNode *parent, WhoFrameCapNode *child);
+
     std::vector<WhoFrameCapNode *> m_nodes;
-    std::vector<QueueHandle_t> m_queues;
+    std::vector<WhoFrameCapEdge *> m_edges;
 };
 } // namespace frame_cap
 } // namespace who
@@ -1,21 +1,124 @@
 #include "who_frame_cap_node.hpp"
-#include "hal/cache_hal.h"
-#include "hal/cache_ll.h"
+#include "esp_timer.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 
 using namespace who::cam;
 static const char *TAG = "WhoFrameCapNode";
 
 namespace who {
 namespace frame_cap {
+// Longest wait of an EDGE_POLICY_BLOCK edge between two checks of the stop and pause bits.
+static const TickType_t s_block_slice = pdMS_TO_TICKS(100);
+
+static int64_t get_fb_timestamp_us(const cam_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+static int64_t get_fb_age_us(const cam_fb_t *fb, int64_t now_us)
+{
+    return now_us - get_fb_timestamp_us(fb);
+}
+
+template <typename T>
+static void update_max(std::atomic<T> &max, T val)
+{
+    T cur = max.load(std::memory_order_relaxed);
+    while (val > cur && !max.compare_exchange_weak(cur, val, std::memory_order_relaxed)) {
+    }
+}
+
+WhoFrameRef::WhoFrameRef(const WhoFrameRef &other) : m_node(other.m_node), m_fb(other.m_fb)
+{
+    if (m_fb) {
+        m_node->cam_fb_retain(m_fb);
+    }
+}
+
+WhoFrameRef::WhoFrameRef(WhoFrameRef &&other) noexcept : m_node(other.m_node), m_fb(other.m_fb)
+{
+    other.m_node = nullptr;
+    other.m_fb = nullptr;
+}
+
+WhoFrameRef &WhoFrameRef::operator=(const WhoFrameRef &other)
+{
+    if (this != &other) {
+        if (other.m_fb) {
+            other.m_node->cam_fb_retain(other.m_fb);
+        }
+        reset();
+        m_node = other.m_node;
+        m_fb = other.m_fb;
+    }
+    return *this;
+}
+
+WhoFrameRef &WhoFrameRef::operator=(WhoFrameRef &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        m_node = other.m_node;
+        m_fb = other.m_fb;
+        other.m_node = nullptr;
+        other.m_fb = nullptr;
+    }
+    return *this;
+}
+
+void WhoFrameRef::reset()
+{
+    if (m_fb) {
+        m_node->cam_fb_release_ref(m_fb);
+    }
+    m_node = nullptr;
+    m_fb = nullptr;
+}
+
+WhoFrameCapEdge::WhoFrameCapEdge(WhoFrameCapNode *prev, WhoFrameCapNode *next, const edge_config_t &cfg) :
+    prev_node(prev),
+    next_node(next),
+    config(cfg),
+    queue(xQueueCreate(cfg.depth, sizeof(cam_fb_t *))),
+    n_offered(0),
+    produced(0),
+    consumed(0),
+    dropped(0),
+    skipped(0)
+{
+}
+
+WhoFrameCapEdge::~WhoFrameCapEdge()
+{
+    vQueueDelete(queue);
+}
+
+edge_stats_t WhoFrameCapEdge::get_stats()
+{
+    return {prev_node,
+            next_node,
+            produced.load(std::memory_order_relaxed),
+            consumed.load(std::memory_order_relaxed),
+            dropped.load(std::memory_order_relaxed),
+            skipped.load(std::memory_order_relaxed)};
+}
+
 WhoFrameCapNode::WhoFrameCapNode(const std::string &name, uint8_t ringbuf_len, bool out_queue_overwrite) :
     task::WhoTask(name),
     m_out_queue_overwrite(out_queue_overwrite),
-    m_out_queue(nullptr),
-    m_prev_node(nullptr),
-    m_next_node(nullptr),
-    m_in_queue(nullptr),
-    m_cam_fbs(ringbuf_len),
-    m_mutex(xSemaphoreCreateMutex())
+    m_in_sem(nullptr),
+    m_in_queue_idx(0),
+    m_in_edge(-1),
+    m_last_publish_us(0),
+    m_period_us(0),
+    m_max_process_us(0),
+    m_max_publish_age_us(0),
+    m_fbs_in_use(0),
+    m_peak_fbs_in_use(0),
+    m_next_frame_seq(0),
+    m_cam_fbs(ringbuf_len)
 {
     // Ensure at least one element in ringbuf.
     assert(ringbuf_len >= 1);
@@ -23,15 +126,51 @@ WhoFrameCapNode::WhoFrameCapNode(const std::string &name, uint8_t ringbuf_len, b
 
 WhoFrameCapNode::~WhoFrameCapNode()
 {
-    vSemaphoreDelete(m_mutex);
+    if (m_in_sem) {
+        vSemaphoreDelete(m_in_sem);
+    }
+}
+
+void WhoFrameCapNode::add_prev_edge(WhoFrameCapEdge *edge)
+{
+    m_prev_nodes.emplace_back(edge->prev_node);
+    m_in_edges.emplace_back(edge);
+    update_in_sem();
+}
+
+void WhoFrameCapNode::add_next_edge(WhoFrameCapEdge *edge)
+{
+    m_next_nodes.emplace_back(edge->next_node);
+    m_out_edges.emplace_back(edge);
+}
+
+edge_config_t WhoFrameCapNode::get_default_edge_config()
+{
+    if (m_out_queue_overwrite) {
+        return {edge_policy_t::EDGE_POLICY_DROP_OLDEST, 1, 0, 1};
+    }
+    return {edge_policy_t::EDGE_POLICY_BLOCK, 1, portMAX_DELAY, 1};
+}
+
+void WhoFrameCapNode::update_in_sem()
+{
+    // The semaphore count never falls behind the number of frames in the in queues as long as the max count covers
+    // all of them. Edges are only changed before the node runs, so it is safe to recreate it here.
+    UBaseType_t max_cnt = 0;
+    for (const auto &edge : m_in_edges) {
+        max_cnt += edge->config.depth;
+    }
+    if (m_in_sem) {
+        vSemaphoreDelete(m_in_sem);
+    }
+    m_in_sem = xSemaphoreCreateCounting(max_cnt, 0);
 }
 
 bool WhoFrameCapNode::pause_async()
 {
     if (task::WhoTask::pause_async()) {
-        cam_fb_t *fb = nullptr;
-        if (m_in_queue) {
-            xQueueSend(m_in_queue, &fb, 0);
+        if (m_in_sem) {
+            xSemaphoreGive(m_in_sem);
         }
         return true;
     }
@@ -41,67 +180,258 @@ bool WhoFrameCapNode::pause_async()
 bool WhoFrameCapNode::stop_async()
 {
     if (task::WhoTask::stop_async()) {
-        cam_fb_t *fb = nullptr;
-        if (m_in_queue) {
-            xQueueSend(m_in_queue, &fb, 0);
+        if (m_in_sem) {
+            xSemaphoreGive(m_in_sem);
         }
         return true;
     }
     return false;
 }
 
+uint32_t WhoFrameCapNode::get_cam_fb_seq(int index)
+{
+    uint32_t seq = m_cam_fbs.get_seq(index);
+    if (seq == RingBuf<cam_fb_t *>::INVALID_SEQ) {
+        int size = m_cam_fbs.size();
+        if (size == 0) {
+            ESP_LOGW(TAG, "%s: Unable to peek from an empty frame buffer.", get_name().c_str());
+        } else {
+            ESP_LOGW(TAG, "%s: Invalid index %d, valid index should be [-1, %d].", get_name().c_str(), index, size - 1);
+        }
+    }
+    return seq;
+}
+
 cam_fb_t *WhoFrameCapNode::cam_fb_peek(int index)
 {
-    xSemaphoreTake(m_mutex, portMAX_DELAY);
-    if (m_cam_fbs.empty()) {
-        ESP_LOGW(TAG, "%s: Unable to peek from an empty frame buffer.", get_name().c_str());
-        xSemaphoreGive(m_mutex);
-        return nullptr;
+    cam_fb_t *fb = nullptr;
+    m_cam_fbs.peek_by_seq(get_cam_fb_seq(index), fb);
+    return fb;
+}
+
+WhoFrameRef WhoFrameCapNode::cam_fb_acquire(int index)
+{
+    // The fb at index may be pushed out by a new frame right after its seq is taken, try again with the new seq.
+    for (int i = 0; i < 2; i++) {
+        uint32_t seq = get_cam_fb_seq(index);
+        if (seq == RingBuf<cam_fb_t *>::INVALID_SEQ) {
+            break;
+        }
+        auto fb = cam_fb_acquire_by_seq(seq);
+        if (fb) {
+            return fb;
+        }
     }
-    if (index == -1) {
-        index = m_cam_fbs.size() - 1;
+    return WhoFrameRef();
+}
+
+WhoFrameRef WhoFrameCapNode::cam_fb_acquire_by_seq(uint32_t seq)
+{
+    cam_fb_t *fb = nullptr;
+    if (m_cam_fbs.acquire_by_seq(
+            seq,
+            fb,
+            [this](cam_fb_t *fb) { return cam_fb_try_retain(fb); },
+            [this](cam_fb_t *fb) { cam_fb_release(fb); })) {
+        subscriber_t *subscriber = get_cur_subscriber();
+        if (subscriber) {
+            subscriber->last_acquire_us.store(esp_timer_get_time(), std::memory_order_relaxed);
+        }
+        return WhoFrameRef(this, fb);
     }
-    if (index < 0 || index > m_cam_fbs.size() - 1) {
-        ESP_LOGW(TAG,
-                 "%s: Invalid index %d, valid index should be [-1, %d].",
-                 get_name().c_str(),
-                 index,
-                 m_cam_fbs.size() - 1);
-        xSemaphoreGive(m_mutex);
-        return nullptr;
+    return WhoFrameRef();
+}
+
+void WhoFrameCapNode::cam_fb_retain(cam_fb_t *fb)
+{
+    std::atomic_ref<int>(fb->ref_cnt).fetch_add(1, std::memory_order_relaxed);
+}
+
+bool WhoFrameCapNode::cam_fb_try_retain(cam_fb_t *fb)
+{
+    // A fb which is already recycled must not be revived.
+    std::atomic_ref<int> ref_cnt(fb->ref_cnt);
+    int cnt = ref_cnt.load(std::memory_order_relaxed);
+    while (cnt > 0) {
+        if (ref_cnt.compare_exchange_weak(cnt, cnt + 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+            return true;
+        }
     }
-    cam_fb_t *ret = m_cam_fbs[index];
-    xSemaphoreGive(m_mutex);
-    return ret;
+    return false;
+}
+
+void WhoFrameCapNode::cam_fb_release(cam_fb_t *fb)
+{
+    if (std::atomic_ref<int>(fb->ref_cnt).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_fbs_in_use.fetch_sub(1, std::memory_order_relaxed);
+        cam_fb_recycle(fb);
+    }
+}
+
+void WhoFrameCapNode::cam_fb_release_ref(cam_fb_t *fb)
+{
+    subscriber_t *subscriber = get_cur_subscriber();
+    if (subscriber) {
+        int64_t now_us = esp_timer_get_time();
+        update_max<int32_t>(subscriber->max_release_age_us, get_fb_age_us(fb, now_us));
+        int64_t last_acquire_us = subscriber->last_acquire_us.load(std::memory_order_relaxed);
+        if (last_acquire_us) {
+            update_max<int32_t>(subscriber->max_hold_us, now_us - last_acquire_us);
+        }
+    }
+    cam_fb_release(fb);
+}
+
+WhoFrameCapNode::subscriber_t *WhoFrameCapNode::get_cur_subscriber()
+{
+    TaskHandle_t task_handle = xTaskGetCurrentTaskHandle();
+    for (auto &subscriber : m_subscribers) {
+        if (subscriber.task->get_task_handle() == task_handle) {
+            return &subscriber;
+        }
+    }
+    return nullptr;
+}
+
+WhoFrameCapNode::node_stats_t WhoFrameCapNode::get_stats(bool reset)
+{
+    node_stats_t stats;
+    stats.period_us = m_period_us.load(std::memory_order_relaxed);
+    if (reset) {
+        stats.max_process_us = m_max_process_us.exchange(0, std::memory_order_relaxed);
+        stats.max_publish_age_us = m_max_publish_age_us.exchange(0, std::memory_order_relaxed);
+        stats.peak_fbs_in_use = m_peak_fbs_in_use.exchange(m_fbs_in_use.load(std::memory_order_relaxed),
+                                                           std::memory_order_relaxed);
+    } else {
+        stats.max_process_us = m_max_process_us.load(std::memory_order_relaxed);
+        stats.max_publish_age_us = m_max_publish_age_us.load(std::memory_order_relaxed);
+        stats.peak_fbs_in_use = m_peak_fbs_in_use.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+std::vector<WhoFrameCapNode::subscriber_stats_t> WhoFrameCapNode::get_subscriber_stats(bool reset)
+{
+    std::vector<subscriber_stats_t> stats;
+    for (auto &subscriber : m_subscribers) {
+        if (reset) {
+            stats.push_back({subscriber.task,
+                             subscriber.max_hold_us.exchange(0, std::memory_order_relaxed),
+                             subscriber.max_release_age_us.exchange(0, std::memory_order_relaxed)});
+        } else {
+            stats.push_back({subscriber.task,
+                             subscriber.max_hold_us.load(std::memory_order_relaxed),
+                             subscriber.max_release_age_us.load(std::memory_order_relaxed)});
+        }
+    }
+    return stats;
+}
+
+void WhoFrameCapNode::update_stats(cam_fb_t *fb, int64_t start_us)
+{
+    int64_t now_us = esp_timer_get_time();
+    update_max<int32_t>(m_max_process_us, now_us - start_us);
+    update_max<int32_t>(m_max_publish_age_us, get_fb_age_us(fb, now_us));
+    if (m_last_publish_us) {
+        // Moving average over about 8 frames.
+        int32_t period_us = m_period_us.load(std::memory_order_relaxed);
+        int32_t interval_us = now_us - m_last_publish_us;
+        m_period_us.store(period_us ? period_us + (interval_us - period_us) / 8 : interval_us,
+                          std::memory_order_relaxed);
+    }
+    m_last_publish_us = now_us;
+    update_max<int>(m_peak_fbs_in_use, m_fbs_in_use.fetch_add(1, std::memory_order_relaxed) + 1);
+}
+
+uint32_t WhoFrameCapNode::get_drop_cnt(WhoFrameCapNode *next_node)
+{
+    for (const auto &edge : m_out_edges) {
+        if (edge->next_node == next_node) {
+            return edge->dropped.load(std::memory_order_relaxed) + get_pool_dry_cnt();
+        }
+    }
+    ESP_LOGE(TAG, "%s is not a next node of %s.", next_node->get_name().c_str(), get_name().c_str());
+    return 0;
+}
+
+std::vector<edge_stats_t> WhoFrameCapNode::get_edge_stats()
+{
+    std::vector<edge_stats_t> stats;
+    for (const auto &edge : m_out_edges) {
+        stats.emplace_back(edge->get_stats());
+    }
+    return stats;
+}
+
+void WhoFrameCapNode::update_trace(cam_fb_t *in_fb, cam_fb_t *out_fb, int64_t start_us)
+{
+    cam_fb_trace_t &trace = out_fb->trace;
+    if (!in_fb) {
+        // A new frame enters the pipeline, it is waiting since it was captured.
+        trace = {};
+        trace.seq = m_next_frame_seq++;
+        start_us = get_fb_timestamp_us(out_fb);
+    } else if (in_fb != out_fb) {
+        trace = in_fb->trace;
+    }
+    cam_fb_stage_t stage = get_stage();
+    trace.stamp(stage, start_us, esp_timer_get_time());
+    WhoFrameTracer::get_instance()->record(trace, stage);
+}
+
+void WhoFrameCapNode::update_crop(cam_fb_t *in_fb, cam_fb_t *out_fb, WhoFrameCapNode *prev_node)
+{
+    if (in_fb == out_fb) {
+        return;
+    }
+    // The crop of a crop node is relative to in_fb.
+    if (is_crop_node()) {
+        out_fb->crop = out_fb->crop.compose(in_fb->crop);
+        return;
+    }
+    // Frames which are not cropped are mapped by the rescale of WhoDetect, only a crop takes the scale of the node.
+    if (in_fb->crop.is_identity()) {
+        out_fb->crop = in_fb->crop;
+        return;
+    }
+    float scale_x, scale_y;
+    get_scale(prev_node, scale_x, scale_y);
+    out_fb->crop = cam_fb_crop_t{1 / scale_x, 1 / scale_y, 0, 0}.compose(in_fb->crop);
 }
 
 void WhoFrameCapNode::add_new_frame_signal_subscriber(task::WhoTask *task)
 {
     m_tasks.emplace_back(task);
+    auto &subscriber = m_subscribers.emplace_back();
+    subscriber.task = task;
+    subscriber.last_acquire_us = 0;
+    subscriber.max_hold_us = 0;
+    subscriber.max_release_age_us = 0;
 }
 
 WhoFrameCapNode *WhoFrameCapNode::get_prev_node()
 {
-    if (!m_prev_node) {
+    if (m_prev_nodes.empty()) {
         ESP_LOGE(TAG, "No prev node.");
+        return nullptr;
     }
-    return m_prev_node;
+    return m_prev_nodes[0];
 }
 
 WhoFrameCapNode *WhoFrameCapNode::get_next_node()
 {
-    if (!m_next_node) {
+    if (m_next_nodes.empty()) {
         ESP_LOGE(TAG, "No next node.");
+        return nullptr;
     }
-    return m_next_node;
+    return m_next_nodes[0];
 }
 
 void WhoFrameCapNode::task()
 {
     while (true) {
-        cam_fb_t *in_fb = nullptr;
-        if (m_in_queue) {
-            xQueueReceive(m_in_queue, &in_fb, portMAX_DELAY);
+        if (m_in_sem) {
+            xSemaphoreTake(m_in_sem, portMAX_DELAY);
         }
         EventBits_t event_bits = xEventGroupWaitBits(m_event_group, TASK_PAUSE | TASK_STOP, pdTRUE, pdFALSE, 0);
         if (event_bits & TASK_STOP) {
@@ -116,23 +446,38 @@ void WhoFrameCapNode::task()
                 continue;
             }
         }
+        cam_fb_t *in_fb = nullptr;
+        int edge = -1;
+        if (m_in_sem) {
+            in_fb = receive_in_frame(edge);
+            // Woken up by a stale signal, the frame has been dropped by the prev node. Or by wake_up(), for a frame
+            // the node finished on its own.
+            if (!in_fb && !has_pending_out_frame()) {
+                continue;
+            }
+        }
+        m_in_edge = edge;
+        int64_t start_us = esp_timer_get_time();
         cam_fb_t *out_fb = process(in_fb);
+        if (out_fb) {
+            update_trace(in_fb, out_fb, start_us);
+            if (in_fb) {
+                update_crop(in_fb, out_fb, m_prev_nodes[edge]);
+            }
+        }
+        if (in_fb) {
+            m_prev_nodes[edge]->cam_fb_release(in_fb);
+        }
         // Drop the fb which failed to process.
         if (!out_fb) {
             continue;
         }
-        if (m_out_queue) {
-            if (m_out_queue_overwrite) {
-                xQueueOverwrite(m_out_queue, &out_fb);
-            } else {
-                xQueueSend(m_out_queue, &out_fb, portMAX_DELAY);
-            }
-        }
-        xSemaphoreTake(m_mutex, portMAX_DELAY);
+        update_stats(out_fb, start_us);
+        // The reference held by the ringbuf.
+        std::atomic_ref<int>(out_fb->ref_cnt).store(1, std::memory_order_release);
+        send_out_frame(out_fb);
         update_ringbuf(out_fb);
-        bool full_ringbuf = m_cam_fbs.full();
-        xSemaphoreGive(m_mutex);
-        if (full_ringbuf) {
+        if (m_cam_fbs.full()) {
             for (const auto &task : m_tasks) {
                 if (task->is_active()) {
                     xEventGroupSetBits(task->get_event_group(), NEW_FRAME);
@@ -144,78 +489,826 @@ void WhoFrameCapNode::task()
     vTaskDelete(NULL);
 }
 
+cam_fb_t *WhoFrameCapNode::receive_in_frame(int &edge)
+{
+    // Start from the edge after the last served one, so that a busy prev node can not starve the others.
+    int n = m_in_edges.size();
+    for (int i = 0; i < n; i++) {
+        int idx = (m_in_queue_idx + i) % n;
+        cam_fb_t *fb = nullptr;
+        if (xQueueReceive(m_in_edges[idx]->queue, &fb, 0) == pdTRUE) {
+            m_in_edges[idx]->consumed.fetch_add(1, std::memory_order_relaxed);
+            m_in_queue_idx = (idx + 1) % n;
+            edge = idx;
+            return fb;
+        }
+    }
+    return nullptr;
+}
+
+void WhoFrameCapNode::send_out_frame(cam_fb_t *fb)
+{
+    for (const auto &edge : m_out_edges) {
+        if (send_out_frame(edge, fb)) {
+            xSemaphoreGive(edge->next_node->m_in_sem);
+        }
+    }
+}
+
+bool WhoFrameCapNode::send_out_frame(WhoFrameCapEdge *edge, cam_fb_t *fb)
+{
+    edge->produced.fetch_add(1, std::memory_order_relaxed);
+    if (edge->n_offered++ % edge->config.keep_every_n) {
+        edge->skipped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // The reference held by the next node, released after the next node processed it.
+    cam_fb_retain(fb);
+    switch (edge->config.policy) {
+    case edge_policy_t::EDGE_POLICY_DROP_OLDEST:
+        // Only this task sends to the queue, once a frame is taken out there is room for the new one.
+        while (xQueueSend(edge->queue, &fb, 0) != pdTRUE) {
+            cam_fb_t *stale_fb = nullptr;
+            if (xQueueReceive(edge->queue, &stale_fb, 0) == pdTRUE) {
+                edge->dropped.fetch_add(1, std::memory_order_relaxed);
+                cam_fb_release(stale_fb);
+            }
+        }
+        return true;
+    case edge_policy_t::EDGE_POLICY_DROP_NEWEST:
+        if (xQueueSend(edge->queue, &fb, 0) == pdTRUE) {
+            return true;
+        }
+        break;
+    case edge_policy_t::EDGE_POLICY_BLOCK: {
+        // Wait in slices, so that a child which no longer takes frames does not hold up the stop or pause of this task.
+        TickType_t remaining = edge->config.block_timeout;
+        while (true) {
+            TickType_t wait = std::min(remaining, s_block_slice);
+            if (xQueueSend(edge->queue, &fb, wait) == pdTRUE) {
+                return true;
+            }
+            if (remaining != portMAX_DELAY) {
+                remaining -= wait;
+            }
+            if (!remaining || (xEventGroupGetBits(m_event_group) & (TASK_STOP | TASK_PAUSE))) {
+                break;
+            }
+        }
+        break;
+    }
+    default:
+        ESP_LOGE(TAG, "Unknown edge policy %d.", (int)edge->config.policy);
+        break;
+    }
+    edge->dropped.fetch_add(1, std::memory_order_relaxed);
+    cam_fb_release(fb);
+    return false;
+}
+
+void WhoFrameCapNode::update_ringbuf(cam_fb_t *fb)
+{
+    cam_fb_t *fb_prev = nullptr;
+    // The ringbuf may have been shrunk.
+    while (m_cam_fbs.size() > m_cam_fbs.len() && m_cam_fbs.pop(fb_prev)) {
+        cam_fb_release(fb_prev);
+    }
+    // Subscribers may still hold the fb, it is recycled after they release it.
+    if (m_cam_fbs.push(fb, fb_prev)) {
+        cam_fb_release(fb_prev);
+    }
+}
+
+void WhoFrameCapNode::cleanup()
+{
+    for (int i = 0; i < m_in_edges.size(); i++) {
+        cam_fb_t *fb;
+        while (xQueueReceive(m_in_edges[i]->queue, &fb, 0) == pdTRUE) {
+            m_prev_nodes[i]->cam_fb_release(fb);
+        }
+    }
+    cam_fb_t *fb;
+    while (!m_cam_fbs.empty() && m_cam_fbs.pop(fb)) {
+        cam_fb_release(fb);
+    }
+}
+
 WhoFetchNode::~WhoFetchNode()
 {
     delete m_cam;
 }
 
-void WhoFetchNode::cleanup()
+bool WhoFetchNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
 {
-    xSemaphoreTake(m_mutex, portMAX_DELAY);
-    while (!m_cam_fbs.empty()) {
-        auto fb = m_cam_fbs.pop();
-        m_cam->cam_fb_return(fb);
+    if (!m_cam->is_valid()) {
+        ESP_LOGE(TAG, "The cam of %s is not valid.", get_name().c_str());
+        return false;
     }
-    xSemaphoreGive(m_mutex);
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
 }
 
 cam_fb_t *WhoFetchNode::process(who::cam::cam_fb_t *fb)
 {
+    // nullptr if the cam dropped the frame, the node waits for the next one.
     return m_cam->cam_fb_get();
 }
 
-void WhoFetchNode::update_ringbuf(who::cam::cam_fb_t *fb)
+void WhoFetchNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
 {
-    if (m_cam_fbs.full()) {
-        auto fb_prev = m_cam_fbs.pop();
-        m_cam->cam_fb_return(fb_prev);
+    m_cam->cam_fb_return(fb);
+}
+
+#if CONFIG_IDF_TARGET_ESP32P4
+static constexpr uint32_t s_decode_caps = 0;
+#else
+static constexpr uint32_t s_decode_caps = dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+#endif
+
+#if !CONFIG_IDF_TARGET_LINUX
+WhoDecodeWorker::WhoDecodeWorker(const std::string &name, WhoJpegDecoder *decoder) :
+    task::WhoTask(name), m_decoder(decoder), m_jobs(xQueueCreate(1, sizeof(job_t *)))
+{
+}
+
+WhoDecodeWorker::~WhoDecodeWorker()
+{
+    vQueueDelete(m_jobs);
+}
+
+bool WhoDecodeWorker::stop_async()
+{
+    if (task::WhoTask::stop_async()) {
+        // Wake up the task waiting for a job.
+        job_t *job = nullptr;
+        xQueueSend(m_jobs, &job, portMAX_DELAY);
+        return true;
     }
-    m_cam_fbs.push(fb);
+    return false;
 }
 
-void WhoDecodeNode::cleanup()
+void WhoDecodeWorker::submit(job_t *job)
+{
+    xQueueSend(m_jobs, &job, portMAX_DELAY);
+}
+
+void WhoDecodeWorker::task()
+{
+    while (true) {
+        job_t *job = nullptr;
+        xQueueReceive(m_jobs, &job, portMAX_DELAY);
+        if (!job) {
+            break;
+        }
+        int64_t start_us = esp_timer_get_time();
+        WhoFrameCapNode *out_node = job->out_node;
+        job->ok = m_decoder->decode(*job->in_fb, *job->out_fb, job->buf_size) == ESP_OK;
+        if (job->ok) {
+            job->out_fb->timestamp = job->in_fb->timestamp;
+            job->out_fb->trace = job->in_fb->trace;
+            job->out_fb->crop = job->in_fb->crop;
+            job->out_fb->trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_DECODE, start_us, esp_timer_get_time());
+        }
+        job->in_node->cam_fb_release(job->in_fb);
+        // The job may be reused as soon as it is done.
+        xSemaphoreGive(job->done);
+        out_node->wake_up();
+    }
+    xEventGroupSetBits(m_event_group, TASK_STOPPED);
+    vTaskDelete(NULL);
+}
+
+WhoDecodeNode::WhoDecodeNode(const std::string &name,
+                             dl::image::pix_type_t pix_type,
+                             uint8_t ringbuf_len,
+                             bool out_queue_overwrite) :
+    WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite),
+    m_pix_type(pix_type),
+    m_decoder(pix_type, s_decode_caps),
+    m_pool(nullptr),
+    m_n_workers(1),
+    m_n_submitted(0),
+    m_n_in_flight(0),
+    m_collected_submit_us(0)
 {
-    while (uxQueueMessagesWaiting(m_in_queue) > 0) {
-        cam_fb_t *tmp;
-        xQueueReceive(m_in_queue, &tmp, 0);
+}
+
+WhoDecodeNode::~WhoDecodeNode()
+{
+    for (int i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->stop();
+        delete m_workers[i];
+        delete m_worker_decoders[i];
+    }
+    for (auto &job : m_jobs) {
+        vSemaphoreDelete(job.done);
+    }
+    if (m_pool) {
+        delete m_pool;
+    }
+}
+
+bool WhoDecodeNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    // The frame size is known only after the prev node is linked, allocate the pool once before the first run.
+    if (!m_pool) {
+        if (!m_decoder.is_supported(get_prev_node()->get_fb_width(), get_prev_node()->get_fb_height())) {
+            ESP_LOGE(TAG,
+                     "%s can't decode a %dx%d jpeg at scale 1/%d.",
+                     get_name().c_str(),
+                     get_prev_node()->get_fb_width(),
+                     get_prev_node()->get_fb_height(),
+                     1 << (int)m_decoder.get_scale());
+            return false;
+        }
+        dl::image::img_t img = {
+            .data = nullptr, .width = get_fb_width(), .height = get_fb_height(), .pix_type = m_pix_type};
+        // One more for the frame being decoded by each worker, and one more for the frame held by subscribers after it
+        // leaves ringbuf.
+        m_pool = WhoFramePool::create(img,
+                                      m_cam_fbs.len() + m_n_workers + 1,
+                                      m_decoder.get_buf_size(get_prev_node()->get_fb_width(),
+                                                             get_prev_node()->get_fb_height()));
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
     }
-    xSemaphoreTake(m_mutex, portMAX_DELAY);
-    while (!m_cam_fbs.empty()) {
-        auto fb = m_cam_fbs.pop();
-        heap_caps_free(fb->buf);
-        delete fb;
+    if (m_n_workers > 1 && m_workers.empty()) {
+        start_workers(uxPriority);
     }
-    xSemaphoreGive(m_mutex);
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+void WhoDecodeNode::start_workers(UBaseType_t priority)
+{
+    m_jobs.resize(m_n_workers);
+    for (int i = 0; i < m_n_workers; i++) {
+        auto decoder = new WhoJpegDecoder(m_pix_type, s_decode_caps);
+        decoder->set_scale(m_decoder.get_scale());
+        decoder->set_crop(m_decoder.get_crop());
+        m_worker_decoders.emplace_back(decoder);
+        m_workers.emplace_back(new WhoDecodeWorker(get_name() + "Worker" + std::to_string(i), decoder));
+        // Alternate the cores, so that the frames in flight are decoded in parallel.
+        m_workers.back()->run(4096, priority, i % portNUM_PROCESSORS);
+        m_jobs[i].done = xSemaphoreCreateBinary();
+    }
+}
+
+uint16_t WhoDecodeNode::get_fb_width()
+{
+    uint16_t width = get_prev_node()->get_fb_width();
+    uint16_t height = get_prev_node()->get_fb_height();
+    m_decoder.get_out_size(width, height);
+    return width;
+}
+
+uint16_t WhoDecodeNode::get_fb_height()
+{
+    uint16_t width = get_prev_node()->get_fb_width();
+    uint16_t height = get_prev_node()->get_fb_height();
+    m_decoder.get_out_size(width, height);
+    return height;
 }
 
 cam_fb_t *WhoDecodeNode::process(who::cam::cam_fb_t *fb)
 {
-    auto timestamp = fb->timestamp;
-#if CONFIG_IDF_TARGET_ESP32P4
-    uint32_t caps = 0;
-#else
-    uint32_t caps = dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
-#endif
-#if CONFIG_SOC_JPEG_CODEC_SUPPORTED
-    auto img = hw_decode_jpeg({fb->buf, fb->len}, m_pix_type, caps);
-#else
-    auto img = sw_decode_jpeg({fb->buf, fb->len}, m_pix_type, caps);
+    if (m_workers.empty()) {
+        cam_fb_t *out_fb = m_pool->get();
+        // All the fbs are still held by subscribers.
+        if (!out_fb) {
+            return nullptr;
+        }
+        // Sometimes may fail to decode a corrupted frame.
+        if (m_decoder.decode(*fb, *out_fb, m_pool->get_buf_size()) != ESP_OK) {
+            m_pool->put(out_fb);
+            return nullptr;
+        }
+        out_fb->timestamp = fb->timestamp;
+        return out_fb;
+    }
+    cam_fb_t *done_fb = nullptr;
+    bool collected = false;
+    // nullptr if woken up by a worker.
+    if (fb) {
+        // Every worker is busy, the oldest frame has to come out before a new one goes in.
+        if (m_n_in_flight == m_n_workers) {
+            done_fb = collect_job();
+            collected = true;
+        }
+        cam_fb_t *out_fb = m_pool->get();
+        if (out_fb) {
+            auto &job = m_jobs[m_n_submitted % m_n_workers];
+            // The worker releases the frame after decoding it.
+            WhoFrameCapNode *in_node = get_in_node();
+            in_node->cam_fb_retain(fb);
+            job = {fb, in_node, out_fb, this, m_pool->get_buf_size(), esp_timer_get_time(), false, job.done};
+            m_workers[m_n_submitted % m_n_workers]->submit(&job);
+            m_n_submitted++;
+            m_n_in_flight++;
+        }
+    }
+    // Otherwise hand out the oldest frame if it is ready.
+    if (!collected && is_oldest_job_done()) {
+        done_fb = collect_job();
+    }
+    // One frame comes out at a time, the next one may be done already and its worker has woken up the task before.
+    if (is_oldest_job_done()) {
+        wake_up();
+    }
+    return done_fb;
+}
+
+bool WhoDecodeNode::is_oldest_job_done()
+{
+    if (!m_n_in_flight) {
+        return false;
+    }
+    auto &job = m_jobs[(m_n_submitted - m_n_in_flight) % m_n_workers];
+    if (xSemaphoreTake(job.done, 0) != pdTRUE) {
+        return false;
+    }
+    xSemaphoreGive(job.done);
+    return true;
+}
+
+cam_fb_t *WhoDecodeNode::collect_job()
+{
+    auto &job = m_jobs[(m_n_submitted - m_n_in_flight) % m_n_workers];
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    m_n_in_flight--;
+    m_collected_submit_us = job.submit_us;
+    if (!job.ok) {
+        m_pool->put(job.out_fb);
+        return nullptr;
+    }
+    return job.out_fb;
+}
+
+void WhoDecodeNode::update_trace(cam_fb_t *in_fb, cam_fb_t *out_fb, int64_t start_us)
+{
+    if (m_workers.empty()) {
+        WhoFrameCapNode::update_trace(in_fb, out_fb, start_us);
+        return;
+    }
+    // out_fb is an older frame than in_fb, the worker already stamped its own trace.
+    WhoFrameTracer::get_instance()->record(out_fb->trace, get_stage());
+}
+
+void WhoDecodeNode::update_crop(cam_fb_t *in_fb, cam_fb_t *out_fb, WhoFrameCapNode *prev_node)
+{
+    // out_fb is an older frame than in_fb, the worker already copied its own crop.
+    if (m_workers.empty()) {
+        WhoFrameCapNode::update_crop(in_fb, out_fb, prev_node);
+    }
+}
+
+void WhoDecodeNode::update_stats(cam_fb_t *fb, int64_t start_us)
+{
+    // fb is an older frame than the in fb, it has been in the node since its job was submitted.
+    WhoFrameCapNode::update_stats(fb, m_workers.empty() ? start_us : m_collected_submit_us);
+}
+
+void WhoDecodeNode::cleanup()
+{
+    while (m_n_in_flight > 0) {
+        cam_fb_t *fb = collect_job();
+        if (fb) {
+            m_pool->put(fb);
+        }
+    }
+    WhoFrameCapNode::cleanup();
+}
+
+void WhoDecodeNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
+{
+    m_pool->put(fb);
+}
 #endif
-    // Sometimes may fail to decode a corrupted frame.
-    if (!img.data) {
+
+WhoSWResizeNode::WhoSWResizeNode(const std::string &name,
+                                 uint16_t dst_w,
+                                 uint16_t dst_h,
+                                 dl::image::pix_type_t dst_pix_type,
+                                 uint8_t ringbuf_len,
+                                 bool out_queue_overwrite,
+                                 resize_interp_t interp) :
+    WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite),
+    m_dst_w(dst_w),
+    m_dst_h(dst_h),
+    m_dst_pix_type(dst_pix_type),
+    m_resizer(interp, s_decode_caps),
+    m_pool(nullptr)
+{
+}
+
+WhoSWResizeNode::~WhoSWResizeNode()
+{
+    if (m_pool) {
+        delete m_pool;
+    }
+}
+
+bool WhoSWResizeNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    if (!m_pool) {
+        dl::image::img_t img = {.data = nullptr, .width = m_dst_w, .height = m_dst_h, .pix_type = m_dst_pix_type};
+        // One more for the frame being resized, and one more for the frame held by subscribers after it leaves ringbuf.
+        m_pool = WhoFramePool::create(img, m_cam_fbs.len() + 2);
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
+    }
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+cam_fb_t *WhoSWResizeNode::process(who::cam::cam_fb_t *fb)
+{
+    cam_fb_t *out_fb = m_pool->get();
+    // All the fbs are still held by subscribers.
+    if (!out_fb) {
+        return nullptr;
+    }
+    if (!m_resizer.resize(*fb, *out_fb)) {
+        m_pool->put(out_fb);
+        return nullptr;
+    }
+    out_fb->timestamp = fb->timestamp;
+    return out_fb;
+}
+
+void WhoSWResizeNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
+{
+    m_pool->put(fb);
+}
+
+void WhoSWResizeNode::get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y)
+{
+    scale_x = (float)m_dst_w / prev_node->get_fb_width();
+    scale_y = (float)m_dst_h / prev_node->get_fb_height();
+}
+
+WhoPyramidNode::WhoPyramidNode(const std::string &name,
+                               const std::vector<float> &scales,
+                               dl::image::pix_type_t pix_type,
+                               uint8_t ringbuf_len,
+                               bool out_queue_overwrite) :
+    WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite), m_scales(scales), m_pix_type(pix_type), m_pool(nullptr)
+{
+    assert(!scales.empty() && std::is_sorted(scales.rbegin(), scales.rend()));
+}
+
+WhoPyramidNode::~WhoPyramidNode()
+{
+    if (m_pool) {
+        delete m_pool;
+    }
+}
+
+bool WhoPyramidNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    // The frame size is known only after the prev node is linked, lay out the levels once before the first run.
+    if (!m_pool) {
+        uint16_t width = get_prev_node()->get_fb_width();
+        uint16_t height = get_prev_node()->get_fb_height();
+        size_t pix_size = dl::image::get_pix_byte_size(m_pix_type);
+        size_t offset = 0;
+        for (int i = 0; i < m_scales.size(); i++) {
+            level_t level = {get_level_size(width, i), get_level_size(height, i), offset, i - 1};
+            // Prefer the smallest level at least twice as large, a 2x downscale is close to a 2x2 box filter.
+            for (int j = i - 1; j >= 0; j--) {
+                if (m_scales[j] >= 2 * m_scales[i] * 0.99f) {
+                    level.src = j;
+                    break;
+                }
+            }
+            // Keep every level 16 bytes aligned.
+            offset += dl::image::align_up(level.width * level.height * pix_size, 16);
+            m_levels.emplace_back(level);
+            m_resizers.emplace_back(resize_interp_t::RESIZE_INTERP_BILINEAR, s_decode_caps);
+        }
+        dl::image::img_t img = {
+            .data = nullptr, .width = m_levels[0].width, .height = m_levels[0].height, .pix_type = m_pix_type};
+        // One more for the frame being built, and one more for the frame held by subscribers after it leaves ringbuf.
+        m_pool = WhoFramePool::create(img, m_cam_fbs.len() + 2, offset);
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
+    }
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+dl::image::img_t WhoPyramidNode::get_level(const who::cam::cam_fb_t &fb, int level)
+{
+    return {.data = (uint8_t *)fb.buf + m_levels[level].offset,
+            .width = m_levels[level].width,
+            .height = m_levels[level].height,
+            .pix_type = m_pix_type};
+}
+
+cam_fb_crop_t WhoPyramidNode::get_level_crop(int level)
+{
+    return {(float)get_prev_node()->get_fb_width() / m_levels[level].width,
+            (float)get_prev_node()->get_fb_height() / m_levels[level].height,
+            0,
+            0};
+}
+
+void WhoPyramidNode::get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y)
+{
+    scale_x = (float)get_level_size(prev_node->get_fb_width(), 0) / prev_node->get_fb_width();
+    scale_y = (float)get_level_size(prev_node->get_fb_height(), 0) / prev_node->get_fb_height();
+}
+
+int WhoPyramidNode::find_level(uint16_t w, uint16_t h)
+{
+    for (int i = m_levels.size() - 1; i >= 0; i--) {
+        if (m_levels[i].width >= w && m_levels[i].height >= h) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+cam_fb_t *WhoPyramidNode::process(who::cam::cam_fb_t *fb)
+{
+    cam_fb_t *out_fb = m_pool->get();
+    // All the fbs are still held by subscribers.
+    if (!out_fb) {
+        return nullptr;
+    }
+    for (int i = 0; i < m_levels.size(); i++) {
+        dl::image::img_t level = get_level(*out_fb, i);
+        bool ok = m_levels[i].src < 0 ? m_resizers[i].resize(*fb, level)
+                                      : m_resizers[i].resize(get_level(*out_fb, m_levels[i].src), level);
+        if (!ok) {
+            m_pool->put(out_fb);
+            return nullptr;
+        }
+    }
+    out_fb->timestamp = fb->timestamp;
+    // The levels are mapped by get_level_crop, the fb itself only carries the crop of in fb.
+    out_fb->crop = {1, 1, 0, 0};
+    return out_fb;
+}
+
+void WhoPyramidNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
+{
+    m_pool->put(fb);
+}
+
+WhoROICropNode::WhoROICropNode(const std::string &name,
+                               uint16_t dst_w,
+                               uint16_t dst_h,
+                               dl::image::pix_type_t dst_pix_type,
+                               uint8_t ringbuf_len,
+                               bool out_queue_overwrite,
+                               resize_interp_t interp) :
+    WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite),
+    m_dst_w(dst_w),
+    m_dst_h(dst_h),
+    m_dst_pix_type(dst_pix_type),
+    m_resizer(interp, s_decode_caps),
+    m_pool(nullptr),
+    m_roi_mutex(xSemaphoreCreateMutex()),
+    m_dynamic_ttl(0),
+    m_roi_idx(0)
+{
+}
+
+WhoROICropNode::~WhoROICropNode()
+{
+    vSemaphoreDelete(m_roi_mutex);
+    if (m_pool) {
+        delete m_pool;
+    }
+}
+
+bool WhoROICropNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    if (!m_pool) {
+        dl::image::img_t img = {.data = nullptr, .width = m_dst_w, .height = m_dst_h, .pix_type = m_dst_pix_type};
+        // One more for the frame being cropped, and one more for the frame held by subscribers after it leaves ringbuf.
+        m_pool = WhoFramePool::create(img, m_cam_fbs.len() + 2);
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
+    }
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+void WhoROICropNode::set_static_rois(const std::vector<std::vector<int>> &rois)
+{
+    xSemaphoreTake(m_roi_mutex, portMAX_DELAY);
+    m_static_rois = rois;
+    xSemaphoreGive(m_roi_mutex);
+}
+
+void WhoROICropNode::set_dynamic_rois(const std::vector<std::vector<int>> &boxes, float margin, int ttl)
+{
+    if (boxes.empty()) {
+        return;
+    }
+    std::vector<std::vector<int>> rois;
+    for (const auto &box : boxes) {
+        int margin_x = (box[2] - box[0]) * margin;
+        int margin_y = (box[3] - box[1]) * margin;
+        rois.push_back({box[0] - margin_x, box[1] - margin_y, box[2] + margin_x, box[3] + margin_y});
+    }
+    xSemaphoreTake(m_roi_mutex, portMAX_DELAY);
+    m_dynamic_rois = std::move(rois);
+    m_dynamic_ttl = ttl * (m_static_rois.size() + m_dynamic_rois.size());
+    xSemaphoreGive(m_roi_mutex);
+}
+
+std::vector<int> WhoROICropNode::get_next_roi(uint16_t width, uint16_t height)
+{
+    xSemaphoreTake(m_roi_mutex, portMAX_DELAY);
+    if (m_dynamic_ttl > 0) {
+        m_dynamic_ttl--;
+    } else {
+        m_dynamic_rois.clear();
+    }
+    std::vector<int> roi;
+    int n = m_static_rois.size() + m_dynamic_rois.size();
+    if (n) {
+        // The regions may be changed since the last frame.
+        m_roi_idx %= n;
+        roi = m_roi_idx < m_static_rois.size() ? m_static_rois[m_roi_idx]
+                                               : m_dynamic_rois[m_roi_idx - m_static_rois.size()];
+        m_roi_idx++;
+    }
+    xSemaphoreGive(m_roi_mutex);
+    return fit_roi(roi, width, height);
+}
+
+std::vector<int> WhoROICropNode::fit_roi(const std::vector<int> &roi, uint16_t width, uint16_t height)
+{
+    if (roi.empty()) {
+        return {0, 0, width, height};
+    }
+    // Enlarge the short side around the center to the aspect ratio of dst, then shift it into the frame.
+    float roi_w = std::max(roi[2] - roi[0], 1);
+    float roi_h = std::max(roi[3] - roi[1], 1);
+    float aspect = (float)m_dst_w / m_dst_h;
+    if (roi_w / roi_h < aspect) {
+        roi_w = roi_h * aspect;
+    } else {
+        roi_h = roi_w / aspect;
+    }
+    int w = std::min((int)(roi_w + 0.5f), (int)width);
+    int h = std::min((int)(roi_h + 0.5f), (int)height);
+    int x_min = std::clamp((roi[0] + roi[2] - w) / 2, 0, width - w);
+    int y_min = std::clamp((roi[1] + roi[3] - h) / 2, 0, height - h);
+    return {x_min, y_min, x_min + w, y_min + h};
+}
+
+cam_fb_t *WhoROICropNode::process(who::cam::cam_fb_t *fb)
+{
+    cam_fb_t *out_fb = m_pool->get();
+    // All the fbs are still held by subscribers.
+    if (!out_fb) {
+        return nullptr;
+    }
+    std::vector<int> roi = get_next_roi(fb->width, fb->height);
+    if (!m_resizer.resize(*fb, *out_fb, roi)) {
+        m_pool->put(out_fb);
         return nullptr;
     }
-    return new cam_fb_t(img, timestamp);
+    out_fb->crop.scale_x = (float)(roi[2] - roi[0]) / m_dst_w;
+    out_fb->crop.scale_y = (float)(roi[3] - roi[1]) / m_dst_h;
+    out_fb->crop.offset_x = roi[0];
+    out_fb->crop.offset_y = roi[1];
+    out_fb->timestamp = fb->timestamp;
+    return out_fb;
 }
 
-void WhoDecodeNode::update_ringbuf(who::cam::cam_fb_t *fb)
+void WhoROICropNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
+{
+    m_pool->put(fb);
+}
+
+WhoMotionNode::WhoMotionNode(const std::string &name,
+                             uint16_t w,
+                             uint16_t h,
+                             uint8_t pixel_thr,
+                             uint8_t ringbuf_len,
+                             bool out_queue_overwrite) :
+    WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite),
+    m_w(w),
+    m_h(h),
+    m_pixel_thr(pixel_thr),
+    m_resizer(resize_interp_t::RESIZE_INTERP_NEAREST, s_decode_caps),
+    m_pool(nullptr),
+    m_luma(w * h),
+    m_motions(),
+    m_motion_mutex(xSemaphoreCreateMutex())
 {
-    if (m_cam_fbs.full()) {
-        auto fb_prev = m_cam_fbs.pop();
-        heap_caps_free(fb_prev->buf);
-        delete fb_prev;
+    for (auto &motion : m_motions) {
+        motion.seq = RingBuf<cam_fb_t *>::INVALID_SEQ;
     }
-    m_cam_fbs.push(fb);
+}
+
+WhoMotionNode::~WhoMotionNode()
+{
+    vSemaphoreDelete(m_motion_mutex);
+    if (m_pool) {
+        delete m_pool;
+    }
+}
+
+bool WhoMotionNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
+{
+    if (!m_pool) {
+        dl::image::img_t img = {
+            .data = nullptr, .width = m_w, .height = m_h, .pix_type = dl::image::DL_IMAGE_PIX_TYPE_GRAY};
+        // One more for the frame being scored, and one more for the frame held by subscribers after it leaves ringbuf.
+        m_pool = WhoFramePool::create(img, m_cam_fbs.len() + 2);
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
+    }
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
+}
+
+bool WhoMotionNode::get_motion(uint32_t seq, motion_t &motion)
+{
+    bool ret = false;
+    xSemaphoreTake(m_motion_mutex, portMAX_DELAY);
+    if (m_motions[seq % N_MOTIONS].seq == seq) {
+        motion = m_motions[seq % N_MOTIONS];
+        ret = true;
+    }
+    xSemaphoreGive(m_motion_mutex);
+    return ret;
+}
+
+cam_fb_t *WhoMotionNode::process(who::cam::cam_fb_t *fb)
+{
+    cam_fb_t *out_fb = m_pool->get();
+    // All the fbs are still held by subscribers.
+    if (!out_fb) {
+        return nullptr;
+    }
+    dl::image::img_t luma = {
+        .data = m_luma.data(), .width = m_w, .height = m_h, .pix_type = dl::image::DL_IMAGE_PIX_TYPE_GRAY};
+    if (!m_resizer.resize(*fb, luma)) {
+        m_pool->put(out_fb);
+        return nullptr;
+    }
+    motion_t motion = {.seq = fb->trace.seq, .score = 0, .box = {0, 0, 0, 0}};
+    uint8_t *mask = (uint8_t *)out_fb->buf;
+    if (m_bg.empty()) {
+        // Nothing to compare with, take the whole frame as changed.
+        m_bg.resize(m_w * m_h);
+        for (int i = 0; i < m_w * m_h; i++) {
+            m_bg[i] = m_luma[i] << 8;
+        }
+        memset(mask, 255, m_w * m_h);
+        motion.score = 1;
+        motion.box[2] = fb->width;
+        motion.box[3] = fb->height;
+    } else {
+        int cnt = 0;
+        int x_min = m_w, y_min = m_h, x_max = -1, y_max = -1;
+        for (int y = 0, i = 0; y < m_h; y++) {
+            for (int x = 0; x < m_w; x++, i++) {
+                int cur = m_luma[i] << 8;
+                int diff = cur - m_bg[i];
+                bool changed = std::abs(diff) > (m_pixel_thr << 8);
+                mask[i] = changed ? 255 : 0;
+                // Learn the background slowly, about 16 frames to follow a change in lighting.
+                m_bg[i] += diff / 16;
+                if (changed) {
+                    cnt++;
+                    x_min = std::min(x_min, x);
+                    y_min = std::min(y_min, y);
+                    x_max = std::max(x_max, x);
+                    y_max = std::max(y_max, y);
+                }
+            }
+        }
+        motion.score = (float)cnt / (m_w * m_h);
+        if (cnt) {
+            motion.box[0] = x_min * fb->width / m_w;
+            motion.box[1] = y_min * fb->height / m_h;
+            motion.box[2] = (x_max + 1) * fb->width / m_w;
+            motion.box[3] = (y_max + 1) * fb->height / m_h;
+        }
+    }
+    xSemaphoreTake(m_motion_mutex, portMAX_DELAY);
+    m_motions[motion.seq % N_MOTIONS] = motion;
+    xSemaphoreGive(m_motion_mutex);
+    out_fb->timestamp = fb->timestamp;
+    return out_fb;
+}
+
+void WhoMotionNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
+{
+    m_pool->put(fb);
 }
 
 #if CONFIG_SOC_PPA_SUPPORTED
@@ -228,69 +1321,70 @@ WhoPPAResizeNode::WhoPPAResizeNode(const std::string &name,
     WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite),
     m_dst_w(dst_w),
     m_dst_h(dst_h),
-    m_dst_imgs(ringbuf_len + 1),
-    m_img_idx(0)
+    m_dst_pix_type(dst_pix_type),
+    m_pool(nullptr)
 {
     ppa_client_config_t ppa_client_config = {};
     ppa_client_config.oper_type = PPA_OPERATION_SRM;
     ESP_ERROR_CHECK(ppa_register_client(&ppa_client_config, &m_ppa_srm_handle));
-    size_t align = cache_hal_get_cache_line_size(CACHE_LL_LEVEL_EXT_MEM, CACHE_TYPE_DATA);
-    for (int i = 0; i < m_dst_imgs.size(); i++) {
-        auto &img = m_dst_imgs[i];
-        img.width = dst_w;
-        img.height = dst_h;
-        img.pix_type = dst_pix_type;
-        if (i == 0) {
-            m_buf_size = dl::image::align_up(dl::image::get_img_byte_size(img), align);
-        }
-        img.data = heap_caps_aligned_calloc(align, 1, m_buf_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
-    }
 }
 
 WhoPPAResizeNode::~WhoPPAResizeNode()
 {
     ESP_ERROR_CHECK(ppa_unregister_client(m_ppa_srm_handle));
-    for (int i = 0; i < m_dst_imgs.size(); i++) {
-        heap_caps_free(m_dst_imgs[i].data);
+    if (m_pool) {
+        delete m_pool;
     }
 }
 
-void WhoPPAResizeNode::cleanup()
+bool WhoPPAResizeNode::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID)
 {
-    while (uxQueueMessagesWaiting(m_in_queue) > 0) {
-        cam_fb_t *tmp;
-        xQueueReceive(m_in_queue, &tmp, 0);
+    // PPA reads the frames as img_t, a jpeg or yuv422 frame needs a WhoDecodeNode or a WhoSWResizeNode before.
+    dl::image::pix_type_t pix_type;
+    for (const auto &prev_node : get_prev_nodes()) {
+        if (!cam_fb_fmt2dl_pix_fmt(prev_node->get_fb_format(), pix_type)) {
+            ESP_LOGE(TAG,
+                     "%s can't resize the frames of %s, their format has no dl::image pix type.",
+                     get_name().c_str(),
+                     prev_node->get_name().c_str());
+            return false;
+        }
     }
-    xSemaphoreTake(m_mutex, portMAX_DELAY);
-    while (!m_cam_fbs.empty()) {
-        auto fb = m_cam_fbs.pop();
-        delete fb;
+    if (!m_pool) {
+        dl::image::img_t img = {.data = nullptr, .width = m_dst_w, .height = m_dst_h, .pix_type = m_dst_pix_type};
+        // One more for the frame being resized, and one more for the frame held by subscribers after it leaves ringbuf.
+        m_pool = WhoFramePool::create(img, m_cam_fbs.len() + 2);
+        if (!m_pool) {
+            ESP_LOGE(TAG, "Failed to create the frame pool of %s.", get_name().c_str());
+            return false;
+        }
     }
-    xSemaphoreGive(m_mutex);
+    return WhoFrameCapNode::run(uxStackDepth, uxPriority, xCoreID);
 }
 
-cam_fb_t *WhoPPAResizeNode::process(who::cam::cam_fb_t *fb)
+void WhoPPAResizeNode::get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y)
 {
-    auto timestamp = fb->timestamp;
-    auto dst_img = get_dst_img();
-    dl::image::resize_ppa(*fb, dst_img, m_ppa_srm_handle);
-    return new cam_fb_t(dst_img, timestamp);
+    // PPA keeps the scale of both axes in the same fixed point steps, it may differ from dst / src slightly.
+    scale_x = dl::image::get_ppa_scale(prev_node->get_fb_width(), m_dst_w);
+    scale_y = dl::image::get_ppa_scale(prev_node->get_fb_height(), m_dst_h);
 }
 
-void WhoPPAResizeNode::update_ringbuf(who::cam::cam_fb_t *fb)
+cam_fb_t *WhoPPAResizeNode::process(who::cam::cam_fb_t *fb)
 {
-    if (m_cam_fbs.full()) {
-        auto fb_prev = m_cam_fbs.pop();
-        delete fb_prev;
+    cam_fb_t *out_fb = m_pool->get();
+    // All the fbs are still held by subscribers.
+    if (!out_fb) {
+        return nullptr;
     }
-    m_cam_fbs.push(fb);
+    dl::image::img_t dst_img = *out_fb;
+    dl::image::resize_ppa(*fb, dst_img, m_ppa_srm_handle);
+    out_fb->timestamp = fb->timestamp;
+    return out_fb;
 }
 
-dl::image::img_t WhoPPAResizeNode::get_dst_img()
+void WhoPPAResizeNode::cam_fb_recycle(who::cam::cam_fb_t *fb)
 {
-    auto &img = m_dst_imgs[m_img_idx];
-    m_img_idx = (m_img_idx + 1) % m_dst_imgs.size();
-    return img;
+    m_pool->put(fb);
 }
 #endif
 } // namespace frame_cap
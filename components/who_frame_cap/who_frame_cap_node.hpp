@@ -1,46 +1,232 @@
 #pragma once
 #include "who_cam_base.hpp"
+#include "who_frame_pool.hpp"
+#include "who_frame_tracer.hpp"
+#include "who_image_kernels.hpp"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "who_jpeg_decoder.hpp"
+#endif
 #include "who_ringbuf.hpp"
 #include "who_task.hpp"
+#include <deque>
 
 namespace who {
 namespace frame_cap {
+class WhoFrameCapNode;
+
+// What the parent does with a new frame when the queue of an edge is full.
+enum class edge_policy_t {
+    // Drop the oldest frame in the queue, the child always gets the latest frames.
+    EDGE_POLICY_DROP_OLDEST,
+    // Drop the new frame, the child gets the frames in the queue first.
+    EDGE_POLICY_DROP_NEWEST,
+    // Wait for the child up to block_timeout, or until the parent is stopped or paused, then drop the new frame.
+    EDGE_POLICY_BLOCK,
+};
+
+typedef struct {
+    edge_policy_t policy;
+    UBaseType_t depth;
+    TickType_t block_timeout;
+    // Only 1 of every keep_every_n frames is sent to the child, the others are skipped.
+    uint32_t keep_every_n;
+} edge_config_t;
+
+// All the counters are frames. produced are the frames the parent sent to the edge, they are either skipped by
+// keep_every_n, dropped by the policy, consumed by the child, or still in the queue.
+typedef struct {
+    WhoFrameCapNode *prev_node;
+    WhoFrameCapNode *next_node;
+    uint32_t produced;
+    uint32_t consumed;
+    uint32_t dropped;
+    uint32_t skipped;
+} edge_stats_t;
+
+// The queue between a parent and a child, owned by WhoFrameCap.
+struct WhoFrameCapEdge {
+    WhoFrameCapEdge(WhoFrameCapNode *prev, WhoFrameCapNode *next, const edge_config_t &cfg);
+    ~WhoFrameCapEdge();
+    edge_stats_t get_stats();
+
+    WhoFrameCapNode *prev_node;
+    WhoFrameCapNode *next_node;
+    edge_config_t config;
+    QueueHandle_t queue;
+    // Frames offered to the edge, only touched by the parent task.
+    uint32_t n_offered;
+    std::atomic<uint32_t> produced;
+    std::atomic<uint32_t> consumed;
+    std::atomic<uint32_t> dropped;
+    std::atomic<uint32_t> skipped;
+};
+
+// Shared handle of a fb produced by a WhoFrameCapNode. The fb is recycled by the node only after the last handle is
+// released, so it is safe to keep it across nodes, subscribers and result callbacks.
+class WhoFrameRef {
+public:
+    WhoFrameRef() : m_node(nullptr), m_fb(nullptr) {}
+    WhoFrameRef(const WhoFrameRef &other);
+    WhoFrameRef(WhoFrameRef &&other) noexcept;
+    ~WhoFrameRef() { reset(); }
+    WhoFrameRef &operator=(const WhoFrameRef &other);
+    WhoFrameRef &operator=(WhoFrameRef &&other) noexcept;
+    void reset();
+    who::cam::cam_fb_t *get() const { return m_fb; }
+    who::cam::cam_fb_t *operator->() const { return m_fb; }
+    who::cam::cam_fb_t &operator*() const { return *m_fb; }
+    explicit operator bool() const { return m_fb != nullptr; }
+    WhoFrameCapNode *get_node() const { return m_node; }
+
+private:
+    friend class WhoFrameCapNode;
+    // Take over a reference which is already retained.
+    WhoFrameRef(WhoFrameCapNode *node, who::cam::cam_fb_t *fb) : m_node(node), m_fb(fb) {}
+    WhoFrameCapNode *m_node;
+    who::cam::cam_fb_t *m_fb;
+};
+
 class WhoFrameCapNode : public task::WhoTask {
 public:
     static inline constexpr EventBits_t NEW_FRAME = TASK_EVENT_BIT_LAST;
 
+    // Frame ages are measured from the fb timestamp.
+    typedef struct {
+        int32_t period_us;
+        int32_t max_process_us;
+        int32_t max_publish_age_us;
+        // Max number of fbs produced by the node and not recycled yet.
+        int peak_fbs_in_use;
+    } node_stats_t;
+
+    typedef struct {
+        task::WhoTask *task;
+        int32_t max_hold_us;
+        int32_t max_release_age_us;
+    } subscriber_stats_t;
+
+    // out_queue_overwrite selects the default config of the out edges, EDGE_POLICY_DROP_OLDEST if true, otherwise
+    // EDGE_POLICY_BLOCK without timeout. See WhoFrameCap::config_edge().
     WhoFrameCapNode(const std::string &name, uint8_t ringbuf_len, bool out_queue_overwrite = true);
     ~WhoFrameCapNode();
     bool stop_async() override;
     bool pause_async() override;
-    void set_in_queue(QueueHandle_t in_queue) { m_in_queue = in_queue; }
-    void set_out_queue(QueueHandle_t out_queue) { m_out_queue = out_queue; }
-    void set_prev_node(WhoFrameCapNode *node) { m_prev_node = node; }
-    void set_next_node(WhoFrameCapNode *node) { m_next_node = node; }
+    // Each edge owns its own queue, a node with several prev nodes takes frames from them in turn.
+    void add_prev_edge(WhoFrameCapEdge *edge);
+    void add_next_edge(WhoFrameCapEdge *edge);
+    edge_config_t get_default_edge_config();
+    // The returned fb is not retained, it may be recycled at any time. Prefer cam_fb_acquire().
     who::cam::cam_fb_t *cam_fb_peek(int index = -1);
+    WhoFrameRef cam_fb_acquire(int index = -1);
+    // Returns an empty handle if the frame is already pushed out of the ringbuf.
+    WhoFrameRef cam_fb_acquire_by_seq(uint32_t seq);
+    // Seq of the fb at index in the ringbuf, RingBuf::INVALID_SEQ if the index is out of range.
+    uint32_t get_cam_fb_seq(int index = -1);
+    void cam_fb_retain(who::cam::cam_fb_t *fb);
+    // Fails if the fb is already recycled.
+    bool cam_fb_try_retain(who::cam::cam_fb_t *fb);
+    void cam_fb_release(who::cam::cam_fb_t *fb);
     void add_new_frame_signal_subscriber(task::WhoTask *task);
     WhoFrameCapNode *get_prev_node();
     WhoFrameCapNode *get_next_node();
+    const std::vector<WhoFrameCapNode *> &get_prev_nodes() { return m_prev_nodes; }
+    const std::vector<WhoFrameCapNode *> &get_next_nodes() { return m_next_nodes; }
+    int get_ringbuf_len() { return m_cam_fbs.len(); }
+    // Stats since the last reset. Subscriber stats cover the frames they release through WhoFrameRef.
+    node_stats_t get_stats(bool reset = false);
+    std::vector<subscriber_stats_t> get_subscriber_stats(bool reset = false);
+    // Number of frames next_node missed, either dropped by the edge policy before next_node took them, or never
+    // produced because the pool of this node ran dry.
+    uint32_t get_drop_cnt(WhoFrameCapNode *next_node);
+    // Number of frames dropped because all the fbs of the pool are still held, 0 for the nodes without a pool.
+    virtual uint32_t get_pool_dry_cnt() { return 0; }
+    // Frames the cam of the node dropped before they were fetched, 0 if the node has no cam.
+    virtual uint32_t get_cam_drop_cnt() { return 0; }
+    // Stats of all the out edges.
+    std::vector<edge_stats_t> get_edge_stats();
     virtual uint16_t get_fb_width() = 0;
     virtual uint16_t get_fb_height() = 0;
+    virtual who::cam::cam_fb_fmt_t get_fb_format() = 0;
     virtual std::string get_type() = 0;
+    // The stage stamped into the trace of the fbs produced by the node.
+    virtual who::cam::cam_fb_stage_t get_stage() = 0;
+    // Scale of the frames of the node relative to the frames of prev_node, 1 if the node does not scale.
+    virtual void get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y) { scale_x = scale_y = 1; }
+    // The fbs of the node carry the crop it makes, see cam_fb_t::crop. WhoDetect maps the results on them, and on the
+    // frames made from them, back to the prev node of the crop node.
+    virtual bool is_crop_node() { return false; }
+    // Wakes up the task of the node without a new frame, for a frame the node finished asynchronously.
+    void wake_up()
+    {
+        if (m_in_sem) {
+            xSemaphoreGive(m_in_sem);
+        }
+    }
 
 private:
+    friend class WhoFrameRef;
+    friend class WhoFrameCap;
+    struct subscriber_t {
+        task::WhoTask *task;
+        std::atomic<int64_t> last_acquire_us;
+        std::atomic<int32_t> max_hold_us;
+        std::atomic<int32_t> max_release_age_us;
+    };
+
     void task() override;
     virtual who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) = 0;
-    virtual void update_ringbuf(who::cam::cam_fb_t *fb) = 0;
+    // Called when the last reference of the fb is released.
+    virtual void cam_fb_recycle(who::cam::cam_fb_t *fb) = 0;
+    who::cam::cam_fb_t *receive_in_frame(int &edge);
+    void send_out_frame(who::cam::cam_fb_t *fb);
+    void update_ringbuf(who::cam::cam_fb_t *fb);
+    subscriber_t *get_cur_subscriber();
+    // Release of a fb held by a WhoFrameRef.
+    void cam_fb_release_ref(who::cam::cam_fb_t *fb);
+    // Returns false if the frame is skipped or dropped.
+    bool send_out_frame(WhoFrameCapEdge *edge, who::cam::cam_fb_t *fb);
+    // Recreate m_in_sem after the in edges change.
+    void update_in_sem();
     bool m_out_queue_overwrite;
-    QueueHandle_t m_out_queue;
-    WhoFrameCapNode *m_prev_node;
-    WhoFrameCapNode *m_next_node;
+    std::vector<WhoFrameCapNode *> m_prev_nodes;
+    std::vector<WhoFrameCapEdge *> m_in_edges;
+    std::vector<WhoFrameCapNode *> m_next_nodes;
+    std::vector<WhoFrameCapEdge *> m_out_edges;
+    // Given once for every frame sent to the in queues and for every pause/stop request.
+    SemaphoreHandle_t m_in_sem;
+    int m_in_queue_idx;
+    // In edge of the frame being processed, -1 if none.
+    int m_in_edge;
     std::vector<task::WhoTask *> m_tasks;
+    std::deque<subscriber_t> m_subscribers;
+    int64_t m_last_publish_us;
+    std::atomic<int32_t> m_period_us;
+    std::atomic<int32_t> m_max_process_us;
+    std::atomic<int32_t> m_max_publish_age_us;
+    std::atomic<int> m_fbs_in_use;
+    std::atomic<int> m_peak_fbs_in_use;
+    uint32_t m_next_frame_seq;
 
 protected:
-    QueueHandle_t m_in_queue;
+    void cleanup() override;
+    // Inherits the trace of in_fb and stamps the stage of the node into it.
+    virtual void update_trace(who::cam::cam_fb_t *in_fb, who::cam::cam_fb_t *out_fb, int64_t start_us);
+    // Inherits the crop of in_fb, so that a crop made upstream follows the frame through the nodes after it.
+    virtual void update_crop(who::cam::cam_fb_t *in_fb, who::cam::cam_fb_t *out_fb, WhoFrameCapNode *prev_node);
+    // start_us is when the node started on the in fb of process().
+    virtual void update_stats(who::cam::cam_fb_t *fb, int64_t start_us);
+    // True if process() may hand out a frame without a new in fb, it is called on wake_up() then.
+    virtual bool has_pending_out_frame() { return false; }
+    // Prev node the in fb of process() comes from, a node with several prev nodes gets frames from each of them.
+    WhoFrameCapNode *get_in_node() { return m_in_edge >= 0 ? m_prev_nodes[m_in_edge] : nullptr; }
     RingBuf<who::cam::cam_fb_t *> m_cam_fbs;
-    SemaphoreHandle_t m_mutex;
 };
 
+// The ringbuf_len is the fb_count of the cam - 2, one fb being captured and one held by a subscriber after it leaves
+// the ringbuf. A frame held by a task or a next node stays alive through its reference, so a ringbuf only has to be
+// longer than 1 on a displayed node: if the result of a frame is ready n frames later, that node keeps n + 1 frames, so
+// that the displayed frame is still there when its result arrives. A displayed WhoFetchNode then needs a cam with
+// fb_count n + 3, any other one fb_count 3.
 class WhoFetchNode : public WhoFrameCapNode {
 public:
     WhoFetchNode(const std::string &name, who::cam::WhoCam *cam, bool out_queue_overwrite = true) :
@@ -48,35 +234,295 @@ public:
     {
     }
     ~WhoFetchNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
     uint16_t get_fb_width() override { return m_cam->get_fb_width(); }
     uint16_t get_fb_height() override { return m_cam->get_fb_height(); }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return m_cam->get_fb_format(); }
     std::string get_type() override { return "FetchNode"; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_FETCH; }
+    // Frames dropped inside the cam before they are fetched.
+    uint32_t get_cam_drop_cnt() override { return m_cam->get_drop_cnt(); }
 
 private:
-    void cleanup() override;
     who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
-    void update_ringbuf(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
     who::cam::WhoCam *m_cam;
 };
 
+#if !CONFIG_IDF_TARGET_LINUX
+// Decodes the frames handed over by a WhoDecodeNode on a core of its own.
+class WhoDecodeWorker : public task::WhoTask {
+public:
+    typedef struct {
+        who::cam::cam_fb_t *in_fb;
+        WhoFrameCapNode *in_node;
+        who::cam::cam_fb_t *out_fb;
+        // Woken up when the job is done.
+        WhoFrameCapNode *out_node;
+        size_t buf_size;
+        int64_t submit_us;
+        bool ok;
+        // Given when the job is done.
+        SemaphoreHandle_t done;
+    } job_t;
+
+    WhoDecodeWorker(const std::string &name, WhoJpegDecoder *decoder);
+    ~WhoDecodeWorker();
+    bool stop_async() override;
+    void submit(job_t *job);
+
+private:
+    void task() override;
+    WhoJpegDecoder *m_decoder;
+    QueueHandle_t m_jobs;
+};
+
 class WhoDecodeNode : public WhoFrameCapNode {
 public:
     WhoDecodeNode(const std::string &name,
                   dl::image::pix_type_t pix_type,
                   uint8_t ringbuf_len,
-                  bool out_queue_overwrite = true) :
-        WhoFrameCapNode(name, ringbuf_len, out_queue_overwrite), m_pix_type(pix_type)
-    {
-    }
-    uint16_t get_fb_width() override { return get_prev_node()->get_fb_width(); }
-    uint16_t get_fb_height() override { return get_prev_node()->get_fb_height(); }
+                  bool out_queue_overwrite = true);
+    ~WhoDecodeNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+    // Decode the frames scaled down and/or cropped, so that they come out near the size the next nodes want. Only
+    // before the first run. crop is {x_min, y_min, x_max, y_max} of the jpeg frame. The software decoder scales 1/n
+    // only if both sides of the jpeg are multiples of 8 * n, run() fails otherwise.
+    void set_scale(decode_scale_t scale) { m_decoder.set_scale(scale); }
+    void set_crop(const std::vector<int> &crop) { m_decoder.set_crop(crop); }
+    // Decode n_workers frames at a time, each in a worker task of its own spread over the cores. The frames come out
+    // in the order they came in, one frame later at most than with a single decoder. Only before the first run, for
+    // the software decoder, the hardware one is already faster than the cam.
+    void set_n_workers(int n_workers) { m_n_workers = n_workers; }
+    uint16_t get_fb_width() override;
+    uint16_t get_fb_height() override;
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::dl_pix_fmt2cam_fb_fmt(m_pix_type); }
     std::string get_type() override { return "DecodeNode"; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_DECODE; }
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
 
 private:
+    who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
+    void update_trace(who::cam::cam_fb_t *in_fb, who::cam::cam_fb_t *out_fb, int64_t start_us) override;
+    void update_crop(who::cam::cam_fb_t *in_fb, who::cam::cam_fb_t *out_fb, WhoFrameCapNode *prev_node) override;
+    void update_stats(who::cam::cam_fb_t *fb, int64_t start_us) override;
+    bool has_pending_out_frame() override { return m_n_in_flight > 0; }
     void cleanup() override;
+    void start_workers(UBaseType_t priority);
+    bool is_oldest_job_done();
+    // Waits for the oldest job in flight and returns its fb, nullptr if it failed to decode.
+    who::cam::cam_fb_t *collect_job();
+
+    dl::image::pix_type_t m_pix_type;
+    WhoJpegDecoder m_decoder;
+    WhoFramePool *m_pool;
+    int m_n_workers;
+    std::vector<WhoJpegDecoder *> m_worker_decoders;
+    std::vector<WhoDecodeWorker *> m_workers;
+    // Ring of jobs, job i goes to worker i % m_n_workers.
+    std::vector<WhoDecodeWorker::job_t> m_jobs;
+    uint32_t m_n_submitted;
+    int m_n_in_flight;
+    // When the job of the last collected frame was submitted.
+    int64_t m_collected_submit_us;
+};
+#endif
+
+// Resize and colour convert on the cpu, for the targets without PPA. Unlike WhoPPAResizeNode the frame is stretched to
+// dst_w x dst_h without keeping the aspect ratio.
+class WhoSWResizeNode : public WhoFrameCapNode {
+public:
+    WhoSWResizeNode(const std::string &name,
+                    uint16_t dst_w,
+                    uint16_t dst_h,
+                    dl::image::pix_type_t dst_pix_type,
+                    uint8_t ringbuf_len,
+                    bool out_queue_overwrite = true,
+                    resize_interp_t interp = resize_interp_t::RESIZE_INTERP_NEAREST);
+    ~WhoSWResizeNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+    uint16_t get_fb_width() override { return m_dst_w; }
+    uint16_t get_fb_height() override { return m_dst_h; }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::dl_pix_fmt2cam_fb_fmt(m_dst_pix_type); }
+    std::string get_type() override { return "SWResizeNode"; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_RESIZE; }
+    void get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y) override;
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
+
+private:
+    who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
+
+    uint16_t m_dst_w;
+    uint16_t m_dst_h;
+    dl::image::pix_type_t m_dst_pix_type;
+    WhoImageResizer m_resizer;
+    WhoFramePool *m_pool;
+};
+
+// Produces the gray (luma) plane of every frame once, for all the gray consumers such as qrcode and motion detection.
+// The frame is resized at the same time if dst_w x dst_h differs from the frame size.
+class WhoGrayNode : public WhoSWResizeNode {
+public:
+    WhoGrayNode(const std::string &name,
+                uint16_t dst_w,
+                uint16_t dst_h,
+                uint8_t ringbuf_len,
+                bool out_queue_overwrite = true,
+                resize_interp_t interp = resize_interp_t::RESIZE_INTERP_NEAREST) :
+        WhoSWResizeNode(
+            name, dst_w, dst_h, dl::image::DL_IMAGE_PIX_TYPE_GRAY, ringbuf_len, out_queue_overwrite, interp)
+    {
+    }
+    std::string get_type() override { return "GrayNode"; }
+};
+
+// Builds an image pyramid of every frame in one pass. Each level is resized from the closest level at least twice as
+// large, or from the level right above it, so the large frame is read only once. An octave is a bilinear 2x downscale,
+// which averages 2x2 pixels only when the sizes of both levels divide evenly. All the levels of a frame live in the
+// buffer of one fb, the fb itself describes level 0.
+class WhoPyramidNode : public WhoFrameCapNode {
+public:
+    // scales of the levels relative to the frame of the prev node, in descending order. e.g. {1, 0.707, 0.5, 0.354}.
+    WhoPyramidNode(const std::string &name,
+                   const std::vector<float> &scales,
+                   dl::image::pix_type_t pix_type,
+                   uint8_t ringbuf_len,
+                   bool out_queue_overwrite = true);
+    ~WhoPyramidNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+    int get_n_levels() { return m_scales.size(); }
+    // View of a level of a fb produced by this node, valid as long as the fb is held.
+    dl::image::img_t get_level(const who::cam::cam_fb_t &fb, int level);
+    // Maps the coordinates in a level back to the frame of the prev node.
+    who::cam::cam_fb_crop_t get_level_crop(int level);
+    // The smallest level which is at least w x h, level 0 if none.
+    int find_level(uint16_t w, uint16_t h);
+    uint16_t get_fb_width() override { return get_level_size(get_prev_node()->get_fb_width(), 0); }
+    uint16_t get_fb_height() override { return get_level_size(get_prev_node()->get_fb_height(), 0); }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::dl_pix_fmt2cam_fb_fmt(m_pix_type); }
+    std::string get_type() override { return "PyramidNode"; }
+    // Scale of level 0, the lcd draws the fbs of the node at it.
+    void get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y) override;
+    // WhoDetect maps the results on a level back to the prev node with get_level_crop.
+    bool is_crop_node() override { return true; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_RESIZE; }
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
+
+private:
+    typedef struct {
+        uint16_t width;
+        uint16_t height;
+        size_t offset;
+        // Level it is resized from, -1 for the frame of the prev node.
+        int src;
+    } level_t;
+
     who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
-    void update_ringbuf(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
+    uint16_t get_level_size(uint16_t size, int level) { return std::max((int)(size * m_scales[level] + 0.5f), 1); }
+
+    std::vector<float> m_scales;
     dl::image::pix_type_t m_pix_type;
+    std::vector<level_t> m_levels;
+    std::vector<WhoImageResizer> m_resizers;
+    WhoFramePool *m_pool;
+};
+
+// Crops a region of interest out of every frame and scales it to dst_w x dst_h, the regions are cropped in turn, one
+// per frame. The fbs carry the crop transform, WhoDetect maps the results back to the parent frame with it. A region
+// is {x_min, y_min, x_max, y_max} in the parent frame, it is enlarged to the aspect ratio of dst to avoid distortion.
+class WhoROICropNode : public WhoFrameCapNode {
+public:
+    WhoROICropNode(const std::string &name,
+                   uint16_t dst_w,
+                   uint16_t dst_h,
+                   dl::image::pix_type_t dst_pix_type,
+                   uint8_t ringbuf_len,
+                   bool out_queue_overwrite = true,
+                   resize_interp_t interp = resize_interp_t::RESIZE_INTERP_BILINEAR);
+    ~WhoROICropNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+    // Configured zones, an empty region means the whole frame. With no region at all the whole frame is cropped.
+    void set_static_rois(const std::vector<std::vector<int>> &rois);
+    // Regions around the boxes of a detect result, each box is enlarged by margin times its size on every side. They
+    // replace the previous dynamic regions and are cropped along with the static ones for ttl rounds. An empty boxes
+    // keeps the current regions until they expire.
+    void set_dynamic_rois(const std::vector<std::vector<int>> &boxes, float margin = 0.5f, int ttl = 3);
+    uint16_t get_fb_width() override { return m_dst_w; }
+    uint16_t get_fb_height() override { return m_dst_h; }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::dl_pix_fmt2cam_fb_fmt(m_dst_pix_type); }
+    std::string get_type() override { return "ROICropNode"; }
+    bool is_crop_node() override { return true; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_RESIZE; }
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
+
+private:
+    who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
+    std::vector<int> get_next_roi(uint16_t width, uint16_t height);
+    std::vector<int> fit_roi(const std::vector<int> &roi, uint16_t width, uint16_t height);
+
+    uint16_t m_dst_w;
+    uint16_t m_dst_h;
+    dl::image::pix_type_t m_dst_pix_type;
+    WhoImageResizer m_resizer;
+    WhoFramePool *m_pool;
+    SemaphoreHandle_t m_roi_mutex;
+    std::vector<std::vector<int>> m_static_rois;
+    std::vector<std::vector<int>> m_dynamic_rois;
+    // Rounds the dynamic regions are still cropped.
+    int m_dynamic_ttl;
+    int m_roi_idx;
+};
+
+// Scores the motion of every frame on a decimated luma image against a running background. The fbs produced are the
+// changed region masks, 255 where the luma differs from the background by more than pixel_thr. The motion is looked up
+// by the seq of the frame, so a branch of the same parent can gate its work on it, see WhoDetect::set_motion_gate().
+class WhoMotionNode : public WhoFrameCapNode {
+public:
+    typedef struct {
+        uint32_t seq;
+        // Fraction of the changed pixels in [0, 1].
+        float score;
+        // Bounding box of the changed pixels in the parent frame, all 0 if nothing changed.
+        int box[4];
+    } motion_t;
+
+    WhoMotionNode(const std::string &name,
+                  uint16_t w = 32,
+                  uint16_t h = 24,
+                  uint8_t pixel_thr = 24,
+                  uint8_t ringbuf_len = 1,
+                  bool out_queue_overwrite = true);
+    ~WhoMotionNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
+    // Returns false if the frame is not scored yet or is too old.
+    bool get_motion(uint32_t seq, motion_t &motion);
+    uint16_t get_fb_width() override { return m_w; }
+    uint16_t get_fb_height() override { return m_h; }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::cam_fb_fmt_t::CAM_FB_FMT_GRAY; }
+    std::string get_type() override { return "MotionNode"; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_RESIZE; }
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
+
+private:
+    static inline constexpr int N_MOTIONS = 8;
+
+    who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
+
+    uint16_t m_w;
+    uint16_t m_h;
+    uint8_t m_pixel_thr;
+    WhoImageResizer m_resizer;
+    WhoFramePool *m_pool;
+    std::vector<uint8_t> m_luma;
+    // Background luma in 8.8 fixed point, empty until the first frame.
+    std::vector<uint16_t> m_bg;
+    motion_t m_motions[N_MOTIONS];
+    SemaphoreHandle_t m_motion_mutex;
 };
 
 #if CONFIG_SOC_PPA_SUPPORTED
@@ -89,22 +535,24 @@ public:
                      uint8_t ringbuf_len,
                      bool out_queue_overwrite = true);
     ~WhoPPAResizeNode();
+    bool run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxPriority, const BaseType_t xCoreID) override;
     uint16_t get_fb_width() override { return m_dst_w; }
     uint16_t get_fb_height() override { return m_dst_h; }
+    who::cam::cam_fb_fmt_t get_fb_format() override { return who::cam::dl_pix_fmt2cam_fb_fmt(m_dst_pix_type); }
     std::string get_type() override { return "PPAResizeNode"; }
+    who::cam::cam_fb_stage_t get_stage() override { return who::cam::cam_fb_stage_t::CAM_FB_STAGE_RESIZE; }
+    void get_scale(WhoFrameCapNode *prev_node, float &scale_x, float &scale_y) override;
+    uint32_t get_pool_dry_cnt() override { return m_pool ? m_pool->get_dry_cnt() : 0; }
 
 private:
-    void cleanup() override;
     who::cam::cam_fb_t *process(who::cam::cam_fb_t *fb) override;
-    void update_ringbuf(who::cam::cam_fb_t *fb) override;
-    dl::image::img_t get_dst_img();
+    void cam_fb_recycle(who::cam::cam_fb_t *fb) override;
 
     uint16_t m_dst_w;
     uint16_t m_dst_h;
+    dl::image::pix_type_t m_dst_pix_type;
     ppa_client_handle_t m_ppa_srm_handle;
-    std::vector<dl::image::img_t> m_dst_imgs;
-    size_t m_buf_size;
-    int m_img_idx;
+    WhoFramePool *m_pool;
 };
 #endif
 } // namespace frame_cap
@@ -0,0 +1,126 @@
+#include "who_frame_cap_planner.hpp"
+#include <inttypes.h>
+#include <map>
+
+static const char *TAG = "WhoFrameCapPlanner";
+
+namespace who {
+namespace frame_cap {
+WhoFrameCapPlanner::WhoFrameCapPlanner(const std::string &name,
+                                       WhoFrameCap *frame_cap,
+                                       uint32_t warm_up_ms,
+                                       uint32_t interval_ms) :
+    task::WhoTask(name),
+    m_frame_cap(frame_cap),
+    m_warm_up_time(pdMS_TO_TICKS(warm_up_ms)),
+    m_interval(pdMS_TO_TICKS(interval_ms)),
+    m_plan_mutex(xSemaphoreCreateMutex())
+{
+}
+
+WhoFrameCapPlanner::~WhoFrameCapPlanner()
+{
+    vSemaphoreDelete(m_plan_mutex);
+}
+
+void WhoFrameCapPlanner::add_sync(WhoFrameCapNode *disp_node, task::WhoTask *result_task)
+{
+    m_syncs.emplace_back(disp_node, result_task);
+}
+
+std::vector<WhoFrameCapPlanner::plan_t> WhoFrameCapPlanner::get_plan()
+{
+    xSemaphoreTake(m_plan_mutex, portMAX_DELAY);
+    auto plan = m_plan;
+    xSemaphoreGive(m_plan_mutex);
+    return plan;
+}
+
+void WhoFrameCapPlanner::task()
+{
+    TickType_t timeout = m_warm_up_time;
+    while (true) {
+        EventBits_t event_bits = xEventGroupWaitBits(m_event_group, TASK_PAUSE | TASK_STOP, pdTRUE, pdFALSE, timeout);
+        if (event_bits & TASK_STOP) {
+            break;
+        } else if (event_bits & TASK_PAUSE) {
+            xEventGroupSetBits(m_event_group, TASK_PAUSED);
+            EventBits_t pause_event_bits =
+                xEventGroupWaitBits(m_event_group, TASK_RESUME | TASK_STOP, pdTRUE, pdFALSE, portMAX_DELAY);
+            if (pause_event_bits & TASK_STOP) {
+                break;
+            } else {
+                // Measure from scratch after resumed.
+                for (const auto &node : m_frame_cap->get_all_nodes()) {
+                    node->get_stats(true);
+                    node->get_subscriber_stats(true);
+                }
+                timeout = m_warm_up_time;
+                continue;
+            }
+        }
+        plan();
+        timeout = m_interval;
+    }
+    xEventGroupSetBits(m_event_group, TASK_STOPPED);
+    vTaskDelete(NULL);
+}
+
+void WhoFrameCapPlanner::plan()
+{
+    auto nodes = m_frame_cap->get_all_nodes();
+    std::vector<WhoFrameCapNode::node_stats_t> node_stats;
+    std::map<task::WhoTask *, int32_t> release_ages_us;
+    for (const auto &node : nodes) {
+        node_stats.emplace_back(node->get_stats(true));
+        for (const auto &stats : node->get_subscriber_stats(true)) {
+            release_ages_us[stats.task] = std::max(release_ages_us[stats.task], stats.max_release_age_us);
+            ESP_LOGI(TAG,
+                     "%s -> %s: hold %" PRIi32 " us, release age %" PRIi32 " us.",
+                     node->get_name().c_str(),
+                     stats.task->get_name().c_str(),
+                     stats.max_hold_us,
+                     stats.max_release_age_us);
+        }
+    }
+
+    std::vector<plan_t> plan;
+    for (int i = 0; i < nodes.size(); i++) {
+        auto node = nodes[i];
+        const auto &stats = node_stats[i];
+        // No frame is produced during the measurement.
+        if (!stats.period_us) {
+            continue;
+        }
+        int len = 1;
+        for (const auto &[disp_node, result_task] : m_syncs) {
+            if (disp_node != node || !release_ages_us.count(result_task)) {
+                continue;
+            }
+            // The oldest frame in the ringbuf is (len - 1) periods older than the newest one.
+            int32_t wait_us = release_ages_us[result_task] - stats.max_publish_age_us;
+            len = std::max(len, 1 + (int)((wait_us + stats.period_us - 1) / stats.period_us));
+        }
+        int cur_len = node->get_ringbuf_len();
+        if (len > cur_len) {
+            ESP_LOGW(TAG, "%s: ringbuf_len %d is needed to sync, only %d.", node->get_name().c_str(), len, cur_len);
+        }
+        // The fbs held outside the ringbuf, by the next nodes and the subscribers, and one more being produced.
+        int fb_count = std::max(stats.peak_fbs_in_use - cur_len, 0) + len + 1;
+        plan.push_back({node, len, fb_count});
+        ESP_LOGI(TAG,
+                 "%s: period %" PRIi32 " us, process %" PRIi32 " us, ringbuf_len %d, needs %d, %s %d.",
+                 node->get_name().c_str(),
+                 stats.period_us,
+                 stats.max_process_us,
+                 cur_len,
+                 len,
+                 node->get_type() == "FetchNode" ? "fb_count" : "pool size",
+                 fb_count);
+    }
+    xSemaphoreTake(m_plan_mutex, portMAX_DELAY);
+    m_plan = plan;
+    xSemaphoreGive(m_plan_mutex);
+}
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,41 @@
+#pragma once
+#include "who_frame_cap.hpp"
+
+namespace who {
+namespace frame_cap {
+// Measures the nodes and their subscribers while the pipeline runs and reports the smallest ringbuf_len which still
+// keeps the displayed frames in sync with the results, along with the fb_count or pool size it needs. The report is
+// logged, the ringbufs and pools are left as they are, size the pipeline from it and rebuild.
+class WhoFrameCapPlanner : public task::WhoTask {
+public:
+    typedef struct {
+        WhoFrameCapNode *node;
+        // Smallest ringbuf_len which keeps the frames in sync.
+        int ringbuf_len;
+        // fb_count of the cam for a fetch node, number of fbs in the pool for the others.
+        int fb_count;
+    } plan_t;
+
+    WhoFrameCapPlanner(const std::string &name,
+                       WhoFrameCap *frame_cap,
+                       uint32_t warm_up_ms = 3000,
+                       uint32_t interval_ms = 10000);
+    ~WhoFrameCapPlanner();
+    // The frames of disp_node must stay in its ringbuf until result_task is done with the same frame, result_task
+    // subscribes to disp_node or to one of its descendants.
+    void add_sync(WhoFrameCapNode *disp_node, task::WhoTask *result_task);
+    std::vector<plan_t> get_plan();
+
+private:
+    void task() override;
+    void plan();
+
+    WhoFrameCap *m_frame_cap;
+    TickType_t m_warm_up_time;
+    TickType_t m_interval;
+    std::vector<std::pair<WhoFrameCapNode *, task::WhoTask *>> m_syncs;
+    std::vector<plan_t> m_plan;
+    SemaphoreHandle_t m_plan_mutex;
+};
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,90 @@
+#include "who_frame_pool.hpp"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "hal/cache_hal.h"
+#include "hal/cache_ll.h"
+#endif
+#include <inttypes.h>
+
+using namespace who::cam;
+static const char *TAG = "WhoFramePool";
+
+static size_t get_buf_align()
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 64;
+#else
+    return cache_hal_get_cache_line_size(CACHE_LL_LEVEL_EXT_MEM, CACHE_TYPE_DATA);
+#endif
+}
+
+namespace who {
+namespace frame_cap {
+WhoFramePool *WhoFramePool::create(const dl::image::img_t &img, int pool_size, size_t buf_size, uint32_t caps)
+{
+    WhoFramePool *pool = new WhoFramePool(img, pool_size, buf_size);
+    if (!pool->alloc(caps)) {
+        delete pool;
+        return nullptr;
+    }
+    return pool;
+}
+
+WhoFramePool::WhoFramePool(const dl::image::img_t &img, int pool_size, size_t buf_size) :
+    m_fbs(pool_size, cam_fb_t(img, {})), m_free_fbs(xQueueCreate(pool_size, sizeof(cam_fb_t *))), m_dry_cnt(0)
+{
+    size_t align = get_buf_align();
+    m_buf_size = dl::image::align_up(std::max(buf_size, dl::image::get_img_byte_size(img)), align);
+}
+
+bool WhoFramePool::alloc(uint32_t caps)
+{
+    if (!m_free_fbs) {
+        ESP_LOGE(TAG, "Failed to create the free fb queue.");
+        return false;
+    }
+    size_t align = get_buf_align();
+    for (auto &fb : m_fbs) {
+        fb.buf = heap_caps_aligned_calloc(align, 1, m_buf_size, caps);
+        if (!fb.buf) {
+            ESP_LOGE(TAG, "Failed to allocate %d fb buffers of %zu bytes.", (int)m_fbs.size(), m_buf_size);
+            return false;
+        }
+        cam_fb_t *p = &fb;
+        xQueueSend(m_free_fbs, &p, 0);
+    }
+    return true;
+}
+
+WhoFramePool::~WhoFramePool()
+{
+    for (auto &fb : m_fbs) {
+        heap_caps_free(fb.buf);
+    }
+    if (m_free_fbs) {
+        vQueueDelete(m_free_fbs);
+    }
+}
+
+cam_fb_t *WhoFramePool::get()
+{
+    cam_fb_t *fb = nullptr;
+    if (xQueueReceive(m_free_fbs, &fb, 0) != pdTRUE) {
+        m_dry_cnt.fetch_add(1, std::memory_order_relaxed);
+        ESP_LOGD(TAG, "Pool runs dry, %" PRIu32 " times in total.", get_dry_cnt());
+        return nullptr;
+    }
+    return fb;
+}
+
+void WhoFramePool::put(cam_fb_t *fb)
+{
+    assert(contains(fb));
+    xQueueSend(m_free_fbs, &fb, 0);
+}
+
+bool WhoFramePool::contains(const cam_fb_t *fb) const
+{
+    return !m_fbs.empty() && fb >= &m_fbs.front() && fb <= &m_fbs.back();
+}
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,49 @@
+#pragma once
+#include "who_cam_define.hpp"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+#include <atomic>
+
+#if CONFIG_IDF_TARGET_LINUX
+// The host has neither psram nor DMA.
+#define WHO_FRAME_POOL_CAPS MALLOC_CAP_DEFAULT
+#else
+#define WHO_FRAME_POOL_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA)
+#endif
+
+namespace who {
+namespace frame_cap {
+// Fixed number of fbs with DMA capable, cache line aligned buffers which are allocated once and recycled, so that the
+// nodes producing new frames do not allocate on every frame.
+class WhoFramePool {
+public:
+    // buf_size is the minimum byte size of each buffer, 0 means the byte size of img. Returns nullptr if any of the
+    // buffers can not be allocated, a smaller pool would drop frames the ringbufs are sized for.
+    static WhoFramePool *create(const dl::image::img_t &img,
+                                int pool_size,
+                                size_t buf_size = 0,
+                                uint32_t caps = WHO_FRAME_POOL_CAPS);
+    ~WhoFramePool();
+    // Returns nullptr when all the fbs are in use.
+    who::cam::cam_fb_t *get();
+    void put(who::cam::cam_fb_t *fb);
+    // Whether the fb is allocated by this pool.
+    bool contains(const who::cam::cam_fb_t *fb) const;
+    int get_pool_size() const { return m_fbs.size(); }
+    size_t get_buf_size() const { return m_buf_size; }
+    // Number of times get() failed because all the fbs are in use.
+    uint32_t get_dry_cnt() const { return m_dry_cnt.load(std::memory_order_relaxed); }
+
+private:
+    WhoFramePool(const dl::image::img_t &img, int pool_size, size_t buf_size);
+    bool alloc(uint32_t caps);
+
+    std::vector<who::cam::cam_fb_t> m_fbs;
+    QueueHandle_t m_free_fbs;
+    size_t m_buf_size;
+    std::atomic<uint32_t> m_dry_cnt;
+};
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,211 @@
+#include "who_frame_tracer.hpp"
+#include "who_frame_cap.hpp"
+#include <algorithm>
+#include <inttypes.h>
+
+using namespace who::cam;
+static const char *TAG = "WhoFrameTracer";
+
+namespace who {
+namespace frame_cap {
+WhoFrameTracer *WhoFrameTracer::get_instance()
+{
+    static WhoFrameTracer instance;
+    return &instance;
+}
+
+void WhoFrameTracer::record(const cam_fb_trace_t &trace, cam_fb_stage_t stage)
+{
+#if CONFIG_WHO_FRAME_TRACE
+    int i = (int)stage;
+    // The frame did not go through the stage.
+    if (!trace.enter_us[i] || !trace.exit_us[i]) {
+        return;
+    }
+    m_stage_hists[i].add(trace.exit_us[i] - trace.enter_us[i]);
+    int64_t capture_us = trace.enter_us[(int)cam_fb_stage_t::CAM_FB_STAGE_FETCH];
+    if (capture_us) {
+        m_glass_hists[i].add(trace.exit_us[i] - capture_us);
+    }
+#endif
+}
+
+WhoFrameTracer::latency_stats_t WhoFrameTracer::get_stage_latency(cam_fb_stage_t stage)
+{
+    return m_stage_hists[(int)stage].get_stats();
+}
+
+WhoFrameTracer::latency_stats_t WhoFrameTracer::get_glass_latency(cam_fb_stage_t stage)
+{
+    return m_glass_hists[(int)stage].get_stats();
+}
+
+void WhoFrameTracer::print(WhoFrameCap *frame_cap)
+{
+#if !CONFIG_WHO_FRAME_TRACE
+    ESP_LOGI(TAG, "Enable CONFIG_WHO_FRAME_TRACE for the stage latencies.");
+#endif
+    for (int i = 0; i < (int)cam_fb_stage_t::CAM_FB_STAGE_MAX; i++) {
+        latency_stats_t stage_stats = m_stage_hists[i].get_stats();
+        if (!stage_stats.cnt) {
+            continue;
+        }
+        latency_stats_t glass_stats = m_glass_hists[i].get_stats();
+        ESP_LOGI(TAG,
+                 "%-11s cnt %" PRIu32 " stage(us) min %" PRId32 " mean %" PRId32 " p50 %" PRId32 " p90 %" PRId32
+                 " p99 %" PRId32 " max %" PRId32 ", glass(us) p50 %" PRId32 " p90 %" PRId32 " p99 %" PRId32
+                 " max %" PRId32,
+                 get_stage_name((cam_fb_stage_t)i),
+                 stage_stats.cnt,
+                 stage_stats.min_us,
+                 stage_stats.mean_us,
+                 stage_stats.p50_us,
+                 stage_stats.p90_us,
+                 stage_stats.p99_us,
+                 stage_stats.max_us,
+                 glass_stats.p50_us,
+                 glass_stats.p90_us,
+                 glass_stats.p99_us,
+                 glass_stats.max_us);
+    }
+    if (!frame_cap) {
+        return;
+    }
+    for (const auto &node : frame_cap->get_all_nodes()) {
+        uint32_t cam_drop_cnt = node->get_cam_drop_cnt();
+        if (cam_drop_cnt) {
+            ESP_LOGI(TAG, "%s cam dropped %" PRIu32, node->get_name().c_str(), cam_drop_cnt);
+        }
+    }
+    for (const auto &node : frame_cap->get_all_nodes()) {
+        uint32_t pool_dry_cnt = node->get_pool_dry_cnt();
+        if (pool_dry_cnt) {
+            ESP_LOGI(TAG, "%s pool ran dry %" PRIu32, node->get_name().c_str(), pool_dry_cnt);
+        }
+    }
+    for (const auto &edge : frame_cap->get_all_edges()) {
+        edge_stats_t stats = edge->get_stats();
+        ESP_LOGI(TAG,
+                 "%s -> %s produced %" PRIu32 " consumed %" PRIu32 " dropped %" PRIu32 " skipped %" PRIu32,
+                 stats.prev_node->get_name().c_str(),
+                 stats.next_node->get_name().c_str(),
+                 stats.produced,
+                 stats.consumed,
+                 stats.dropped,
+                 stats.skipped);
+    }
+}
+
+void WhoFrameTracer::reset()
+{
+    for (int i = 0; i < (int)cam_fb_stage_t::CAM_FB_STAGE_MAX; i++) {
+        m_stage_hists[i].reset();
+        m_glass_hists[i].reset();
+    }
+}
+
+const char *WhoFrameTracer::get_stage_name(cam_fb_stage_t stage)
+{
+    switch (stage) {
+    case cam_fb_stage_t::CAM_FB_STAGE_FETCH:
+        return "fetch";
+    case cam_fb_stage_t::CAM_FB_STAGE_DECODE:
+        return "decode";
+    case cam_fb_stage_t::CAM_FB_STAGE_RESIZE:
+        return "resize";
+    case cam_fb_stage_t::CAM_FB_STAGE_PREPROCESS:
+        return "preprocess";
+    case cam_fb_stage_t::CAM_FB_STAGE_INFER:
+        return "infer";
+    case cam_fb_stage_t::CAM_FB_STAGE_POSTPROCESS:
+        return "postprocess";
+    case cam_fb_stage_t::CAM_FB_STAGE_RESULT_CB:
+        return "result_cb";
+    case cam_fb_stage_t::CAM_FB_STAGE_DISPLAY:
+        return "display";
+    default:
+        return "unknown";
+    }
+}
+
+void WhoFrameTracer::Histogram::add(int32_t val)
+{
+    // The stamps come from different cores, clamp the tiny negative values.
+    val = std::max(val, (int32_t)0);
+    m_buckets[get_bucket(val)].fetch_add(1, std::memory_order_relaxed);
+    m_cnt.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(val, std::memory_order_relaxed);
+    int32_t cur = m_min.load(std::memory_order_relaxed);
+    while (val < cur && !m_min.compare_exchange_weak(cur, val, std::memory_order_relaxed)) {
+    }
+    cur = m_max.load(std::memory_order_relaxed);
+    while (val > cur && !m_max.compare_exchange_weak(cur, val, std::memory_order_relaxed)) {
+    }
+}
+
+WhoFrameTracer::latency_stats_t WhoFrameTracer::Histogram::get_stats()
+{
+    latency_stats_t stats = {};
+    // Buckets are read one by one while they are updated, the percentiles are approximate anyway.
+    uint32_t buckets[N_BUCKETS];
+    uint32_t cnt = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        cnt += buckets[i];
+    }
+    if (!cnt) {
+        return stats;
+    }
+    stats.cnt = cnt;
+    stats.min_us = m_min.load(std::memory_order_relaxed);
+    stats.max_us = m_max.load(std::memory_order_relaxed);
+    stats.mean_us = m_sum.load(std::memory_order_relaxed) / std::max(m_cnt.load(std::memory_order_relaxed), 1u);
+    const int percents[] = {50, 90, 99};
+    int32_t *percentiles[] = {&stats.p50_us, &stats.p90_us, &stats.p99_us};
+    for (int i = 0; i < 3; i++) {
+        uint64_t target = ((uint64_t)cnt * percents[i] + 99) / 100;
+        uint64_t acc = 0;
+        for (int j = 0; j < N_BUCKETS; j++) {
+            acc += buckets[j];
+            if (acc >= target) {
+                *percentiles[i] = std::min(get_bucket_upper(j), stats.max_us);
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+void WhoFrameTracer::Histogram::reset()
+{
+    for (int i = 0; i < N_BUCKETS; i++) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_cnt.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(INT32_MAX, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+int WhoFrameTracer::Histogram::get_bucket(uint32_t val)
+{
+    if (val < (1u << SUB_BUCKET_BITS)) {
+        return val;
+    }
+    int msb = 31 - __builtin_clz(val);
+    int sub = (val >> (msb - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1);
+    return ((msb - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + sub;
+}
+
+int32_t WhoFrameTracer::Histogram::get_bucket_upper(int bucket)
+{
+    if (bucket < (1 << SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+    int shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    int sub = bucket & ((1 << SUB_BUCKET_BITS) - 1);
+    int64_t lower = (int64_t)((1 << SUB_BUCKET_BITS) + sub) << shift;
+    return (int32_t)std::min(lower + ((int64_t)1 << shift) - 1, (int64_t)INT32_MAX);
+}
+} // namespace frame_cap
+} // namespace who
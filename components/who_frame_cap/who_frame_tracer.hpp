@@ -0,0 +1,67 @@
+#pragma once
+#include "who_cam_define.hpp"
+#include <atomic>
+#include <string>
+
+namespace who {
+namespace frame_cap {
+class WhoFrameCap;
+
+// Collects the stage stamps of the frames into latency histograms. The stage latency of a stage is exit - enter, the
+// glass latency is exit - capture time, capture time is the enter stamp of the fetch stage. Without
+// CONFIG_WHO_FRAME_TRACE the frames carry no stamps and only the frame counters are printed.
+class WhoFrameTracer {
+public:
+    typedef struct {
+        uint32_t cnt;
+        int32_t min_us;
+        int32_t max_us;
+        int32_t mean_us;
+        // Percentiles are the upper bound of the histogram bucket they fall in, at most 25% above the real value.
+        int32_t p50_us;
+        int32_t p90_us;
+        int32_t p99_us;
+    } latency_stats_t;
+
+    static WhoFrameTracer *get_instance();
+    // Lock free, safe to call from any task.
+    void record(const who::cam::cam_fb_trace_t &trace, who::cam::cam_fb_stage_t stage);
+    latency_stats_t get_stage_latency(who::cam::cam_fb_stage_t stage);
+    latency_stats_t get_glass_latency(who::cam::cam_fb_stage_t stage);
+    // Print the latency of all the stages, and the frame counters of every edge in frame_cap if it is given.
+    void print(WhoFrameCap *frame_cap = nullptr);
+    void reset();
+    static const char *get_stage_name(who::cam::cam_fb_stage_t stage);
+
+private:
+    // Log2 buckets split into 4 linear sub buckets.
+    class Histogram {
+    public:
+        static inline constexpr int SUB_BUCKET_BITS = 2;
+        static inline constexpr int N_BUCKETS = (32 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+        Histogram() { reset(); }
+        void add(int32_t val);
+        latency_stats_t get_stats();
+        void reset();
+
+    private:
+        static int get_bucket(uint32_t val);
+        static int32_t get_bucket_upper(int bucket);
+
+        std::atomic<uint32_t> m_buckets[N_BUCKETS];
+        std::atomic<uint32_t> m_cnt;
+        std::atomic<int64_t> m_sum;
+        std::atomic<int32_t> m_min;
+        std::atomic<int32_t> m_max;
+    };
+
+    WhoFrameTracer() = default;
+    WhoFrameTracer(const WhoFrameTracer &) = delete;
+    WhoFrameTracer &operator=(const WhoFrameTracer &) = delete;
+
+    Histogram m_stage_hists[(int)who::cam::cam_fb_stage_t::CAM_FB_STAGE_MAX];
+    Histogram m_glass_hists[(int)who::cam::cam_fb_stage_t::CAM_FB_STAGE_MAX];
+};
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,303 @@
+#include "who_image_kernels.hpp"
+#include "esp_log.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+static const char *TAG = "WhoImageKernels";
+
+namespace who {
+namespace frame_cap {
+namespace {
+// Pixel formats, load expands to 8 bit channels and store packs them back.
+struct Rgb565Le {
+    static inline constexpr int BPP = 2;
+    static inline void load(const uint8_t *p, int &r, int &g, int &b)
+    {
+        uint16_t pix = p[0] | (p[1] << 8);
+        r = ((pix >> 8) & 0xf8) | (pix >> 13);
+        g = ((pix >> 3) & 0xfc) | ((pix >> 9) & 0x3);
+        b = ((pix << 3) & 0xf8) | ((pix >> 2) & 0x7);
+    }
+    static inline void store(uint8_t *p, int r, int g, int b)
+    {
+        uint16_t pix = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        p[0] = pix & 0xff;
+        p[1] = pix >> 8;
+    }
+};
+
+struct Rgb565Be {
+    static inline constexpr int BPP = 2;
+    static inline void load(const uint8_t *p, int &r, int &g, int &b)
+    {
+        uint8_t le[2] = {p[1], p[0]};
+        Rgb565Le::load(le, r, g, b);
+    }
+    static inline void store(uint8_t *p, int r, int g, int b)
+    {
+        uint16_t pix = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        p[0] = pix >> 8;
+        p[1] = pix & 0xff;
+    }
+};
+
+struct Rgb888 {
+    static inline constexpr int BPP = 3;
+    static inline void load(const uint8_t *p, int &r, int &g, int &b)
+    {
+        r = p[0];
+        g = p[1];
+        b = p[2];
+    }
+    static inline void store(uint8_t *p, int r, int g, int b)
+    {
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+    }
+};
+
+struct Gray {
+    static inline constexpr int BPP = 1;
+    static inline void load(const uint8_t *p, int &r, int &g, int &b) { r = g = b = p[0]; }
+    // BT.601 luma.
+    static inline void store(uint8_t *p, int r, int g, int b) { p[0] = (r * 77 + g * 150 + b * 29) >> 8; }
+};
+
+// Packed YUYV, a pair of pixels shares U and V. Rows are an even number of pixels and the buffers are at least 4 byte
+// aligned, so the pixel is the second of its pair if bit 1 of its address is set. Src only.
+struct Yuyv {
+    static inline constexpr int BPP = 2;
+    // BT.601 limited range, as the uvc and dvp sensors output it.
+    static inline void load(const uint8_t *p, int &r, int &g, int &b)
+    {
+        const uint8_t *pair = (const uint8_t *)((uintptr_t)p & ~(uintptr_t)3);
+        int c = 298 * (p[0] - 16) + 128;
+        int d = pair[1] - 128;
+        int e = pair[3] - 128;
+        r = std::clamp((c + 409 * e) >> 8, 0, 255);
+        g = std::clamp((c - 100 * d - 208 * e) >> 8, 0, 255);
+        b = std::clamp((c + 516 * d) >> 8, 0, 255);
+    }
+};
+
+// Only the luma of YUYV, for a GRAY dst. r = g = b makes Gray::store return it unchanged.
+struct YuyvLuma {
+    static inline constexpr int BPP = 2;
+    static inline void load(const uint8_t *p, int &r, int &g, int &b) { r = g = b = p[0]; }
+};
+
+// Src offset and bilinear weight of every dst pixel along one axis. Pixel centers are aligned, the same mapping as
+// cv::resize.
+void build_axis_table(bool bilinear,
+                      int src_min,
+                      int src_max,
+                      int dst_len,
+                      std::vector<uint16_t> &ofs,
+                      std::vector<uint8_t> &wts)
+{
+    int src_len = src_max - src_min;
+    float scale = (float)src_len / dst_len;
+    ofs.resize(dst_len);
+    wts.assign(dst_len, 0);
+    for (int i = 0; i < dst_len; i++) {
+        if (!bilinear) {
+            ofs[i] = src_min + std::min((int)((i + 0.5f) * scale), src_len - 1);
+            continue;
+        }
+        float pos = std::clamp((i + 0.5f) * scale - 0.5f, 0.f, (float)(src_len - 1));
+        int pos0 = std::min((int)pos, std::max(src_len - 2, 0));
+        ofs[i] = src_min + pos0;
+        wts[i] = (uint8_t)std::min((int)((pos - pos0) * 256 + 0.5f), 255);
+    }
+}
+} // namespace
+
+WhoImageResizer::WhoImageResizer(resize_interp_t interp, uint32_t caps) : m_interp(interp), m_caps(caps)
+{
+}
+
+bool WhoImageResizer::check_crop(const dl::image::img_t &src, const std::vector<int> &crop)
+{
+    if (!crop.empty() && (crop.size() != 4 || crop[0] < 0 || crop[1] < 0 || crop[2] > src.width ||
+                          crop[3] > src.height || crop[0] >= crop[2] || crop[1] >= crop[3])) {
+        ESP_LOGE(TAG, "Invalid crop area.");
+        return false;
+    }
+    return true;
+}
+
+bool WhoImageResizer::resize(const who::cam::cam_fb_t &src, const dl::image::img_t &dst, const std::vector<int> &crop)
+{
+    if (src.format != who::cam::cam_fb_fmt_t::CAM_FB_FMT_YUV422) {
+        return resize((dl::image::img_t)src, dst, crop);
+    }
+    // The kernels only look at the data and the size of src.
+    dl::image::img_t src_img = {
+        .data = src.buf, .width = src.width, .height = src.height, .pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB565};
+    if (!check_crop(src_img, crop)) {
+        return false;
+    }
+    update_tables(src_img, dst, crop);
+    if (dst.pix_type == dl::image::DL_IMAGE_PIX_TYPE_GRAY) {
+        return dispatch_dst<YuyvLuma>(src_img, dst);
+    }
+    return dispatch_dst<Yuyv>(src_img, dst);
+}
+
+bool WhoImageResizer::resize(const dl::image::img_t &src, const dl::image::img_t &dst, const std::vector<int> &crop)
+{
+    if (!check_crop(src, crop)) {
+        return false;
+    }
+    update_tables(src, dst, crop);
+    bool big_endian = m_caps & dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    switch (src.pix_type) {
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB565:
+        return big_endian ? dispatch_dst<Rgb565Be>(src, dst) : dispatch_dst<Rgb565Le>(src, dst);
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
+        return dispatch_dst<Rgb888>(src, dst);
+    case dl::image::DL_IMAGE_PIX_TYPE_GRAY:
+        return dispatch_dst<Gray>(src, dst);
+    default:
+        ESP_LOGE(TAG, "Unsupported src pix type.");
+        return false;
+    }
+}
+
+template <typename Src>
+bool WhoImageResizer::dispatch_dst(const dl::image::img_t &src, const dl::image::img_t &dst)
+{
+    bool big_endian = m_caps & dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
+    auto run = [&]<typename Dst>() {
+        if (m_interp == resize_interp_t::RESIZE_INTERP_NEAREST) {
+            resize_nearest<Src, Dst>(src, dst);
+        } else {
+            resize_bilinear<Src, Dst>(src, dst);
+        }
+    };
+    switch (dst.pix_type) {
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB565:
+        if (big_endian) {
+            run.template operator()<Rgb565Be>();
+        } else {
+            run.template operator()<Rgb565Le>();
+        }
+        return true;
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
+        run.template operator()<Rgb888>();
+        return true;
+    case dl::image::DL_IMAGE_PIX_TYPE_GRAY:
+        run.template operator()<Gray>();
+        return true;
+    default:
+        ESP_LOGE(TAG, "Unsupported dst pix type.");
+        return false;
+    }
+}
+
+void WhoImageResizer::update_tables(const dl::image::img_t &src,
+                                    const dl::image::img_t &dst,
+                                    const std::vector<int> &crop)
+{
+    std::vector<int> area = crop.empty() ? std::vector<int>{0, 0, src.width, src.height} : crop;
+    std::vector<int> geometry = {src.width, src.height, dst.width, dst.height, area[0], area[1], area[2], area[3]};
+    if (geometry == m_geometry) {
+        return;
+    }
+    m_geometry = geometry;
+    bool bilinear = m_interp == resize_interp_t::RESIZE_INTERP_BILINEAR;
+    build_axis_table(bilinear, area[0], area[2], dst.width, m_x_ofs, m_x_wts);
+    build_axis_table(bilinear, area[1], area[3], dst.height, m_y_ofs, m_y_wts);
+    if (bilinear) {
+        m_rows[0].resize(dst.width * 3);
+        m_rows[1].resize(dst.width * 3);
+    }
+}
+
+template <typename Src, typename Dst>
+void WhoImageResizer::resize_nearest(const dl::image::img_t &src, const dl::image::img_t &dst)
+{
+    const int src_stride = src.width * Src::BPP;
+    const uint16_t *x_ofs = m_x_ofs.data();
+    uint8_t *dst_ptr = (uint8_t *)dst.data;
+    for (int y = 0; y < dst.height; y++) {
+        const uint8_t *src_row = (const uint8_t *)src.data + m_y_ofs[y] * src_stride;
+        // Rows mapped from the same src row are identical.
+        if (y > 0 && m_y_ofs[y] == m_y_ofs[y - 1]) {
+            memcpy(dst_ptr, dst_ptr - dst.width * Dst::BPP, dst.width * Dst::BPP);
+            dst_ptr += dst.width * Dst::BPP;
+            continue;
+        }
+        for (int x = 0; x < dst.width; x++, dst_ptr += Dst::BPP) {
+            const uint8_t *p = src_row + x_ofs[x] * Src::BPP;
+            if constexpr (std::is_same_v<Src, Dst>) {
+                for (int c = 0; c < Src::BPP; c++) {
+                    dst_ptr[c] = p[c];
+                }
+            } else {
+                int r, g, b;
+                Src::load(p, r, g, b);
+                Dst::store(dst_ptr, r, g, b);
+            }
+        }
+    }
+}
+
+template <typename Src, typename Dst>
+void WhoImageResizer::resize_bilinear(const dl::image::img_t &src, const dl::image::img_t &dst)
+{
+    const int src_stride = src.width * Src::BPP;
+    const int src_x_max = m_geometry[6] - 1;
+    const int src_y_max = m_geometry[7] - 1;
+    // Interpolate a src row horizontally, the channels are kept in 8.8 fixed point.
+    auto interp_row = [&](int sy, uint16_t *row) {
+        const uint8_t *src_row = (const uint8_t *)src.data + sy * src_stride;
+        for (int x = 0; x < dst.width; x++, row += 3) {
+            int x0 = m_x_ofs[x];
+            int x1 = std::min(x0 + 1, src_x_max);
+            int w1 = m_x_wts[x];
+            int w0 = 256 - w1;
+            int r0, g0, b0, r1, g1, b1;
+            Src::load(src_row + x0 * Src::BPP, r0, g0, b0);
+            Src::load(src_row + x1 * Src::BPP, r1, g1, b1);
+            row[0] = r0 * w0 + r1 * w1;
+            row[1] = g0 * w0 + g1 * w1;
+            row[2] = b0 * w0 + b1 * w1;
+        }
+    };
+    // Src rows of the two interpolated rows, consecutive dst rows mostly share them.
+    int row_y[2] = {-1, -1};
+    uint8_t *dst_ptr = (uint8_t *)dst.data;
+    for (int y = 0; y < dst.height; y++) {
+        int y0 = m_y_ofs[y];
+        int y1 = std::min(y0 + 1, src_y_max);
+        if (row_y[0] != y0) {
+            if (row_y[1] == y0) {
+                std::swap(m_rows[0], m_rows[1]);
+                std::swap(row_y[0], row_y[1]);
+            } else {
+                interp_row(y0, m_rows[0].data());
+                row_y[0] = y0;
+            }
+        }
+        if (row_y[1] != y1) {
+            interp_row(y1, m_rows[1].data());
+            row_y[1] = y1;
+        }
+        uint32_t w1 = m_y_wts[y];
+        uint32_t w0 = 256 - w1;
+        const uint16_t *row0 = m_rows[0].data();
+        const uint16_t *row1 = m_rows[1].data();
+        for (int x = 0; x < dst.width; x++, dst_ptr += Dst::BPP, row0 += 3, row1 += 3) {
+            int r = (row0[0] * w0 + row1[0] * w1 + (1 << 15)) >> 16;
+            int g = (row0[1] * w0 + row1[1] * w1 + (1 << 15)) >> 16;
+            int b = (row0[2] * w0 + row1[2] * w1 + (1 << 15)) >> 16;
+            Dst::store(dst_ptr, r, g, b);
+        }
+    }
+}
+} // namespace frame_cap
+} // namespace who
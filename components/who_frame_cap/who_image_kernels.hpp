@@ -0,0 +1,47 @@
+#pragma once
+#include "dl_image.hpp"
+#include "who_cam_define.hpp"
+#include <vector>
+
+namespace who {
+namespace frame_cap {
+enum class resize_interp_t { RESIZE_INTERP_NEAREST, RESIZE_INTERP_BILINEAR };
+
+// Software resize with colour conversion for the targets without PPA. The coordinate tables are rebuilt only when the
+// geometry changes, so the per pixel work is a table lookup and, for bilinear, two 8 bit fixed point blends.
+// Supported src and dst: RGB565, RGB888, GRAY, and YUV422 as src of a fb. RGB565 is big endian in both src and dst if
+// caps has DL_IMAGE_CAP_RGB565_BIG_ENDIAN. A YUV422 src is converted only at the sampled pixels, and a GRAY dst takes
+// its luma as it is, so a yuv cam needs no full frame rgb conversion.
+class WhoImageResizer {
+public:
+    WhoImageResizer(resize_interp_t interp, uint32_t caps = 0);
+    // crop is {x_min, y_min, x_max, y_max} of src, empty for the whole src. Returns false on unsupported formats.
+    bool resize(const dl::image::img_t &src, const dl::image::img_t &dst, const std::vector<int> &crop = {});
+    bool resize(const who::cam::cam_fb_t &src, const dl::image::img_t &dst, const std::vector<int> &crop = {});
+    resize_interp_t get_interp() { return m_interp; }
+
+private:
+    bool check_crop(const dl::image::img_t &src, const std::vector<int> &crop);
+    void update_tables(const dl::image::img_t &src, const dl::image::img_t &dst, const std::vector<int> &crop);
+    template <typename Src, typename Dst>
+    void resize_nearest(const dl::image::img_t &src, const dl::image::img_t &dst);
+    template <typename Src, typename Dst>
+    void resize_bilinear(const dl::image::img_t &src, const dl::image::img_t &dst);
+    template <typename Src>
+    bool dispatch_dst(const dl::image::img_t &src, const dl::image::img_t &dst);
+
+    resize_interp_t m_interp;
+    uint32_t m_caps;
+    // Geometry the tables are built for, src w/h, dst w/h and crop.
+    std::vector<int> m_geometry;
+    // Src x/y of every dst x/y, the left/top one for bilinear.
+    std::vector<uint16_t> m_x_ofs;
+    std::vector<uint16_t> m_y_ofs;
+    // Weight of the right/bottom pixel in 1/256 for bilinear.
+    std::vector<uint8_t> m_x_wts;
+    std::vector<uint8_t> m_y_wts;
+    // Two horizontally interpolated src rows, 3 channels each.
+    std::vector<uint16_t> m_rows[2];
+};
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,310 @@
+#include "who_jpeg_decoder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <inttypes.h>
+#if CONFIG_SOC_JPEG_CODEC_SUPPORTED
+#include "hal/cache_hal.h"
+#include "hal/cache_ll.h"
+#endif
+
+using namespace who::cam;
+static const char *TAG = "WhoJpegDecoder";
+
+namespace who {
+namespace frame_cap {
+std::vector<int> WhoJpegDecoder::get_scaled_crop(uint16_t width, uint16_t height)
+{
+    int shift = (int)m_scale;
+    int scaled_w = std::max(width >> shift, 1);
+    int scaled_h = std::max(height >> shift, 1);
+    if (m_crop.size() != 4) {
+        return {0, 0, scaled_w, scaled_h};
+    }
+    int x_min = std::clamp(m_crop[0] >> shift, 0, scaled_w - 1);
+    int y_min = std::clamp(m_crop[1] >> shift, 0, scaled_h - 1);
+    int x_max = std::clamp(m_crop[2] >> shift, x_min + 1, scaled_w);
+    int y_max = std::clamp(m_crop[3] >> shift, y_min + 1, scaled_h);
+    return {x_min, y_min, x_max, y_max};
+}
+
+void WhoJpegDecoder::get_out_size(uint16_t &width, uint16_t &height)
+{
+    auto crop = get_scaled_crop(width, height);
+    width = crop[2] - crop[0];
+    height = crop[3] - crop[1];
+}
+
+#if CONFIG_SOC_JPEG_CODEC_SUPPORTED
+WhoJpegDecoder::WhoJpegDecoder(dl::image::pix_type_t pix_type, uint32_t caps) :
+    m_pix_type(pix_type),
+    m_scale(decode_scale_t::DECODE_SCALE_1),
+    m_handle(nullptr),
+    m_scratch(nullptr),
+    m_scratch_size(0)
+#if !CONFIG_SOC_PPA_SUPPORTED
+    ,
+    m_resizer(resize_interp_t::RESIZE_INTERP_NEAREST, caps)
+#endif
+{
+    jpeg_decode_engine_cfg_t engine_cfg = {};
+    engine_cfg.timeout_ms = 50;
+    ESP_ERROR_CHECK(jpeg_new_decoder_engine(&engine_cfg, &m_handle));
+    m_decode_cfg = {};
+    switch (pix_type) {
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB565:
+        m_decode_cfg.output_format = JPEG_DECODE_OUT_FORMAT_RGB565;
+        break;
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
+        m_decode_cfg.output_format = JPEG_DECODE_OUT_FORMAT_RGB888;
+        break;
+    default:
+        ESP_LOGE(TAG, "Unsupported pix type.");
+        break;
+    }
+    m_decode_cfg.rgb_order =
+        (caps & dl::image::DL_IMAGE_CAP_RGB_SWAP) ? JPEG_DEC_RGB_ELEMENT_ORDER_RGB : JPEG_DEC_RGB_ELEMENT_ORDER_BGR;
+    m_decode_cfg.conv_std = JPEG_YUV_RGB_CONV_STD_BT601;
+#if CONFIG_SOC_PPA_SUPPORTED
+    ppa_client_config_t ppa_client_config = {};
+    ppa_client_config.oper_type = PPA_OPERATION_SRM;
+    ESP_ERROR_CHECK(ppa_register_client(&ppa_client_config, &m_ppa_srm_handle));
+#endif
+}
+
+WhoJpegDecoder::~WhoJpegDecoder()
+{
+    ESP_ERROR_CHECK(jpeg_del_decoder_engine(m_handle));
+#if CONFIG_SOC_PPA_SUPPORTED
+    ESP_ERROR_CHECK(ppa_unregister_client(m_ppa_srm_handle));
+#endif
+    heap_caps_free(m_scratch);
+}
+
+bool WhoJpegDecoder::is_supported(uint16_t width, uint16_t height)
+{
+    // The scale is applied after the whole frame is decoded, any size works.
+    return true;
+}
+
+size_t WhoJpegDecoder::get_buf_size(uint16_t width, uint16_t height)
+{
+    if (m_scale != decode_scale_t::DECODE_SCALE_1 || !m_crop.empty()) {
+        get_out_size(width, height);
+        return width * height * dl::image::get_pix_byte_size(m_pix_type);
+    }
+    // The hardware decoder writes whole 16x16 blocks.
+    return dl::image::align_up(width, 16) * dl::image::align_up(height, 16) * dl::image::get_pix_byte_size(m_pix_type);
+}
+
+esp_err_t WhoJpegDecoder::decode(const cam_fb_t &jpeg, cam_fb_t &dst, size_t buf_size)
+{
+    jpeg_decode_picture_info_t info;
+    esp_err_t ret = jpeg_decoder_get_info((const uint8_t *)jpeg.buf, jpeg.len, &info);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (get_buf_size(info.width, info.height) > buf_size) {
+        ESP_LOGE(TAG, "Buffer too small to decode a %" PRIu32 "x%" PRIu32 " jpeg.", info.width, info.height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool direct = m_scale == decode_scale_t::DECODE_SCALE_1 && m_crop.empty();
+    void *out_buf = dst.buf;
+    size_t out_buf_size = buf_size;
+    if (!direct) {
+        size_t scratch_size = dl::image::align_up(info.width, 16) * dl::image::align_up(info.height, 16) *
+            dl::image::get_pix_byte_size(m_pix_type);
+        if (m_scratch_size < scratch_size) {
+            heap_caps_free(m_scratch);
+            size_t align = cache_hal_get_cache_line_size(CACHE_LL_LEVEL_EXT_MEM, CACHE_TYPE_DATA);
+            scratch_size = dl::image::align_up(scratch_size, align);
+            m_scratch = heap_caps_aligned_calloc(align, 1, scratch_size, MALLOC_CAP_SPIRAM);
+            m_scratch_size = m_scratch ? scratch_size : 0;
+            if (!m_scratch) {
+                ESP_LOGE(TAG, "Failed to allocate scratch buffer of %zu bytes.", scratch_size);
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        out_buf = m_scratch;
+        out_buf_size = m_scratch_size;
+    }
+    uint32_t out_size;
+    ret = jpeg_decoder_process(
+        m_handle, &m_decode_cfg, (const uint8_t *)jpeg.buf, jpeg.len, (uint8_t *)out_buf, out_buf_size, &out_size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    dl::image::img_t img = {.data = out_buf,
+                            .width = (uint16_t)info.width,
+                            .height = (uint16_t)info.height,
+                            .pix_type = m_pix_type};
+    if (!direct) {
+        int shift = (int)m_scale;
+        auto crop = get_scaled_crop(info.width, info.height);
+        dl::image::img_t out_img = {.data = dst.buf,
+                                    .width = (uint16_t)(crop[2] - crop[0]),
+                                    .height = (uint16_t)(crop[3] - crop[1]),
+                                    .pix_type = m_pix_type};
+        std::vector<int> src_crop = {crop[0] << shift,
+                                     crop[1] << shift,
+                                     std::min(crop[2] << shift, (int)info.width),
+                                     std::min(crop[3] << shift, (int)info.height)};
+#if CONFIG_SOC_PPA_SUPPORTED
+        dl::image::resize_ppa(img, out_img, m_ppa_srm_handle, 0, src_crop);
+#else
+        // Nearest resize by a power of 2 is a decimation.
+        if (!m_resizer.resize(img, out_img, src_crop)) {
+            return ESP_FAIL;
+        }
+#endif
+        img = out_img;
+    }
+    dst = cam_fb_t(img, dst.timestamp);
+    return ESP_OK;
+}
+#else
+WhoJpegDecoder::WhoJpegDecoder(dl::image::pix_type_t pix_type, uint32_t caps) :
+    m_pix_type(pix_type),
+    m_scale(decode_scale_t::DECODE_SCALE_1),
+    m_config(DEFAULT_JPEG_DEC_CONFIG()),
+    m_handle(nullptr)
+{
+    switch (pix_type) {
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB565:
+        m_config.output_type = (caps & dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN) ? JPEG_PIXEL_FORMAT_RGB565_BE
+                                                                                  : JPEG_PIXEL_FORMAT_RGB565_LE;
+        break;
+    case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
+        m_config.output_type = JPEG_PIXEL_FORMAT_RGB888;
+        break;
+    default:
+        ESP_LOGE(TAG, "Unsupported pix type.");
+        break;
+    }
+    // The handle is reused for every frame, only the header is parsed again.
+    if (jpeg_dec_open(&m_config, &m_handle) != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to open jpeg decoder.");
+    }
+}
+
+WhoJpegDecoder::~WhoJpegDecoder()
+{
+    if (m_handle) {
+        jpeg_dec_close(m_handle);
+    }
+}
+
+bool WhoJpegDecoder::is_supported(uint16_t width, uint16_t height)
+{
+    // esp_new_jpeg scales in the IDCT only to a size which is a multiple of 8.
+    int align = 8 << (int)m_scale;
+    return m_scale == decode_scale_t::DECODE_SCALE_1 || (width % align == 0 && height % align == 0);
+}
+
+void WhoJpegDecoder::get_decode_config(uint16_t width,
+                                       uint16_t height,
+                                       jpeg_resolution_t &scale,
+                                       jpeg_resolution_t &clipper,
+                                       uint16_t &dec_width,
+                                       uint16_t &dec_height)
+{
+    int shift = (int)m_scale;
+    scale = {0, 0};
+    dec_width = width;
+    dec_height = height;
+    if (shift) {
+        scale = {(uint16_t)(width >> shift), (uint16_t)(height >> shift)};
+        dec_width = scale.width;
+        dec_height = scale.height;
+    }
+    // The clipper keeps the top left of the scaled frame, it stops the decode right after the bottom right corner of
+    // the crop, the offset of the crop is moved out afterwards.
+    clipper = {0, 0};
+    if (!m_crop.empty()) {
+        auto crop = get_scaled_crop(width, height);
+        uint16_t clip_width = std::min<int>(dl::image::align_up(crop[2], 8), dec_width);
+        uint16_t clip_height = std::min<int>(dl::image::align_up(crop[3], 8), dec_height);
+        if ((clip_width < dec_width || clip_height < dec_height) && clip_width % 8 == 0 && clip_height % 8 == 0) {
+            clipper = {clip_width, clip_height};
+            dec_width = clip_width;
+            dec_height = clip_height;
+        }
+    }
+}
+
+size_t WhoJpegDecoder::get_buf_size(uint16_t width, uint16_t height)
+{
+    // The crop offset is moved out in place after the clipped frame is decoded.
+    jpeg_resolution_t scale, clipper;
+    uint16_t dec_width, dec_height;
+    get_decode_config(width, height, scale, clipper, dec_width, dec_height);
+    return dec_width * dec_height * dl::image::get_pix_byte_size(m_pix_type);
+}
+
+esp_err_t WhoJpegDecoder::decode(const cam_fb_t &jpeg, cam_fb_t &dst, size_t buf_size)
+{
+    if (!m_handle) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    jpeg_dec_io_t io = {};
+    io.inbuf = (uint8_t *)jpeg.buf;
+    io.inbuf_len = jpeg.len;
+    jpeg_dec_header_info_t info;
+    if (jpeg_dec_parse_header(m_handle, &io, &info) != JPEG_ERR_OK) {
+        return ESP_FAIL;
+    }
+    if (!is_supported(info.width, info.height)) {
+        ESP_LOGE(TAG, "A %dx%d jpeg can't be scaled by 1/%d.", info.width, info.height, 1 << (int)m_scale);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    jpeg_resolution_t scale, clipper;
+    uint16_t width, height;
+    get_decode_config(info.width, info.height, scale, clipper, width, height);
+    if (scale.width != m_config.scale.width || scale.height != m_config.scale.height ||
+        clipper.width != m_config.clipper.width || clipper.height != m_config.clipper.height) {
+        // The scale and the clipper are given when the handle is opened.
+        jpeg_dec_close(m_handle);
+        m_handle = nullptr;
+        m_config.scale = scale;
+        m_config.clipper = clipper;
+        if (jpeg_dec_open(&m_config, &m_handle) != JPEG_ERR_OK) {
+            ESP_LOGE(TAG, "Failed to open jpeg decoder.");
+            return ESP_FAIL;
+        }
+        io = {};
+        io.inbuf = (uint8_t *)jpeg.buf;
+        io.inbuf_len = jpeg.len;
+        if (jpeg_dec_parse_header(m_handle, &io, &info) != JPEG_ERR_OK) {
+            return ESP_FAIL;
+        }
+    }
+    int out_len = 0;
+    if (jpeg_dec_get_outbuf_len(m_handle, &out_len) != JPEG_ERR_OK || out_len > buf_size) {
+        ESP_LOGE(TAG, "Buffer too small to decode a %dx%d jpeg.", info.width, info.height);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    io.outbuf = (uint8_t *)dst.buf;
+    if (jpeg_dec_process(m_handle, &io) != JPEG_ERR_OK) {
+        return ESP_FAIL;
+    }
+    dl::image::img_t img = {.data = dst.buf, .width = width, .height = height, .pix_type = m_pix_type};
+    if (!m_crop.empty()) {
+        auto crop = get_scaled_crop(info.width, info.height);
+        size_t pix_size = dl::image::get_pix_byte_size(m_pix_type);
+        size_t row_size = (crop[2] - crop[0]) * pix_size;
+        // Every row moves to a lower address, so the rows can be moved in place from the top. Nothing moves if the
+        // crop starts at the top left.
+        if (crop[0] || crop[1] || crop[2] < width) {
+            uint8_t *buf = (uint8_t *)dst.buf;
+            for (int y = crop[1]; y < crop[3]; y++) {
+                memmove(buf + (y - crop[1]) * row_size, buf + (y * width + crop[0]) * pix_size, row_size);
+            }
+        }
+        img.width = crop[2] - crop[0];
+        img.height = crop[3] - crop[1];
+    }
+    dst = cam_fb_t(img, dst.timestamp);
+    return ESP_OK;
+}
+#endif
+} // namespace frame_cap
+} // namespace who
@@ -0,0 +1,70 @@
+#pragma once
+#include "who_cam_define.hpp"
+#include "who_image_kernels.hpp"
+#if CONFIG_SOC_JPEG_CODEC_SUPPORTED
+#include "driver/jpeg_decode.h"
+#else
+#include "esp_jpeg_dec.h"
+#endif
+
+namespace who {
+namespace frame_cap {
+enum class decode_scale_t { DECODE_SCALE_1, DECODE_SCALE_1_2, DECODE_SCALE_1_4, DECODE_SCALE_1_8 };
+
+// Decodes jpeg fbs into caller provided buffers, the hardware decoder is used if the soc has one.
+// The output can be scaled down by 1/2, 1/4 or 1/8 and cropped. The software decoder scales in the IDCT and stops at
+// the bottom right of the crop, so the decode time shrinks with the output. The hardware decoder can not scale, it
+// decodes the whole frame into a scratch buffer which PPA scales and crops, so the cpu stays free, only the output
+// buffers shrink.
+class WhoJpegDecoder {
+public:
+    WhoJpegDecoder(dl::image::pix_type_t pix_type, uint32_t caps = 0);
+    ~WhoJpegDecoder();
+    // Only before the first decode.
+    void set_scale(decode_scale_t scale) { m_scale = scale; }
+    // crop is {x_min, y_min, x_max, y_max} of the jpeg frame, empty for the whole frame. It is aligned to the scale.
+    void set_crop(const std::vector<int> &crop) { m_crop = crop; }
+    decode_scale_t get_scale() { return m_scale; }
+    const std::vector<int> &get_crop() { return m_crop; }
+    // False if a jpeg of width x height can't be decoded at the scale.
+    bool is_supported(uint16_t width, uint16_t height);
+    // Size of the output decoded from a jpeg of width x height.
+    void get_out_size(uint16_t &width, uint16_t &height);
+    // Minimum byte size of the buffer to decode a jpeg of width x height.
+    size_t get_buf_size(uint16_t width, uint16_t height);
+    // Decode jpeg into dst->buf which holds buf_size bytes, the other fields of dst except timestamp are updated.
+    esp_err_t decode(const who::cam::cam_fb_t &jpeg, who::cam::cam_fb_t &dst, size_t buf_size);
+
+private:
+    // {x_min, y_min, x_max, y_max} of the output in the scaled frame.
+    std::vector<int> get_scaled_crop(uint16_t width, uint16_t height);
+
+    dl::image::pix_type_t m_pix_type;
+    decode_scale_t m_scale;
+    std::vector<int> m_crop;
+#if CONFIG_SOC_JPEG_CODEC_SUPPORTED
+    jpeg_decoder_handle_t m_handle;
+    jpeg_decode_cfg_t m_decode_cfg;
+    // Whole frame decoded before it is scaled or cropped.
+    void *m_scratch;
+    size_t m_scratch_size;
+#if CONFIG_SOC_PPA_SUPPORTED
+    ppa_client_handle_t m_ppa_srm_handle;
+#else
+    WhoImageResizer m_resizer;
+#endif
+#else
+    // Scale and clipper of the decoder config for a jpeg of width x height, and the size of the frame they decode.
+    void get_decode_config(uint16_t width,
+                           uint16_t height,
+                           jpeg_resolution_t &scale,
+                           jpeg_resolution_t &clipper,
+                           uint16_t &dec_width,
+                           uint16_t &dec_height);
+
+    jpeg_dec_config_t m_config;
+    jpeg_dec_handle_t m_handle;
+#endif
+};
+} // namespace frame_cap
+} // namespace who
@@ -1,89 +1,200 @@
-#include <freertos/FreeRTOS.h>
-#include <vector>
+#pragma once
+#include "esp_log.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 
+// Lock-free ring with a single writer and any number of readers. Every pushed value gets a sequence number, readers
+// address a value either by its index in the ring or by its sequence number, and never block the writer. The capacity
+// is rounded up to a power of two, only the latest len values are kept in the ring.
 template <typename T>
 class RingBuf {
-private:
-    T *m_buffer;
-    int m_capacity;
-    int m_head;
-    int m_count;
-
 public:
-    RingBuf(int capacity) : m_buffer(new T[capacity]), m_capacity(capacity), m_head(0), m_count(0) {}
+    static inline constexpr uint32_t INVALID_SEQ = UINT32_MAX;
+
+    // View of the values in [start, end) of the ring which does not copy them. Values which are overwritten while
+    // iterating read as T{}.
+    class Span {
+    public:
+        class Iterator {
+        public:
+            Iterator(const RingBuf *ring, uint32_t seq) : m_ring(ring), m_seq(seq) {}
+            T operator*() const
+            {
+                T value{};
+                m_ring->peek_by_seq(m_seq, value);
+                return value;
+            }
+            Iterator &operator++()
+            {
+                m_seq++;
+                return *this;
+            }
+            bool operator==(const Iterator &other) const { return m_seq == other.m_seq; }
+            bool operator!=(const Iterator &other) const { return m_seq != other.m_seq; }
+            uint32_t seq() const { return m_seq; }
+
+        private:
+            const RingBuf *m_ring;
+            uint32_t m_seq;
+        };
+
+        Span(const RingBuf *ring, uint32_t start_seq, uint32_t end_seq) :
+            m_ring(ring), m_start_seq(start_seq), m_end_seq(end_seq)
+        {
+        }
+        Iterator begin() const { return Iterator(m_ring, m_start_seq); }
+        Iterator end() const { return Iterator(m_ring, m_end_seq); }
+        int size() const { return m_end_seq - m_start_seq; }
+        bool empty() const { return m_end_seq == m_start_seq; }
+
+    private:
+        const RingBuf *m_ring;
+        uint32_t m_start_seq;
+        uint32_t m_end_seq;
+    };
 
-    ~RingBuf() { delete[] m_buffer; }
+    RingBuf(int len) : m_capacity(round_up_pow2(len)), m_len(len), m_head(0), m_tail(0)
+    {
+        m_mask = m_capacity - 1;
+        m_slots = new slot_t[m_capacity];
+        for (int i = 0; i < m_capacity; i++) {
+            m_slots[i].seq.store(INVALID_SEQ, std::memory_order_relaxed);
+            m_slots[i].value.store(T{}, std::memory_order_relaxed);
+        }
+    }
+
+    ~RingBuf() { delete[] m_slots; }
 
-    void push(const T &value)
+    // Writer only. Returns true if the oldest value is pushed out of the ring, it is returned by evicted.
+    bool push(const T &value, T &evicted)
     {
-        if (m_count == m_capacity) {
-            ESP_LOGE("RingBuf", "RingBuf is full.");
+        bool ret = false;
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_relaxed) >= len()) {
+            ret = pop(evicted);
         }
-        m_buffer[(m_head + m_count) % m_capacity] = value;
-        m_count++;
+        slot_t &slot = m_slots[head & m_mask];
+        slot.seq.store(INVALID_SEQ, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.seq.store(head, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
+        return ret;
     }
 
-    T pop()
+    // Writer only. The slot is invalidated before the value is handed out, so readers can not take it any more.
+    bool pop(T &value)
     {
-        if (m_count == 0) {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_relaxed)) {
             ESP_LOGE("RingBuf", "RingBuf is empty.");
+            return false;
         }
-        T value = m_buffer[m_head];
-        m_head = (m_head + 1) % m_capacity;
-        m_count--;
-        return value;
+        slot_t &slot = m_slots[tail & m_mask];
+        value = slot.value.load(std::memory_order_relaxed);
+        slot.seq.store(INVALID_SEQ, std::memory_order_relaxed);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
     }
 
-    T &operator[](int index)
+    // Returns false if the value of seq is not in the ring.
+    bool peek_by_seq(uint32_t seq, T &value) const
     {
-        if (index < 0 || index >= m_count) {
-            ESP_LOGE("RingBuf", "Index out of range.");
+        const slot_t &slot = m_slots[seq & m_mask];
+        if (seq == INVALID_SEQ || slot.seq.load(std::memory_order_acquire) != seq) {
+            return false;
         }
-        return m_buffer[(m_head + index) % m_capacity];
+        T ret = slot.value.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) {
+            return false;
+        }
+        value = ret;
+        return true;
     }
 
-    std::vector<T> range(int start, int end) const
+    // Take a reference of the value of seq. try_retain(value) must fail once the value is released by the writer, the
+    // value is handed out only if it is still in the ring after it is retained, otherwise release(value) is called.
+    template <typename TryRetain, typename Release>
+    bool acquire_by_seq(uint32_t seq, T &value, TryRetain &&try_retain, Release &&release) const
     {
-        if (start < 0 || end > m_count || start > end) {
-            ESP_LOGE("RingBuf", "Invalid range.");
+        T ret;
+        if (!peek_by_seq(seq, ret) || !try_retain(ret)) {
+            return false;
         }
-        if (start == end) {
-            return {};
+        if (m_slots[seq & m_mask].seq.load(std::memory_order_relaxed) != seq) {
+            release(ret);
+            return false;
         }
-        int rel_start = (m_head + start) % m_capacity;
-        int rel_end = (m_head + end) % m_capacity;
-        std::vector<T> sub_buf;
-        if (rel_start < rel_end) {
-            sub_buf = std::vector<T>(m_buffer + rel_start, m_buffer + rel_end);
-        } else {
-            sub_buf = std::vector<T>(m_buffer + rel_start, m_buffer + m_count);
-            std::vector<T> sub_buf2(m_buffer, m_buffer + rel_end);
-            sub_buf.insert(sub_buf.end(), sub_buf2.begin(), sub_buf2.end());
-        }
-        return sub_buf;
+        value = ret;
+        return true;
     }
 
-    T &front()
+    // Sequence number of the value at index, index -1 means the latest one. Returns INVALID_SEQ if out of range.
+    uint32_t get_seq(int index) const
     {
-        if (m_count == 0) {
-            ESP_LOGE("RingBuf", "RingBuf is empty.");
+        uint32_t tail = m_tail.load(std::memory_order_acquire);
+        uint32_t head = m_head.load(std::memory_order_acquire);
+        int size = head - tail;
+        if (index == -1) {
+            index = size - 1;
         }
-        return m_buffer[m_head];
+        if (index < 0 || index >= size) {
+            return INVALID_SEQ;
+        }
+        return tail + index;
     }
 
-    T &back()
+    bool peek(int index, T &value) const { return peek_by_seq(get_seq(index), value); }
+
+    Span span(int start, int end) const
     {
-        if (m_count == 0) {
-            ESP_LOGE("RingBuf", "RingBuf is empty.");
+        uint32_t tail = m_tail.load(std::memory_order_acquire);
+        uint32_t head = m_head.load(std::memory_order_acquire);
+        if (start < 0 || end > (int)(head - tail) || start > end) {
+            ESP_LOGE("RingBuf", "Invalid range.");
+            return Span(this, tail, tail);
         }
-        return m_buffer[(m_head + m_count - 1) % m_capacity];
+        return Span(this, tail + start, tail + end);
     }
 
+    // Sequence number the next pushed value will get.
+    uint32_t next_seq() const { return m_head.load(std::memory_order_acquire); }
+
     int capacity() const { return m_capacity; }
 
-    int size() const { return m_count; }
+    int len() const { return m_len.load(std::memory_order_relaxed); }
+
+    // Change the number of values kept in the ring within [1, capacity]. If the ring shrinks, the writer has to pop the
+    // extra values.
+    void set_len(int len) { m_len.store(std::max(1, std::min(len, m_capacity)), std::memory_order_relaxed); }
+
+    int size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+    bool empty() const { return size() == 0; }
 
-    bool empty() const { return m_count == 0; }
+    bool full() const { return size() >= len(); }
 
-    bool full() const { return m_count == m_capacity; }
+private:
+    struct slot_t {
+        std::atomic<uint32_t> seq;
+        std::atomic<T> value;
+    };
+
+    static int round_up_pow2(int n)
+    {
+        int ret = 1;
+        while (ret < n) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    slot_t *m_slots;
+    int m_capacity;
+    uint32_t m_mask;
+    std::atomic<int> m_len;
+    std::atomic<uint32_t> m_head;
+    std::atomic<uint32_t> m_tail;
 };
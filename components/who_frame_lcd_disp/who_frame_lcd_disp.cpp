@@ -1,6 +1,8 @@
 #include "who_frame_lcd_disp.hpp"
+#include "esp_timer.h"
 
 using namespace who::lcd;
+using namespace who::cam;
 
 namespace who {
 namespace lcd_disp {
@@ -55,23 +57,38 @@ void WhoFrameLCDDisp::task()
                 continue;
             }
         }
-        auto fb = m_frame_cap_node->cam_fb_peek(m_peek_index);
+        auto fb = m_frame_cap_node->cam_fb_acquire(m_peek_index);
+        if (!fb) {
+            continue;
+        }
+        int64_t start_us = esp_timer_get_time();
 #if BSP_CONFIG_NO_GRAPHIC_LIB
         if (m_lcd_disp_cb) {
-            m_lcd_disp_cb(fb);
+            m_lcd_disp_cb(fb.get());
         }
         m_lcd->draw_bitmap(fb->buf, (int)fb->width, (int)fb->height, 0, 0);
 #else
         bsp_display_lock(0);
         lv_canvas_set_buffer(m_canvas, fb->buf, fb->width, fb->height, LV_COLOR_FORMAT_NATIVE);
         if (m_lcd_disp_cb) {
-            m_lcd_disp_cb(fb);
+            m_lcd_disp_cb(fb.get());
         }
         bsp_display_unlock();
 #endif
+        // fb is shared with the other subscribers, stamp a copy of its trace.
+        cam_fb_trace_t trace = fb->trace;
+        trace.stamp(cam_fb_stage_t::CAM_FB_STAGE_DISPLAY, start_us, esp_timer_get_time());
+        frame_cap::WhoFrameTracer::get_instance()->record(trace, cam_fb_stage_t::CAM_FB_STAGE_DISPLAY);
+        // The lcd may still read from the fb after draw returns, hold it until the next fb is displayed.
+        m_disp_fb = std::move(fb);
     }
     xEventGroupSetBits(m_event_group, TASK_STOPPED);
     vTaskDelete(NULL);
 }
+
+void WhoFrameLCDDisp::cleanup()
+{
+    m_disp_fb.reset();
+}
 } // namespace lcd_disp
 } // namespace who
@@ -5,4 +5,8 @@
 #elif CONFIG_IDF_TARGET_ESP32P4
 #include "who_p4_cam.hpp"
 #endif
+#if !CONFIG_IDF_TARGET_LINUX
 #include "who_uvc_cam.hpp"
+#endif
+#include "who_replay_cam.hpp"
+#include "who_synth_cam.hpp"
@@ -1,5 +1,6 @@
 #pragma once
 #include "who_cam_define.hpp"
+#include <atomic>
 
 namespace who {
 namespace cam {
@@ -7,20 +8,55 @@ class WhoCam {
 public:
     WhoCam(uint8_t fb_count) : WhoCam(fb_count, 0, 0) {}
     WhoCam(uint8_t fb_count, uint16_t fb_width, uint16_t fb_height) :
-        m_fb_count(fb_count), m_cam_fbs(new cam_fb_t[fb_count]), m_fb_width(fb_width), m_fb_height(fb_height)
+        m_fb_count(fb_count),
+        m_cam_fbs(new cam_fb_t[fb_count]()),
+        m_fb_in_use(new std::atomic<bool>[fb_count]()),
+        m_fb_width(fb_width),
+        m_fb_height(fb_height)
     {
     }
-    virtual ~WhoCam() { delete[] m_cam_fbs; }
+    virtual ~WhoCam()
+    {
+        delete[] m_cam_fbs;
+        delete[] m_fb_in_use;
+    }
+    // Returns nullptr if the frame is dropped, e.g. because every slot is still held.
     virtual cam_fb_t *cam_fb_get() = 0;
     virtual void cam_fb_return(cam_fb_t *fb) = 0;
     uint16_t get_fb_width() { return m_fb_width; }
     uint16_t get_fb_height() { return m_fb_height; }
     uint8_t get_fb_count() { return m_fb_count; }
     virtual cam_fb_fmt_t get_fb_format() = 0;
+    // Frames the cam dropped because they were not fetched in time.
+    virtual uint32_t get_drop_cnt() { return 0; }
+    // False if the cam can't produce any frame, e.g. a recording which failed to parse. WhoFetchNode does not run then.
+    virtual bool is_valid() { return true; }
 
 protected:
+    // Slot for a new fb, held until release_cam_fb(), fbs may be returned out of order. Returns -1 if every slot is
+    // still held by the pipeline, the new frame must be dropped then, overwriting a slot would corrupt a fb somebody
+    // still reads. Only called by the fetch task.
+    int get_cam_fb_index()
+    {
+        for (int i = 0; i < m_fb_count; i++) {
+            // Pairs with the release in release_cam_fb(), the task which returned the fb is done with it.
+            if (!m_fb_in_use[i].load(std::memory_order_acquire)) {
+                m_fb_in_use[i].store(true, std::memory_order_relaxed);
+                return i;
+            }
+        }
+        return -1;
+    }
+    // Frees the slot of fb, at the end of cam_fb_return(), which may run in any task.
+    void release_cam_fb(cam_fb_t *fb)
+    {
+        fb->ret = nullptr;
+        m_fb_in_use[fb - m_cam_fbs].store(false, std::memory_order_release);
+    }
+
     uint8_t m_fb_count;
     cam_fb_t *m_cam_fbs;
+    std::atomic<bool> *m_fb_in_use;
     uint16_t m_fb_width;
     uint16_t m_fb_height;
 };
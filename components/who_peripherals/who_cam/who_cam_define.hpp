@@ -1,16 +1,81 @@
 #pragma once
 #include "dl_image.hpp"
-#include "usb/uvc_host.h"
+#include "sdkconfig.h"
+#include <cassert>
+#include <sys/time.h>
 #if CONFIG_IDF_TARGET_ESP32S3
 #include "esp_camera.h"
 #elif CONFIG_IDF_TARGET_ESP32P4
 #include "linux/videodev2.h"
 #endif
+// The linux target has neither usb host nor a board, only WhoReplayCam and WhoSynthCam are available there.
+#if !CONFIG_IDF_TARGET_LINUX
+#include "usb/uvc_host.h"
 #include "bsp/esp-bsp.h"
+#endif
 
 namespace who {
 namespace cam {
-enum class cam_fb_fmt_t { CAM_FB_FMT_RGB565, CAM_FB_FMT_RGB888, CAM_FB_FMT_JPEG, CAM_FB_FMT_UKN };
+// CAM_FB_FMT_YUV422 is packed YUYV (Y0 U Y1 V). It has no dl::image pix type, WhoImageResizer converts it to the
+// pix type of the consumer in the same pass as the resize.
+enum class cam_fb_fmt_t {
+    CAM_FB_FMT_RGB565,
+    CAM_FB_FMT_RGB888,
+    CAM_FB_FMT_JPEG,
+    CAM_FB_FMT_GRAY,
+    CAM_FB_FMT_YUV422,
+    CAM_FB_FMT_UKN
+};
+
+enum class cam_fb_stage_t {
+    CAM_FB_STAGE_FETCH,
+    CAM_FB_STAGE_DECODE,
+    CAM_FB_STAGE_RESIZE,
+    CAM_FB_STAGE_PREPROCESS,
+    CAM_FB_STAGE_INFER,
+    CAM_FB_STAGE_POSTPROCESS,
+    CAM_FB_STAGE_RESULT_CB,
+    CAM_FB_STAGE_DISPLAY,
+    CAM_FB_STAGE_MAX,
+};
+
+// The fb produced by a node inherits the trace of the fb it comes from, so the trace follows the frame through the
+// pipeline. Stamps are esp_timer us, 0 if the frame did not go through the stage. The stamps are only kept with
+// CONFIG_WHO_FRAME_TRACE, stamp() does nothing otherwise.
+typedef struct {
+    // Monotonic seq assigned when the frame is fetched.
+    uint32_t seq;
+#if CONFIG_WHO_FRAME_TRACE
+    int64_t enter_us[(int)cam_fb_stage_t::CAM_FB_STAGE_MAX];
+    int64_t exit_us[(int)cam_fb_stage_t::CAM_FB_STAGE_MAX];
+#endif
+
+    void stamp(cam_fb_stage_t stage, int64_t enter, int64_t exit)
+    {
+#if CONFIG_WHO_FRAME_TRACE
+        enter_us[(int)stage] = enter;
+        exit_us[(int)stage] = exit;
+#endif
+    }
+} cam_fb_trace_t;
+
+// Maps the coordinates in a fb cropped out of another frame back to that frame, x_src = x * scale_x + offset_x.
+typedef struct cam_fb_crop_s {
+    float scale_x;
+    float scale_y;
+    float offset_x;
+    float offset_y;
+
+    bool is_identity() const { return scale_x == 1 && scale_y == 1 && offset_x == 0 && offset_y == 0; }
+    // Crop of a fb cropped out of a fb which carries parent, it maps to the frame parent maps to.
+    cam_fb_crop_s compose(const cam_fb_crop_s &parent) const
+    {
+        return {scale_x * parent.scale_x,
+                scale_y * parent.scale_y,
+                offset_x * parent.scale_x + parent.offset_x,
+                offset_y * parent.scale_y + parent.offset_y};
+    }
+} cam_fb_crop_t;
 
 #if CONFIG_IDF_TARGET_ESP32S3
 inline framesize_t get_cam_frame_size_from_lcd_resolution()
@@ -32,12 +97,34 @@ inline cam_fb_fmt_t pix_fmt2cam_fb_fmt(pixformat_t pix_fmt)
         return cam_fb_fmt_t::CAM_FB_FMT_RGB888;
     case PIXFORMAT_JPEG:
         return cam_fb_fmt_t::CAM_FB_FMT_JPEG;
+    case PIXFORMAT_GRAYSCALE:
+        return cam_fb_fmt_t::CAM_FB_FMT_GRAY;
+    case PIXFORMAT_YUV422:
+        return cam_fb_fmt_t::CAM_FB_FMT_YUV422;
     default:
         return cam_fb_fmt_t::CAM_FB_FMT_UKN;
     }
 }
 #endif
 
+// Returns false if the format has no dl::image pix type.
+inline bool cam_fb_fmt2dl_pix_fmt(cam_fb_fmt_t fmt, dl::image::pix_type_t &dl_pix_fmt)
+{
+    switch (fmt) {
+    case cam_fb_fmt_t::CAM_FB_FMT_RGB565:
+        dl_pix_fmt = dl::image::DL_IMAGE_PIX_TYPE_RGB565;
+        return true;
+    case cam_fb_fmt_t::CAM_FB_FMT_RGB888:
+        dl_pix_fmt = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+        return true;
+    case cam_fb_fmt_t::CAM_FB_FMT_GRAY:
+        dl_pix_fmt = dl::image::DL_IMAGE_PIX_TYPE_GRAY;
+        return true;
+    default:
+        return false;
+    }
+}
+
 inline cam_fb_fmt_t dl_pix_fmt2cam_fb_fmt(dl::image::pix_type_t dl_pix_fmt)
 {
     switch (dl_pix_fmt) {
@@ -45,20 +132,26 @@ inline cam_fb_fmt_t dl_pix_fmt2cam_fb_fmt(dl::image::pix_type_t dl_pix_fmt)
         return cam_fb_fmt_t::CAM_FB_FMT_RGB565;
     case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
         return cam_fb_fmt_t::CAM_FB_FMT_RGB888;
+    case dl::image::DL_IMAGE_PIX_TYPE_GRAY:
+        return cam_fb_fmt_t::CAM_FB_FMT_GRAY;
     default:
         return cam_fb_fmt_t::CAM_FB_FMT_UKN;
     }
 }
 
+#if !CONFIG_IDF_TARGET_LINUX
 inline cam_fb_fmt_t uvc_fmt2cam_fb_fmt(uvc_host_stream_format uvc_fmt)
 {
     switch (uvc_fmt) {
     case UVC_VS_FORMAT_MJPEG:
         return cam_fb_fmt_t::CAM_FB_FMT_JPEG;
+    case UVC_VS_FORMAT_YUY2:
+        return cam_fb_fmt_t::CAM_FB_FMT_YUV422;
     default:
         return cam_fb_fmt_t::CAM_FB_FMT_UKN;
     }
 }
+#endif
 
 #if CONFIG_IDF_TARGET_ESP32P4
 inline cam_fb_fmt_t v4l2_fmt2cam_fb_fmt(uint32_t v4l2_fmt)
@@ -71,6 +164,10 @@ inline cam_fb_fmt_t v4l2_fmt2cam_fb_fmt(uint32_t v4l2_fmt)
     case V4L2_PIX_FMT_MJPEG:
     case V4L2_PIX_FMT_JPEG:
         return cam_fb_fmt_t::CAM_FB_FMT_JPEG;
+    case V4L2_PIX_FMT_YUYV:
+        return cam_fb_fmt_t::CAM_FB_FMT_YUV422;
+    case V4L2_PIX_FMT_GREY:
+        return cam_fb_fmt_t::CAM_FB_FMT_GRAY;
     default:
         return cam_fb_fmt_t::CAM_FB_FMT_UKN;
     }
@@ -85,6 +182,10 @@ typedef struct cam_fb_s {
     cam_fb_fmt_t format;
     struct timeval timestamp;
     void *ret;
+    // Number of holders of the fb in the frame cap pipeline, the fb is recycled when it drops to zero.
+    int ref_cnt = 0;
+    cam_fb_trace_t trace = {};
+    cam_fb_crop_t crop = {1, 1, 0, 0};
     cam_fb_s() = default;
 #if CONFIG_IDF_TARGET_ESP32S3
     cam_fb_s(const camera_fb_t &fb)
@@ -98,6 +199,7 @@ typedef struct cam_fb_s {
         ret = (void *)(&fb);
     }
 #endif
+#if !CONFIG_IDF_TARGET_LINUX
     cam_fb_s(const uvc_host_frame_t &fb, int64_t cur_time)
     {
         buf = (void *)fb.data;
@@ -109,6 +211,7 @@ typedef struct cam_fb_s {
         timestamp.tv_usec = cur_time % 1000000;
         ret = (void *)(&fb);
     }
+#endif
     cam_fb_s(const dl::image::img_t &img, const struct timeval &time)
     {
         buf = img.data;
@@ -119,13 +222,14 @@ typedef struct cam_fb_s {
         timestamp = time;
         ret = nullptr;
     }
+    // Only the rgb and gray fbs can be viewed as an img_t, data is nullptr for the other formats. Put a WhoDecodeNode
+    // after a jpeg cam and a WhoSWResizeNode or a WhoGrayNode after a yuv422 cam, the consumers of a node check its
+    // format when they run.
     operator dl::image::img_t() const
     {
-        return {.data = buf,
-                .width = width,
-                .height = height,
-                .pix_type = format == who::cam::cam_fb_fmt_t::CAM_FB_FMT_RGB565 ? dl::image::DL_IMAGE_PIX_TYPE_RGB565
-                                                                                : dl::image::DL_IMAGE_PIX_TYPE_RGB888};
+        dl::image::pix_type_t pix_type = dl::image::DL_IMAGE_PIX_TYPE_RGB888;
+        void *data = cam_fb_fmt2dl_pix_fmt(format, pix_type) ? buf : nullptr;
+        return {.data = data, .width = width, .height = height, .pix_type = pix_type};
     }
 } cam_fb_t;
 
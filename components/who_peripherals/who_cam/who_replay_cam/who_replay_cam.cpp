@@ -0,0 +1,185 @@
+#include "who_replay_cam.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <cinttypes>
+#include <cstring>
+#include <unistd.h>
+#if CONFIG_IDF_TARGET_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#include "esp_partition.h"
+#endif
+
+static const char *TAG = "WhoReplayCam";
+
+namespace who {
+namespace cam {
+template <typename T>
+static T read_le(const uint8_t *p)
+{
+    T val = 0;
+    for (int i = sizeof(T) - 1; i >= 0; i--) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+WhoReplayCam::WhoReplayCam(const void *recording, size_t size, float fps, uint8_t fb_count, bool loop) :
+    WhoCam(fb_count),
+    m_format(cam_fb_fmt_t::CAM_FB_FMT_UKN),
+    m_period_us(fps > 0 ? (int64_t)(1000000 / fps) : 0),
+    m_loop(loop),
+    m_frame_idx(0),
+    m_n_loops(0),
+    m_next_due_us(0),
+    m_drop_cnt(0)
+{
+    if (!parse((const uint8_t *)recording, size)) {
+        ESP_LOGE(TAG, "Invalid recording.");
+    }
+}
+
+WhoReplayCam::~WhoReplayCam()
+{
+    if (m_unmap) {
+        m_unmap();
+    }
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+WhoReplayCam *WhoReplayCam::from_file(const char *path, float fps, uint8_t fb_count, bool loop)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Failed to open %s.", path);
+        return nullptr;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        ESP_LOGE(TAG, "Failed to map %s.", path);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    WhoReplayCam *cam = new WhoReplayCam(data, size, fps, fb_count, loop);
+    cam->m_unmap = [data, size]() { munmap(data, size); };
+    return cam;
+}
+#else
+WhoReplayCam *WhoReplayCam::from_partition(const char *label, float fps, uint8_t fb_count, bool loop)
+{
+    const esp_partition_t *partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) {
+        ESP_LOGE(TAG, "Partition %s not found.", label);
+        return nullptr;
+    }
+    const void *data;
+    esp_partition_mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &data, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map partition %s.", label);
+        return nullptr;
+    }
+    WhoReplayCam *cam = new WhoReplayCam(data, partition->size, fps, fb_count, loop);
+    cam->m_unmap = [handle]() { esp_partition_munmap(handle); };
+    return cam;
+}
+#endif
+
+bool WhoReplayCam::parse(const uint8_t *recording, size_t size)
+{
+    if (size < HEADER_SIZE || memcmp(recording, "WHOR", 4) || recording[4] != VERSION) {
+        return false;
+    }
+    m_format = (cam_fb_fmt_t)recording[5];
+    m_fb_width = read_le<uint16_t>(recording + 6);
+    m_fb_height = read_le<uint16_t>(recording + 8);
+    uint32_t n_frames = read_le<uint32_t>(recording + 12);
+    // A partition is usually larger than the recording, the frames after the header are bounded by n_frames.
+    size_t offset = HEADER_SIZE;
+    for (uint32_t i = 0; i < n_frames; i++) {
+        if (offset + 4 > size) {
+            break;
+        }
+        size_t len = read_le<uint32_t>(recording + offset);
+        offset += 4;
+        if (len > size - offset) {
+            break;
+        }
+        m_frames.emplace_back(recording + offset, len);
+        offset += (len + 3) & ~(size_t)3;
+    }
+    if (m_frames.size() != n_frames) {
+        ESP_LOGE(TAG, "Recording truncated, %d of %" PRIu32 " frames.", (int)m_frames.size(), n_frames);
+    }
+    return !m_frames.empty();
+}
+
+void WhoReplayCam::wait_frame_due()
+{
+    if (!m_period_us) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    // Start over if the pipeline fell behind by more than a frame, instead of replaying the backlog in a burst.
+    if (!m_next_due_us || now_us - m_next_due_us > m_period_us) {
+        m_next_due_us = now_us;
+    } else if (m_next_due_us > now_us) {
+        usleep(m_next_due_us - now_us);
+    }
+    m_next_due_us += m_period_us;
+}
+
+cam_fb_t *WhoReplayCam::cam_fb_get()
+{
+    if (m_frames.empty() || is_finished()) {
+        // Keep the fetch task from spinning.
+        vTaskDelay(pdMS_TO_TICKS(100));
+        return nullptr;
+    }
+    wait_frame_due();
+    int i = get_cam_fb_index();
+    if (i < 0 && !m_period_us) {
+        // Nothing is late when the frames are not paced, give the pipeline time to return a fb and try the same frame.
+        vTaskDelay(1);
+        return nullptr;
+    }
+    const auto &[data, len] = m_frames[m_frame_idx];
+    if (++m_frame_idx == m_frames.size()) {
+        m_frame_idx = 0;
+        m_n_loops++;
+    }
+    if (i < 0) {
+        // Paced in real time, the frame is dropped as a sensor would drop it.
+        m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    cam_fb_t &fb = m_cam_fbs[i];
+    fb = cam_fb_t();
+    fb.buf = (void *)data;
+    fb.len = len;
+    fb.width = m_fb_width;
+    fb.height = m_fb_height;
+    fb.format = m_format;
+    // The frame is captured now as far as the pipeline is concerned.
+    int64_t now_us = esp_timer_get_time();
+    fb.timestamp.tv_sec = now_us / 1000000;
+    fb.timestamp.tv_usec = now_us % 1000000;
+    fb.ret = (void *)data;
+    return &fb;
+}
+
+void WhoReplayCam::cam_fb_return(cam_fb_t *fb)
+{
+    release_cam_fb(fb);
+}
+} // namespace cam
+} // namespace who
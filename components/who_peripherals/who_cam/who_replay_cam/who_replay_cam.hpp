@@ -0,0 +1,56 @@
+#pragma once
+#include "who_cam_base.hpp"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace who {
+namespace cam {
+// Plays back a recording made by tools/replay_recorder.py instead of a sensor, so that a pipeline can be benchmarked
+// on the same frames every run, without a camera or on the linux target. The recording is memory mapped and the fbs
+// point into it, nothing is copied. Layout, all little endian:
+//   header: "WHOR", u8 version, u8 cam_fb_fmt_t, u16 width, u16 height, u16 reserved, u32 n_frames
+//   frame:  u32 len, len bytes, padded to 4 bytes
+// RGB565 frames are replayed as they are recorded, record them in the byte order of the cam they stand in for.
+class WhoReplayCam : public WhoCam {
+public:
+    // fps 0 replays as fast as the pipeline fetches, otherwise the frames are paced in real time. Without loop,
+    // cam_fb_get() returns nullptr once all the frames are replayed. The recording must outlive the cam.
+    WhoReplayCam(const void *recording, size_t size, float fps = 0, uint8_t fb_count = 3, bool loop = true);
+    ~WhoReplayCam();
+#if CONFIG_IDF_TARGET_LINUX
+    static WhoReplayCam *from_file(const char *path, float fps = 0, uint8_t fb_count = 3, bool loop = true);
+#else
+    // The recording is flashed to a data partition, e.g. with parttool.py.
+    static WhoReplayCam *from_partition(const char *label, float fps = 0, uint8_t fb_count = 3, bool loop = true);
+#endif
+    cam_fb_t *cam_fb_get() override;
+    void cam_fb_return(cam_fb_t *fb) override;
+    cam_fb_fmt_t get_fb_format() override { return m_format; }
+    uint32_t get_drop_cnt() override { return m_drop_cnt.load(std::memory_order_relaxed); }
+    bool is_valid() override { return !m_frames.empty(); }
+    int get_n_frames() { return m_frames.size(); }
+    // Number of times the whole recording is replayed.
+    uint32_t get_n_loops() { return m_n_loops; }
+    bool is_finished() { return !m_loop && m_n_loops > 0; }
+
+private:
+    static inline constexpr uint8_t VERSION = 1;
+    static inline constexpr size_t HEADER_SIZE = 16;
+
+    bool parse(const uint8_t *recording, size_t size);
+    void wait_frame_due();
+
+    std::vector<std::pair<const uint8_t *, size_t>> m_frames;
+    cam_fb_fmt_t m_format;
+    int64_t m_period_us;
+    bool m_loop;
+    int m_frame_idx;
+    uint32_t m_n_loops;
+    int64_t m_next_due_us;
+    std::atomic<uint32_t> m_drop_cnt;
+    // Unmaps the recording if the cam mapped it.
+    std::function<void()> m_unmap;
+};
+} // namespace cam
+} // namespace who
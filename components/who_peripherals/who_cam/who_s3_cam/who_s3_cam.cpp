@@ -12,7 +12,7 @@ WhoS3Cam::WhoS3Cam(const pixformat_t pixel_format,
                    const uint8_t fb_count,
                    bool vertical_flip,
                    bool horizontal_flip) :
-    WhoCam(fb_count, resolution[frame_size].width, resolution[frame_size].height), m_format(pixel_format)
+    WhoCam(fb_count, resolution[frame_size].width, resolution[frame_size].height), m_format(pixel_format), m_drop_cnt(0)
 {
     ESP_ERROR_CHECK(bsp_i2c_init());
     camera_config_t camera_config = BSP_CAMERA_DEFAULT_CONFIG;
@@ -36,7 +36,16 @@ WhoS3Cam::~WhoS3Cam()
 cam_fb_t *WhoS3Cam::cam_fb_get()
 {
     camera_fb_t *fb = esp_camera_fb_get();
+    // Timed out waiting for the sensor.
+    if (!fb) {
+        return nullptr;
+    }
     int i = get_cam_fb_index();
+    if (i < 0) {
+        esp_camera_fb_return(fb);
+        m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
     m_cam_fbs[i] = cam_fb_t(*fb);
     return &m_cam_fbs[i];
 }
@@ -44,6 +53,7 @@ cam_fb_t *WhoS3Cam::cam_fb_get()
 void WhoS3Cam::cam_fb_return(cam_fb_t *fb)
 {
     esp_camera_fb_return((camera_fb_t *)fb->ret);
+    release_cam_fb(fb);
 }
 
 esp_err_t WhoS3Cam::set_flip(bool vertical_flip, bool horizontal_flip)
@@ -67,13 +77,5 @@ esp_err_t WhoS3Cam::set_flip(bool vertical_flip, bool horizontal_flip)
     return ESP_OK;
 }
 
-int WhoS3Cam::get_cam_fb_index()
-{
-    static int i = 0;
-    int index = i;
-    i = (i + 1) % m_fb_count;
-    return index;
-}
-
 } // namespace cam
 } // namespace who
@@ -1,5 +1,6 @@
 #pragma once
 #include "who_cam_base.hpp"
+#include <atomic>
 #include <deque>
 
 namespace who {
@@ -16,11 +17,12 @@ public:
     cam_fb_t *cam_fb_get() override;
     void cam_fb_return(cam_fb_t *fb) override;
     cam_fb_fmt_t get_fb_format() override { return pix_fmt2cam_fb_fmt(m_format); }
+    uint32_t get_drop_cnt() override { return m_drop_cnt.load(std::memory_order_relaxed); }
 
 private:
     esp_err_t set_flip(bool vertical_flip, bool horizontal_flip);
-    int get_cam_fb_index();
     pixformat_t m_format;
+    std::atomic<uint32_t> m_drop_cnt;
 };
 
 } // namespace cam
@@ -0,0 +1,273 @@
+#include "who_synth_cam.hpp"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+static const char *TAG = "WhoSynthCam";
+
+namespace who {
+namespace cam {
+// The bar code is two rows of 16 cells on the top 1/8 of the frame, the target square moves below it.
+static constexpr int N_BAR_CELLS = 16;
+static constexpr int N_BAR_ROWS = 2;
+
+static uint8_t get_check(uint32_t frame_id)
+{
+    return (frame_id ^ (frame_id >> 8) ^ (frame_id >> 16) ^ 0x5a) & 0xff;
+}
+
+// Triangle wave in [0, 1] with period 2 / speed frames.
+static float get_tri(uint32_t frame_id, float speed)
+{
+    float phase = fmodf(frame_id * speed, 2.f);
+    return phase < 1 ? phase : 2 - phase;
+}
+
+WhoSynthCam::WhoSynthCam(cam_fb_fmt_t format,
+                         uint16_t width,
+                         uint16_t height,
+                         const std::vector<segment_t> &script,
+                         uint8_t fb_count,
+                         uint8_t max_pending,
+                         bool rgb565_big_endian,
+                         uint32_t seed) :
+    WhoCam(fb_count, width, height),
+    m_format(format),
+    m_rgb565_big_endian(rgb565_big_endian),
+    m_max_pending(std::max<uint8_t>(max_pending, 1)),
+    m_rand(seed),
+    m_next({0, -1, 0}),
+    m_seg_idx(0),
+    m_seg_frame(0),
+    m_drop_cnt(0),
+    m_frame_cnt(0),
+    m_fetch_seg_idx(0)
+{
+    // schedule_next_arrival() divides by the fps, and loops over the frames of a segment.
+    for (const auto &seg : script) {
+        if (seg.n_frames > 0 && seg.fps > 0) {
+            m_script.emplace_back(seg);
+        } else {
+            ESP_LOGE(TAG, "Segment %s needs n_frames > 0 and fps > 0, skip it.", seg.name ? seg.name : "");
+        }
+    }
+    assert(width >= N_BAR_CELLS && height >= N_BAR_ROWS * 8);
+    switch (format) {
+    case cam_fb_fmt_t::CAM_FB_FMT_RGB565:
+        m_bpp = 2;
+        break;
+    case cam_fb_fmt_t::CAM_FB_FMT_RGB888:
+        m_bpp = 3;
+        break;
+    case cam_fb_fmt_t::CAM_FB_FMT_GRAY:
+        m_bpp = 1;
+        break;
+    default:
+        ESP_LOGE(TAG, "Unsupported format, fallback to RGB888.");
+        m_format = cam_fb_fmt_t::CAM_FB_FMT_RGB888;
+        m_bpp = 3;
+        break;
+    }
+    size_t size = width * height * m_bpp;
+    for (int i = 0; i < fb_count; i++) {
+        m_bufs.emplace_back((uint8_t *)heap_caps_calloc(1, size, MALLOC_CAP_DEFAULT));
+        if (!m_bufs.back()) {
+            ESP_LOGE(TAG, "Failed to allocate fb buffer of %zu bytes.", size);
+        }
+    }
+    // A gradient, so that resize and colour conversion bugs are visible.
+    m_background.resize(size);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            pack_pix(x * 255 / width, y * 255 / height, 128, m_background.data() + (y * width + x) * m_bpp);
+        }
+    }
+}
+
+WhoSynthCam::~WhoSynthCam()
+{
+    for (auto buf : m_bufs) {
+        heap_caps_free(buf);
+    }
+}
+
+bool WhoSynthCam::is_valid()
+{
+    return !m_script.empty() && std::find(m_bufs.begin(), m_bufs.end(), nullptr) == m_bufs.end();
+}
+
+cam_fb_t *WhoSynthCam::cam_fb_get()
+{
+    if (m_script.empty()) {
+        return nullptr;
+    }
+    int64_t now_us = esp_timer_get_time();
+    if (m_next.arrival_us < 0) {
+        m_next.arrival_us = now_us;
+    }
+    while (true) {
+        while (m_next.arrival_us <= now_us) {
+            m_pending.emplace_back(m_next);
+            schedule_next_arrival();
+            if (m_pending.size() > m_max_pending) {
+                m_pending.pop_front();
+                m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (!m_pending.empty()) {
+            break;
+        }
+        usleep(m_next.arrival_us - now_us);
+        now_us = esp_timer_get_time();
+    }
+    arrival_t arrival = m_pending.front();
+    m_pending.pop_front();
+
+    int i = get_cam_fb_index();
+    if (i < 0) {
+        m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    draw_frame(m_bufs[i], arrival.frame_id);
+    cam_fb_t &fb = m_cam_fbs[i];
+    fb = cam_fb_t();
+    fb.buf = m_bufs[i];
+    fb.len = m_fb_width * m_fb_height * m_bpp;
+    fb.width = m_fb_width;
+    fb.height = m_fb_height;
+    fb.format = m_format;
+    // Captured when it arrived, the age of the fb covers the time it waited to be fetched.
+    fb.timestamp.tv_sec = arrival.arrival_us / 1000000;
+    fb.timestamp.tv_usec = arrival.arrival_us % 1000000;
+    fb.ret = m_bufs[i];
+    m_frame_cnt.fetch_add(1, std::memory_order_relaxed);
+    m_fetch_seg_idx.store(arrival.seg_idx, std::memory_order_relaxed);
+    return &fb;
+}
+
+void WhoSynthCam::cam_fb_return(cam_fb_t *fb)
+{
+    release_cam_fb(fb);
+}
+
+void WhoSynthCam::schedule_next_arrival()
+{
+    const segment_t &seg = m_script[m_seg_idx];
+    int64_t period_us = (int64_t)(1000000 / seg.fps);
+    uint16_t burst_len = std::max<uint16_t>(seg.burst_len, 1);
+    int64_t interval_us = 0;
+    if ((m_seg_frame + 1) % burst_len == 0) {
+        interval_us = period_us * burst_len;
+        interval_us += (int64_t)(m_rand.next_signed() * seg.jitter * period_us);
+    }
+    if (seg.stall_every && (m_seg_frame + 1) % seg.stall_every == 0) {
+        interval_us += seg.stall_us;
+    }
+    if (++m_seg_frame >= seg.n_frames) {
+        m_seg_frame = 0;
+        m_seg_idx = (m_seg_idx + 1) % m_script.size();
+    }
+    m_next = {m_next.frame_id + 1, m_next.arrival_us + std::max<int64_t>(interval_us, 0), m_seg_idx};
+}
+
+void WhoSynthCam::draw_frame(uint8_t *buf, uint32_t frame_id)
+{
+    if (!buf) {
+        return;
+    }
+    memcpy(buf, m_background.data(), m_background.size());
+    uint8_t black[3], white[3], target[3];
+    pack_pix(0, 0, 0, black);
+    pack_pix(255, 255, 255, white);
+    pack_pix(255, 255, 0, target);
+    uint32_t code = (frame_id & ((1 << ID_BITS) - 1)) | (get_check(frame_id) << ID_BITS);
+    for (int i = 0; i < N_BAR_ROWS * N_BAR_CELLS; i++) {
+        int row = i / N_BAR_CELLS;
+        int col = i % N_BAR_CELLS;
+        fill_rect(buf,
+                  col * m_fb_width / N_BAR_CELLS,
+                  row * m_fb_height / (N_BAR_ROWS * 8),
+                  (col + 1) * m_fb_width / N_BAR_CELLS,
+                  (row + 1) * m_fb_height / (N_BAR_ROWS * 8),
+                  (code >> i) & 1 ? white : black);
+    }
+    auto box = get_target_box(frame_id, m_fb_width, m_fb_height);
+    fill_rect(buf, box[0], box[1], box[2], box[3], target);
+}
+
+void WhoSynthCam::fill_rect(uint8_t *buf, int x0, int y0, int x1, int y1, const uint8_t *pix)
+{
+    for (int y = y0; y < y1; y++) {
+        uint8_t *p = buf + (y * m_fb_width + x0) * m_bpp;
+        for (int x = x0; x < x1; x++, p += m_bpp) {
+            memcpy(p, pix, m_bpp);
+        }
+    }
+}
+
+void WhoSynthCam::pack_pix(uint8_t r, uint8_t g, uint8_t b, uint8_t *pix)
+{
+    switch (m_format) {
+    case cam_fb_fmt_t::CAM_FB_FMT_RGB565: {
+        uint16_t val = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+        pix[0] = m_rgb565_big_endian ? val >> 8 : val & 0xff;
+        pix[1] = m_rgb565_big_endian ? val & 0xff : val >> 8;
+        break;
+    }
+    case cam_fb_fmt_t::CAM_FB_FMT_GRAY:
+        pix[0] = (r * 77 + g * 150 + b * 29) >> 8;
+        break;
+    default:
+        pix[0] = r;
+        pix[1] = g;
+        pix[2] = b;
+        break;
+    }
+}
+
+bool WhoSynthCam::decode_frame_id(const dl::image::img_t &img, uint32_t &frame_id)
+{
+    uint32_t code = 0;
+    for (int i = 0; i < N_BAR_ROWS * N_BAR_CELLS; i++) {
+        int x = (2 * (i % N_BAR_CELLS) + 1) * img.width / (2 * N_BAR_CELLS);
+        int y = (2 * (i / N_BAR_CELLS) + 1) * img.height / (2 * N_BAR_ROWS * 8);
+        const uint8_t *p = (const uint8_t *)img.data;
+        bool bit;
+        // Black and white are the same in both RGB565 byte orders.
+        switch (img.pix_type) {
+        case dl::image::DL_IMAGE_PIX_TYPE_RGB565:
+            p += (y * img.width + x) * 2;
+            bit = p[0] + p[1] > 255;
+            break;
+        case dl::image::DL_IMAGE_PIX_TYPE_RGB888:
+            p += (y * img.width + x) * 3;
+            bit = p[0] + p[1] + p[2] > 382;
+            break;
+        case dl::image::DL_IMAGE_PIX_TYPE_GRAY:
+            bit = p[y * img.width + x] > 127;
+            break;
+        default:
+            return false;
+        }
+        code |= (uint32_t)bit << i;
+    }
+    frame_id = code & ((1 << ID_BITS) - 1);
+    return (code >> ID_BITS) == get_check(frame_id);
+}
+
+std::vector<int> WhoSynthCam::get_target_box(uint32_t frame_id, uint16_t width, uint16_t height)
+{
+    // Every coordinate is a fraction of the frame size, so the box of a resized frame is the resized box.
+    float w = width / 4.f;
+    float h = height / 4.f;
+    float top = height / 8.f;
+    int x_min = (int)(get_tri(frame_id, 1 / 50.f) * (width - w));
+    int y_min = (int)(top + get_tri(frame_id, 1 / 37.f) * (height - top - h));
+    return {x_min, y_min, x_min + (int)w, y_min + (int)h};
+}
+} // namespace cam
+} // namespace who
@@ -0,0 +1,112 @@
+#pragma once
+#include "who_cam_base.hpp"
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace who {
+namespace cam {
+// xorshift32, the same seed gives the same sequence, so a stress run can be replayed.
+class WhoXorShift32 {
+public:
+    WhoXorShift32(uint32_t seed) : m_state(seed ? seed : 1) {}
+    uint32_t next()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+    // Uniform in [-1, 1).
+    float next_signed() { return (float)(next() >> 8) / (1 << 23) - 1; }
+
+private:
+    uint32_t m_state;
+};
+
+// Generates test frames on a scripted arrival time model, to stress the frame cap and detect tasks with the timing a
+// sensor produces at its worst: bursts, jitter, stalls and sudden fps changes. Every frame carries its frame id in a
+// bar code on the top rows and a square whose position is a function of the id, so the frame can be identified and
+// checked after any resize, see decode_frame_id() and get_target_box().
+class WhoSynthCam : public WhoCam {
+public:
+    typedef struct {
+        const char *name;
+        uint32_t n_frames;
+        float fps;
+        // Arrival intervals vary uniformly within +-jitter of the period.
+        float jitter;
+        // Frames arrive back to back in bursts of burst_len, the bursts are burst_len periods apart.
+        uint16_t burst_len;
+        // After every stall_every frames the next frame arrives stall_us late, 0 for no stall.
+        uint32_t stall_every;
+        int32_t stall_us;
+    } segment_t;
+
+    // The segments of script are played in a loop, a segment without frames or with fps <= 0 is left out. Frames
+    // that arrived but are not fetched yet are kept up to max_pending, the older ones are dropped like a sensor
+    // overwriting its buffers. Frames are RGB565, RGB888 or GRAY, RGB565 in big endian if rgb565_big_endian.
+    WhoSynthCam(cam_fb_fmt_t format,
+                uint16_t width,
+                uint16_t height,
+                const std::vector<segment_t> &script,
+                uint8_t fb_count = 3,
+                uint8_t max_pending = 1,
+#if CONFIG_IDF_TARGET_ESP32P4
+                bool rgb565_big_endian = false,
+#else
+                bool rgb565_big_endian = true,
+#endif
+                uint32_t seed = 1);
+    ~WhoSynthCam();
+    cam_fb_t *cam_fb_get() override;
+    void cam_fb_return(cam_fb_t *fb) override;
+    cam_fb_fmt_t get_fb_format() override { return m_format; }
+    uint32_t get_drop_cnt() override { return m_drop_cnt.load(std::memory_order_relaxed); }
+    // False if no segment of the script is left, or a fb buffer failed to allocate.
+    bool is_valid() override;
+    // Segment of the last fetched frame.
+    int get_segment_idx() { return m_fetch_seg_idx.load(std::memory_order_relaxed); }
+    const segment_t &get_segment(int idx) { return m_script[idx]; }
+    uint32_t get_frame_cnt() { return m_frame_cnt.load(std::memory_order_relaxed); }
+
+    // Frame id of a frame from the cam, possibly resized or colour converted. Returns false if the bar code is
+    // corrupted, e.g. by tearing.
+    static bool decode_frame_id(const dl::image::img_t &img, uint32_t &frame_id);
+    // {x_min, y_min, x_max, y_max} of the square in a width x height frame with the id.
+    static std::vector<int> get_target_box(uint32_t frame_id, uint16_t width, uint16_t height);
+
+private:
+    static inline constexpr int ID_BITS = 24;
+    static inline constexpr int CHECK_BITS = 8;
+
+    typedef struct {
+        uint32_t frame_id;
+        int64_t arrival_us;
+        int seg_idx;
+    } arrival_t;
+
+    void schedule_next_arrival();
+    void draw_frame(uint8_t *buf, uint32_t frame_id);
+    void fill_rect(uint8_t *buf, int x0, int y0, int x1, int y1, const uint8_t *pix);
+    void pack_pix(uint8_t r, uint8_t g, uint8_t b, uint8_t *pix);
+
+    cam_fb_fmt_t m_format;
+    int m_bpp;
+    bool m_rgb565_big_endian;
+    std::vector<segment_t> m_script;
+    uint8_t m_max_pending;
+    WhoXorShift32 m_rand;
+    std::vector<uint8_t *> m_bufs;
+    std::vector<uint8_t> m_background;
+    std::deque<arrival_t> m_pending;
+    // The next frame to arrive.
+    arrival_t m_next;
+    int m_seg_idx;
+    uint32_t m_seg_frame;
+    std::atomic<uint32_t> m_drop_cnt;
+    std::atomic<uint32_t> m_frame_cnt;
+    std::atomic<int> m_fetch_seg_idx;
+};
+} // namespace cam
+} // namespace who
@@ -6,7 +6,7 @@ namespace who {
 namespace cam {
 WhoUVCCam::WhoUVCCam(
     const uvc_host_stream_format fmt, uint16_t h_res, uint16_t v_res, float fps, const uint8_t fb_count) :
-    WhoCam(fb_count, h_res, v_res), m_frame(xQueueCreate(1, sizeof(uvc_host_frame_t *))), m_format(fmt)
+    WhoCam(fb_count, h_res, v_res), m_frame(xQueueCreate(1, sizeof(frame_t))), m_format(fmt), m_drop_cnt(0)
 {
     assert(fmt == UVC_VS_FORMAT_MJPEG || fmt == UVC_VS_FORMAT_YUY2);
     size_t frame_size = (fmt == UVC_VS_FORMAT_MJPEG) ? (size_t)(h_res * v_res * 3 / 5.f) : (size_t)(h_res * v_res * 2);
@@ -49,24 +49,22 @@ WhoUVCCam::WhoUVCCam(
 
 cam_fb_t *WhoUVCCam::cam_fb_get()
 {
-    uvc_host_frame_t *frame;
+    frame_t frame;
     xQueueReceive(m_frame, &frame, portMAX_DELAY);
     int i = get_cam_fb_index();
-    m_cam_fbs[i] = cam_fb_t(*frame, esp_timer_get_time());
+    if (i < 0) {
+        uvc_host_frame_return(m_stream, frame.frame);
+        m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    m_cam_fbs[i] = cam_fb_t(*frame.frame, frame.timestamp_us);
     return &m_cam_fbs[i];
 }
 
 void WhoUVCCam::cam_fb_return(cam_fb_t *fb)
 {
     uvc_host_frame_return(m_stream, (uvc_host_frame_t *)fb->ret);
-}
-
-int WhoUVCCam::get_cam_fb_index()
-{
-    static int i = 0;
-    int index = i;
-    i = (i + 1) % m_fb_count;
-    return index;
+    release_cam_fb(fb);
 }
 
 void WhoUVCCam::stream_cb(const uvc_host_stream_event_data_t *event, void *user_ctx)
@@ -105,11 +103,13 @@ bool WhoUVCCam::frame_cb(const uvc_host_frame_t *frame, void *user_ctx)
 
 bool WhoUVCCam::frame_cb(const uvc_host_frame_t *frame)
 {
-    if (xQueueSend(m_frame, &frame, 0) != pdTRUE) {
-        uvc_host_frame_t *prev_frame;
+    frame_t new_frame = {(uvc_host_frame_t *)frame, esp_timer_get_time()};
+    // Replace the frame not fetched yet. If the fetch task takes it in the meantime the queue has room again.
+    while (xQueueSend(m_frame, &new_frame, 0) != pdTRUE) {
+        frame_t prev_frame;
         if (xQueueReceive(m_frame, &prev_frame, 0) == pdTRUE) {
-            uvc_host_frame_return(m_stream, prev_frame);
-            xQueueSend(m_frame, &frame, portMAX_DELAY);
+            uvc_host_frame_return(m_stream, prev_frame.frame);
+            m_drop_cnt.fetch_add(1, std::memory_order_relaxed);
         }
     }
     return false;
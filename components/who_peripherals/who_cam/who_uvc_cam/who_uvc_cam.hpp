@@ -2,6 +2,7 @@
 #include "who_cam_base.hpp"
 #include "who_task.hpp"
 #include "who_uvc.hpp"
+#include <atomic>
 #include <deque>
 #include <queue>
 
@@ -13,9 +14,15 @@ public:
     cam_fb_t *cam_fb_get() override;
     void cam_fb_return(cam_fb_t *fb) override;
     cam_fb_fmt_t get_fb_format() override { return uvc_fmt2cam_fb_fmt(m_format); }
+    uint32_t get_drop_cnt() override { return m_drop_cnt.load(std::memory_order_relaxed); }
 
 private:
-    int get_cam_fb_index();
+    // The frame is stamped when it arrives, not when it is dequeued, so that its age covers the wait in the queue.
+    typedef struct {
+        uvc_host_frame_t *frame;
+        int64_t timestamp_us;
+    } frame_t;
+
     static void stream_cb(const uvc_host_stream_event_data_t *event, void *user_ctx);
     void stream_cb(const uvc_host_stream_event_data_t *event);
     static bool frame_cb(const uvc_host_frame_t *frame, void *user_ctx);
@@ -25,6 +32,7 @@ private:
     uvc_host_stream_hdl_t m_stream;
     QueueHandle_t m_frame;
     uvc_host_stream_format m_format;
+    std::atomic<uint32_t> m_drop_cnt;
 };
 } // namespace cam
 } // namespace who
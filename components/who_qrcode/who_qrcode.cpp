@@ -1,6 +1,8 @@
 #include "who_qrcode.hpp"
 #include "quirc.h"
-#include "who_qrcode.hpp"
+#include <cstring>
+
+static const char *TAG = "WhoQRCode";
 
 namespace who {
 namespace qrcode {
@@ -15,7 +17,9 @@ WhoQRCode::WhoQRCode(const std::string &name, frame_cap::WhoFrameCapNode *frame_
     uint16_t w = BSP_LCD_H_RES / 2, h = BSP_LCD_V_RES / 2;
     uint32_t caps = 0;
 #endif
-    quirc_resize(m_qr, w, h);
+    if (quirc_resize(m_qr, w, h) < 0) {
+        ESP_LOGE(TAG, "Failed to allocate the quirc image of %dx%d.", w, h);
+    }
     m_image_transformer.set_caps(caps);
 }
 
@@ -41,12 +45,15 @@ void WhoQRCode::task()
                 continue;
             }
         }
-        auto fb = m_frame_cap_node->cam_fb_peek();
-        int w, h;
-        uint8_t *data = quirc_begin(m_qr, &w, &h);
-        dl::image::img_t dst_img = {
-            .data = data, .width = (uint16_t)w, .height = (uint16_t)h, .pix_type = dl::image::DL_IMAGE_PIX_TYPE_GRAY};
-        m_image_transformer.set_src_img(*fb).set_dst_img(dst_img).transform();
+        auto fb = m_frame_cap_node->cam_fb_acquire();
+        if (!fb) {
+            continue;
+        }
+        bool filled = fill_quirc_image(*fb);
+        fb.reset();
+        if (!filled) {
+            continue;
+        }
         quirc_end(m_qr);
         int num_codes = quirc_count(m_qr);
         for (int i = 0; i < num_codes; i++) {
@@ -70,6 +77,43 @@ void WhoQRCode::task()
     vTaskDelete(NULL);
 }
 
+bool WhoQRCode::fill_quirc_image(const who::cam::cam_fb_t &fb)
+{
+    int w, h;
+    uint8_t *data = quirc_begin(m_qr, &w, &h);
+    if (fb.format == cam::cam_fb_fmt_t::CAM_FB_FMT_GRAY || fb.format == cam::cam_fb_fmt_t::CAM_FB_FMT_YUV422) {
+        // A gray frame from WhoGrayNode, or the luma of a yuv cam. quirc only decodes from the image it owns, so the
+        // frame is copied as it is instead of being converted. Follow the frame size, the buffer is reallocated only
+        // when it changes.
+        if (w != fb.width || h != fb.height) {
+            // quirc keeps the old image if it fails, skip the frame then.
+            if (quirc_resize(m_qr, fb.width, fb.height) < 0) {
+                ESP_LOGE(TAG, "Failed to allocate the quirc image of %dx%d.", fb.width, fb.height);
+                return false;
+            }
+            data = quirc_begin(m_qr, &w, &h);
+        }
+        if (fb.format == cam::cam_fb_fmt_t::CAM_FB_FMT_GRAY) {
+            memcpy(data, fb.buf, w * h);
+        } else {
+            // YUYV, the luma is every other byte.
+            const uint8_t *src = (const uint8_t *)fb.buf;
+            for (int i = 0; i < w * h; i++) {
+                data[i] = src[i * 2];
+            }
+        }
+        return true;
+    }
+    // The quirc image failed to allocate in the constructor.
+    if (!w || !h) {
+        return false;
+    }
+    dl::image::img_t dst_img = {
+        .data = data, .width = (uint16_t)w, .height = (uint16_t)h, .pix_type = dl::image::DL_IMAGE_PIX_TYPE_GRAY};
+    m_image_transformer.set_src_img(fb).set_dst_img(dst_img).transform();
+    return true;
+}
+
 void WhoQRCode::set_qrcode_result_cb(const std::function<void(const std::string &)> &result_cb)
 {
     m_result_cb = result_cb;
@@ -16,6 +16,8 @@ public:
 private:
     void task() override;
     void cleanup() override;
+    // Returns false if the quirc image can not be resized to the frame.
+    bool fill_quirc_image(const who::cam::cam_fb_t &fb);
 
     frame_cap::WhoFrameCapNode *m_frame_cap_node;
     struct quirc *m_qr;
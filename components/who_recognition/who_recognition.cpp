@@ -62,7 +62,8 @@ void WhoRecognitionCore::task()
         }
         if (event_bits & RECOGNIZE) {
             auto new_detect_result_cb = [this](const detect::WhoDetect::result_t &result) {
-                auto ret = m_recognizer->recognize(result.img, result.det_res);
+                result.det_res.to_list(m_det_res);
+                auto ret = m_recognizer->recognize(result.img, m_det_res);
                 if (m_detect_result_cb) {
                     m_detect_result_cb(result);
                 }
@@ -80,7 +81,8 @@ void WhoRecognitionCore::task()
         }
         if (event_bits & ENROLL) {
             auto new_detect_result_cb = [this](const detect::WhoDetect::result_t &result) {
-                esp_err_t ret = m_recognizer->enroll(result.img, result.det_res);
+                result.det_res.to_list(m_det_res);
+                esp_err_t ret = m_recognizer->enroll(result.img, m_det_res);
                 if (m_detect_result_cb) {
                     m_detect_result_cb(result);
                 }
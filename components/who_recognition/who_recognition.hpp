@@ -26,6 +26,8 @@ private:
     std::function<void(const detect::WhoDetect::result_t &)> m_detect_result_cb;
     std::function<void(const std::string &)> m_recognition_result_cb;
     std::function<void()> m_cleanup;
+    // The results to recognize or enroll, in the list the recognizer takes.
+    std::list<dl::detect::result_t> m_det_res;
 };
 
 class WhoRecognition : public task::WhoTaskGroup {
@@ -12,8 +12,14 @@ bool WhoTaskBase::run(const configSTACK_DEPTH_TYPE uxStackDepth, UBaseType_t uxP
     xSemaphoreTake(m_mutex, portMAX_DELAY);
     EventBits_t event_bits = xEventGroupGetBits(m_event_group);
     if (event_bits & TASK_STOPPED) {
-        if (xTaskCreatePinnedToCore(task, m_name.c_str(), uxStackDepth, this, uxPriority, &m_task_handle, xCoreID) ==
-            pdPASS) {
+#if CONFIG_IDF_TARGET_LINUX
+        // The host port runs the tasks on a single core, the cores the pipeline is spread over only exist on a chip.
+        BaseType_t ret = xTaskCreate(task, m_name.c_str(), uxStackDepth, this, uxPriority, &m_task_handle);
+#else
+        BaseType_t ret =
+            xTaskCreatePinnedToCore(task, m_name.c_str(), uxStackDepth, this, uxPriority, &m_task_handle, xCoreID);
+#endif
+        if (ret == pdPASS) {
             xEventGroupClearBits(m_event_group, TASK_STOPPED);
             xSemaphoreGive(m_mutex);
             return true;
@@ -1,5 +1,8 @@
 #include "who_yield2idle.hpp"
+#include "sdkconfig.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_freertos_hooks.h"
+#endif
 #include <algorithm>
 #include <cstring>
 #include <esp_log.h>
@@ -84,7 +87,12 @@ WhoYield2Idle *WhoYield2Idle::get_instance()
 
 bool WhoYield2Idle::run(const configSTACK_DEPTH_TYPE uxStackDepth)
 {
+#if CONFIG_IDF_TARGET_LINUX
+    // No task watchdog on the host, nothing to yield for.
+    return true;
+#else
     return task::WhoTaskBase::run(uxStackDepth, configMAX_PRIORITIES - 1, tskNO_AFFINITY);
+#endif
 }
 
 void WhoYield2Idle::start_monitor(task::WhoTask *task)
@@ -117,6 +125,7 @@ bool WhoYield2Idle::pause_async()
 
 void WhoYield2Idle::task()
 {
+#if !CONFIG_IDF_TARGET_LINUX
     const TickType_t interval = pdMS_TO_TICKS((CONFIG_ESP_TASK_WDT_TIMEOUT_S - CONFIG_MAX_TASK_LOOP_TIME) * 1000 / 2);
     if (interval < pdMS_TO_TICKS(1500)) {
         ESP_LOGW(TAG, "Try to increase CONFIG_ESP_TASK_WDT_TIMEOUT_S");
@@ -162,6 +171,7 @@ void WhoYield2Idle::task()
     }
     esp_deregister_freertos_idle_hook_for_cpu(idle0_cb, 0);
     esp_deregister_freertos_idle_hook_for_cpu(idle1_cb, 1);
+#endif
     xEventGroupSetBits(m_event_group, TASK_STOPPED);
     vTaskDelete(NULL);
 }
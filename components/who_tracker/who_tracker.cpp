@@ -0,0 +1,253 @@
+#include "who_tracker.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace who {
+namespace tracker {
+// Noise relative to the box height, so that the filter behaves the same for near and far objects.
+static constexpr float MEAS_STD = 0.05f;
+// Change of velocity per second.
+static constexpr float ACC_STD = 1.f;
+// Velocity of a new track.
+static constexpr float INIT_VEL_STD = 1.f;
+static constexpr int MAX_DETS = detect::detect_results_t::MAX_RESULTS;
+
+static int64_t to_us(const struct timeval &timestamp)
+{
+    return (int64_t)timestamp.tv_sec * 1000000 + timestamp.tv_usec;
+}
+
+static void center_to_box(const float center[4], float box[4])
+{
+    float w = std::max(center[2], 1.f);
+    float h = std::max(center[3], 1.f);
+    box[0] = center[0] - w / 2;
+    box[1] = center[1] - h / 2;
+    box[2] = center[0] + w / 2;
+    box[3] = center[1] + h / 2;
+}
+
+static float iou(const float a[4], const int16_t b[4])
+{
+    float w = std::min(a[2], (float)b[2]) - std::max(a[0], (float)b[0]);
+    float h = std::min(a[3], (float)b[3]) - std::max(a[1], (float)b[1]);
+    if (w <= 0 || h <= 0) {
+        return 0;
+    }
+    float inter = w * h;
+    float area_a = (a[2] - a[0]) * (a[3] - a[1]);
+    float area_b = (float)(b[2] - b[0]) * (b[3] - b[1]);
+    return inter / (area_a + area_b - inter);
+}
+
+void WhoTracker::kalman_t::init(float z, float pos_var, float vel_var)
+{
+    x = z;
+    v = 0;
+    p[0][0] = pos_var;
+    p[0][1] = p[1][0] = 0;
+    p[1][1] = vel_var;
+}
+
+void WhoTracker::kalman_t::predict(float dt, float acc_var)
+{
+    x += v * dt;
+    // P = F * P * F' + Q, F = [1, dt; 0, 1], Q of a white noise acceleration.
+    float p00 = p[0][0] + dt * (p[0][1] + p[1][0]) + dt * dt * p[1][1];
+    float p01 = p[0][1] + dt * p[1][1];
+    float p10 = p[1][0] + dt * p[1][1];
+    float dt2 = dt * dt;
+    p[0][0] = p00 + acc_var * dt2 * dt2 / 4;
+    p[0][1] = p01 + acc_var * dt2 * dt / 2;
+    p[1][0] = p10 + acc_var * dt2 * dt / 2;
+    p[1][1] += acc_var * dt2;
+}
+
+void WhoTracker::kalman_t::correct(float z, float meas_var)
+{
+    // Only the position is measured, H = [1, 0].
+    float s = p[0][0] + meas_var;
+    float k0 = p[0][0] / s;
+    float k1 = p[1][0] / s;
+    float y = z - x;
+    x += k0 * y;
+    v += k1 * y;
+    float p00 = p[0][0], p01 = p[0][1];
+    p[0][0] -= k0 * p00;
+    p[0][1] -= k0 * p01;
+    p[1][0] -= k1 * p00;
+    p[1][1] -= k1 * p01;
+}
+
+WhoTracker::WhoTracker(float iou_thr, int min_hits, int max_age_ms) :
+    m_iou_thr(iou_thr),
+    m_min_hits(std::max(min_hits, 1)),
+    m_max_age_us((int64_t)max_age_ms * 1000),
+    m_next_id(1),
+    m_tracks(),
+    m_mutex(xSemaphoreCreateMutex())
+{
+}
+
+WhoTracker::~WhoTracker()
+{
+    vSemaphoreDelete(m_mutex);
+}
+
+void WhoTracker::create_track(const detect::detect_results_t &det_res, int idx, int64_t now_us)
+{
+    auto it = std::find_if(m_tracks.begin(), m_tracks.end(), [](const state_t &s) { return !s.used; });
+    if (it == m_tracks.end()) {
+        return;
+    }
+    const int16_t *box = det_res.box[idx];
+    float h = std::max(box[3] - box[1], 1);
+    float pos_var = (MEAS_STD * h) * (MEAS_STD * h);
+    float vel_var = (INIT_VEL_STD * h) * (INIT_VEL_STD * h);
+    it->used = true;
+    it->id = m_next_id++;
+    // 0 is never an id.
+    if (!m_next_id) {
+        m_next_id = 1;
+    }
+    it->category = det_res.category[idx];
+    it->score = det_res.score[idx];
+    it->n_hits = 1;
+    it->update_us = now_us;
+    it->filter_us = now_us;
+    it->kf[0].init((box[0] + box[2]) / 2.f, pos_var, vel_var);
+    it->kf[1].init((box[1] + box[3]) / 2.f, pos_var, vel_var);
+    it->kf[2].init(box[2] - box[0], pos_var, vel_var);
+    it->kf[3].init(box[3] - box[1], pos_var, vel_var);
+}
+
+void WhoTracker::track_box(const state_t &s, float dt, float box[4])
+{
+    float center[4];
+    for (int i = 0; i < 4; i++) {
+        center[i] = s.kf[i].x + s.kf[i].v * dt;
+    }
+    center_to_box(center, box);
+}
+
+void WhoTracker::update(const detect::detect_results_t &det_res, const struct timeval &timestamp)
+{
+    int64_t now_us = to_us(timestamp);
+    int n_dets = det_res.n;
+
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    // Predict every track to the detected frame.
+    float boxes[MAX_TRACKS][4];
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        auto &s = m_tracks[i];
+        if (!s.used) {
+            continue;
+        }
+        float dt = std::max(now_us - s.filter_us, (int64_t)0) / 1e6f;
+        float h = std::max(s.kf[3].x, 1.f);
+        float acc_var = (ACC_STD * h) * (ACC_STD * h);
+        for (auto &kf : s.kf) {
+            kf.predict(dt, acc_var);
+        }
+        s.filter_us = std::max(now_us, s.filter_us);
+        track_box(s, 0, boxes[i]);
+    }
+
+    // Greedy matching in descending iou, close to the optimal assignment when objects hardly overlap.
+    float ious[MAX_TRACKS][MAX_DETS];
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        for (int j = 0; j < n_dets; j++) {
+            const auto &s = m_tracks[i];
+            ious[i][j] = s.used && s.category == det_res.category[j] ? iou(boxes[i], det_res.box[j]) : 0;
+        }
+    }
+    bool track_matched[MAX_TRACKS] = {};
+    bool det_matched[MAX_DETS] = {};
+    while (true) {
+        int best_i = -1, best_j = -1;
+        float best_iou = m_iou_thr;
+        for (int i = 0; i < MAX_TRACKS; i++) {
+            if (track_matched[i]) {
+                continue;
+            }
+            for (int j = 0; j < n_dets; j++) {
+                if (!det_matched[j] && ious[i][j] >= best_iou) {
+                    best_iou = ious[i][j];
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        if (best_i < 0) {
+            break;
+        }
+        track_matched[best_i] = true;
+        det_matched[best_j] = true;
+        auto &s = m_tracks[best_i];
+        const int16_t *box = det_res.box[best_j];
+        float h = std::max(box[3] - box[1], 1);
+        float meas_var = (MEAS_STD * h) * (MEAS_STD * h);
+        s.kf[0].correct((box[0] + box[2]) / 2.f, meas_var);
+        s.kf[1].correct((box[1] + box[3]) / 2.f, meas_var);
+        s.kf[2].correct(box[2] - box[0], meas_var);
+        s.kf[3].correct(box[3] - box[1], meas_var);
+        s.score = det_res.score[best_j];
+        s.n_hits++;
+        s.update_us = now_us;
+    }
+
+    // A tentative track is dropped on its first miss, a reported one after max age.
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        auto &s = m_tracks[i];
+        if (s.used && !track_matched[i] && (s.n_hits < m_min_hits || now_us - s.update_us > m_max_age_us)) {
+            s.used = false;
+        }
+    }
+    for (int j = 0; j < n_dets; j++) {
+        if (!det_matched[j]) {
+            create_track(det_res, j, now_us);
+        }
+    }
+    xSemaphoreGive(m_mutex);
+}
+
+int WhoTracker::predict(const struct timeval &timestamp, track_t *tracks, int max_tracks)
+{
+    int64_t now_us = to_us(timestamp);
+    int n = 0;
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    for (const auto &s : m_tracks) {
+        if (n == max_tracks) {
+            break;
+        }
+        int64_t age_us = now_us - s.update_us;
+        if (!s.used || s.n_hits < m_min_hits || age_us > m_max_age_us) {
+            continue;
+        }
+        // A frame older than the filter, e.g. displayed late, is extrapolated backwards.
+        float box[4];
+        track_box(s, (now_us - s.filter_us) / 1e6f, box);
+        auto &t = tracks[n++];
+        t.id = s.id;
+        t.category = s.category;
+        t.score = s.score;
+        for (int i = 0; i < 4; i++) {
+            t.box[i] = (int)std::lround(box[i]);
+        }
+        t.n_hits = s.n_hits;
+        t.age_us = std::max(age_us, (int64_t)0);
+    }
+    xSemaphoreGive(m_mutex);
+    return n;
+}
+
+void WhoTracker::reset()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    for (auto &s : m_tracks) {
+        s.used = false;
+    }
+    xSemaphoreGive(m_mutex);
+}
+} // namespace tracker
+} // namespace who
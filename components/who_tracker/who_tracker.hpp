@@ -0,0 +1,75 @@
+#pragma once
+#include "who_detect.hpp"
+#include <array>
+
+namespace who {
+namespace tracker {
+typedef struct {
+    // Stable over the life of the track, never 0.
+    uint32_t id;
+    int category;
+    // Of the last matched detection.
+    float score;
+    // x1, y1, x2, y2 predicted at the requested timestamp.
+    int box[4];
+    // Matched detections in total.
+    uint32_t n_hits;
+    // Microseconds since the last matched detection.
+    int64_t age_us;
+} track_t;
+
+// SORT-style tracker to interpolate the detections of a model running at a fraction of the camera fps. Every box
+// coordinate, as center x, center y, width and height, is a constant velocity kalman filter in time, detections are
+// matched to the tracks of the same category by greedy iou. Tracks live in a fixed capacity array, neither update()
+// nor predict() allocates.
+class WhoTracker {
+public:
+    static inline constexpr int MAX_TRACKS = 16;
+
+    // A track is reported after min_hits matched detections, and deleted max_age_ms after the last one.
+    WhoTracker(float iou_thr = 0.3f, int min_hits = 2, int max_age_ms = 500);
+    ~WhoTracker();
+    // Detections beyond the free capacity are not tracked. Timestamps are expected in order.
+    void update(const detect::detect_results_t &det_res, const struct timeval &timestamp);
+    void update(const detect::WhoDetect::result_t &result) { update(result.det_res, result.timestamp); }
+    // Reported tracks predicted at timestamp, e.g. of a camera frame. Returns the number of tracks written.
+    int predict(const struct timeval &timestamp, track_t *tracks, int max_tracks = MAX_TRACKS);
+    void reset();
+
+private:
+    // Position and velocity of a box coordinate, with their covariance.
+    struct kalman_t {
+        float x;
+        float v;
+        float p[2][2];
+        void init(float z, float pos_var, float vel_var);
+        void predict(float dt, float acc_var);
+        void correct(float z, float meas_var);
+    };
+
+    struct state_t {
+        bool used;
+        uint32_t id;
+        int category;
+        float score;
+        uint32_t n_hits;
+        // Of the last matched detection.
+        int64_t update_us;
+        // The time kf refers to, the last detected frame.
+        int64_t filter_us;
+        kalman_t kf[4];
+    };
+
+    void create_track(const detect::detect_results_t &det_res, int idx, int64_t now_us);
+    // Box of a track extrapolated by dt seconds from the time of its filter.
+    void track_box(const state_t &s, float dt, float box[4]);
+
+    float m_iou_thr;
+    uint32_t m_min_hits;
+    int64_t m_max_age_us;
+    uint32_t m_next_id;
+    std::array<state_t, MAX_TRACKS> m_tracks;
+    SemaphoreHandle_t m_mutex;
+};
+} // namespace tracker
+} // namespace who
@@ -7,17 +7,10 @@ using namespace who::frame_cap;
 // num of frames the model take to get result
 #define MODEL_TIME 3
 
-// The size of the fb_count and ringbuf_len must be big enough. If you have no idea how to set them, try with 5 and
-// larger.
+// Displayed ringbuf MODEL_TIME + 1 = 4 frames, so a displayed cam has fb_count MODEL_TIME + 3, see WhoFetchNode.
 #if CONFIG_IDF_TARGET_ESP32S3
 WhoFrameCap *get_dvp_frame_cap_pipeline()
 {
-    // The ringbuf_len of FetchNode equals cam_fb_count - 2. The WhoFetchNode fb will display on lcd, if you want to
-    // make sure the displayed detection result is synced with the frame, the ringbuf size must be big enough to
-    // cover the process time from now to the the detection result is ready. If the ring_buf_len is 3, the frame
-    // which the disp task will display is 2 frames before than the frame which feeds into detection task. So the
-    // detection task must finish within 2 frames, or the detect result will have a delay compared to the displayed
-    // frame.
     framesize_t frame_size = get_cam_frame_size_from_lcd_resolution();
 #ifdef BSP_BOARD_ESP32_S3_KORVO_2
     auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, MODEL_TIME + 3, true, true);
@@ -39,17 +32,13 @@ WhoFrameCap *get_mipi_csi_frame_cap_pipeline()
 
 WhoFrameCap *get_uvc_frame_cap_pipeline()
 {
-    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 4);
+    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 3);
     auto frame_cap = new WhoFrameCap();
-    // The ringbuf_len of FetchNode equals cam_fb_count - 2, the ringbuf_len of FetchNode should take care of the
-    // process time of the following Node. For example, if the DecodeNode takes 2 frame to decode, then the
-    // FetchNode ringbuf_len is at least 2, and the fb_count of the cam is at least 4.
+    // The jpeg frame is held by the DecodeNode while it is decoded, and the decoded frame by the PPAResizeNode, so
+    // neither ringbuf has to cover the time of the next node.
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam, false);
-    // The DecodeNode ringbuf_len relies on the following PPAResizeNode process time, the time of data transfer.
-    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 2, false);
-    // The ppa resized fb will display on lcd, if you want to make sure the displayed detection result is synced with
-    // the frame, the ringbuf size must be big enough to cover the process time from now to the the detection result is
-    // ready.
+    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1, false);
+    // The ppa resized fb will display on lcd, its ringbuf covers the time until the detection result is ready.
     frame_cap->add_node<WhoPPAResizeNode>(
         "FrameCapPPAResize", 800, 600, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME + 1);
     return frame_cap;
@@ -1,19 +1,27 @@
 #include "frame_cap_pipeline.hpp"
 #include "who_detect_app_lcd.hpp"
 #include "who_detect_app_term.hpp"
+#include "who_detect_result_handle.hpp"
+#include "who_multi_detect.hpp"
+#include "who_yield2idle.hpp"
 #include "bsp/esp-bsp.h"
+// Every model component in the build is included, run_multi_detect_term() runs all of them.
 #if defined(CONFIG_HUMAN_FACE_DETECT_MODEL_LOCATION)
 #include "human_face_detect.hpp"
-#elif defined(CONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION)
+#endif
+#if defined(CONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION)
 #include "pedestrian_detect.hpp"
-#elif defined(CONFIG_CAT_DETECT_MODEL_LOCATION)
+#endif
+#if defined(CONFIG_CAT_DETECT_MODEL_LOCATION)
 #include "cat_detect.hpp"
-#elif defined(CONFIG_DOG_DETECT_MODEL_LOCATION)
+#endif
+#if defined(CONFIG_DOG_DETECT_MODEL_LOCATION)
 #include "dog_detect.hpp"
 #endif
 
 using namespace who::frame_cap;
 using namespace who::app;
+using namespace who::detect;
 
 dl::detect::Detect *get_detect_model()
 {
@@ -33,23 +41,30 @@ dl::detect::Detect *get_detect_model()
 #endif
 }
 
-void run_detect_lcd()
+WhoFrameCap *run_detect_lcd()
 {
     WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr;
+    WhoFrameCapNode *detect_frame_cap_node = nullptr;
 #if CONFIG_IDF_TARGET_ESP32S3
     auto frame_cap = get_lcd_dvp_frame_cap_pipeline();
 #elif CONFIG_IDF_TARGET_ESP32P4
     auto frame_cap = get_lcd_mipi_csi_frame_cap_pipeline();
     // auto frame_cap = get_lcd_mipi_csi_ppa_frame_cap_pipeline(&lcd_disp_frame_cap_node);
-    // auto frame_cap = get_lcd_uvc_frame_cap_pipeline();
+    // auto frame_cap = get_lcd_uvc_frame_cap_pipeline(&lcd_disp_frame_cap_node, &detect_frame_cap_node);
 #endif
-    auto detect_app = new WhoDetectAppLCD({{255, 0, 0}}, frame_cap, lcd_disp_frame_cap_node);
+    auto detect_app = new WhoDetectAppLCD({{255, 0, 0}}, frame_cap, lcd_disp_frame_cap_node, detect_frame_cap_node);
     // create model later to avoid memory fragmentation.
     detect_app->set_model(get_detect_model());
+    // Most frames of a fixed camera are static, skip the model on them and keep the last boxes. Still detect once every
+    // 30 frames, for the objects which stop moving or leave slowly.
+    detect_app->set_motion_gate(0.01f, 30);
+    // try this to log the ringbuf_len and fb_count each node needs to keep the boxes in sync with the frames.
+    // detect_app->enable_planner();
     detect_app->run();
+    return frame_cap;
 }
 
-void run_detect_term()
+WhoFrameCap *run_detect_term()
 {
 #if CONFIG_IDF_TARGET_ESP32S3
     auto frame_cap = get_term_dvp_frame_cap_pipeline();
@@ -61,7 +76,70 @@ void run_detect_term()
     auto detect_app = new WhoDetectAppTerm(frame_cap);
     // create model later to avoid memory fragmentation.
     detect_app->set_model(get_detect_model());
+    detect_app->set_motion_gate(0.01f, 30);
     detect_app->run();
+    return frame_cap;
+}
+
+WhoFrameCap *run_multi_detect_term()
+{
+#if CONFIG_IDF_TARGET_ESP32S3
+    auto frame_cap = get_term_dvp_frame_cap_pipeline();
+#elif CONFIG_IDF_TARGET_ESP32P4
+    auto frame_cap = get_term_mipi_csi_frame_cap_pipeline();
+#endif
+    auto multi_detect = new WhoMultiDetect("MultiDetect", frame_cap->get_last_node());
+    auto add_model = [multi_detect](const char *name, dl::detect::Detect *model, float fps) {
+        int idx = multi_detect->add_model(model, nullptr, fps);
+        multi_detect->set_detect_result_cb(idx, [name](const WhoDetect::result_t &result) {
+            ESP_LOGI("MAIN", "%s:", name);
+            print_detect_results(result.det_res);
+        });
+        return idx;
+    };
+    // The face model crops the faces its first stage finds out of the frame for its second stage, so it runs on the
+    // frame itself.
+#if defined(CONFIG_HUMAN_FACE_DETECT_MODEL_LOCATION)
+    add_model("face",
+              new HumanFaceDetect(static_cast<HumanFaceDetect::model_type_t>(CONFIG_DEFAULT_HUMAN_FACE_DETECT_MODEL),
+                                  false),
+              10);
+#endif
+    // The others are resized to their input shape by WhoMultiDetect, once for all the models of the same shape.
+#if defined(CONFIG_PEDESTRIAN_DETECT_MODEL_LOCATION)
+    int pedestrian = add_model(
+        "pedestrian",
+        new PedestrianDetect(static_cast<PedestrianDetect::model_type_t>(CONFIG_DEFAULT_PEDESTRIAN_DETECT_MODEL),
+                             false),
+        5);
+    multi_detect->set_model_input_shape(pedestrian, 224, 224);
+#endif
+#if defined(CONFIG_CAT_DETECT_MODEL_LOCATION)
+    int cat = add_model(
+        "cat", new CatDetect(static_cast<CatDetect::model_type_t>(CONFIG_DEFAULT_CAT_DETECT_MODEL), false), 2);
+#if defined(CONFIG_ESPDET_PICO_416_416_CAT)
+    multi_detect->set_model_input_shape(cat, 416, 416);
+#else
+    multi_detect->set_model_input_shape(cat, 224, 224);
+#endif
+#endif
+#if defined(CONFIG_DOG_DETECT_MODEL_LOCATION)
+    int dog = add_model(
+        "dog", new DogDetect(static_cast<DogDetect::model_type_t>(CONFIG_DEFAULT_DOG_DETECT_MODEL), false), 2);
+#if defined(CONFIG_ESPDET_PICO_416_416_DOG)
+    multi_detect->set_model_input_shape(dog, 416, 416);
+#else
+    multi_detect->set_model_input_shape(dog, 224, 224);
+#endif
+#endif
+    // Or SCHEDULE_ROUND_ROBIN, one model per frame, or SCHEDULE_PRIORITY with a time budget per frame.
+    multi_detect->set_schedule(WhoMultiDetect::schedule_t::SCHEDULE_FPS);
+    who::WhoYield2Idle::get_instance()->run();
+    for (const auto &frame_cap_node : frame_cap->get_all_nodes()) {
+        frame_cap_node->run(4096, 2, 0);
+    }
+    multi_detect->run(4096, 2, 1);
+    return frame_cap;
 }
 
 extern "C" void app_main(void)
@@ -78,7 +156,18 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(bsp_led_set(BSP_LED_GREEN, false));
 #endif
 
-    run_detect_lcd();
+    auto frame_cap = run_detect_lcd();
     // try this if you don't have a lcd.
-    // run_detect_term();
+    // auto frame_cap = run_detect_term();
+    // try this to run every detect model component in the build on the same frames, see README.md.
+    // auto frame_cap = run_multi_detect_term();
+#if CONFIG_WHO_FRAME_TRACE
+    // Where the latency of the frames goes, and where the frames are dropped.
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(10000));
+        WhoFrameTracer::get_instance()->print(frame_cap);
+    }
+#else
+    (void)frame_cap;
+#endif
 }
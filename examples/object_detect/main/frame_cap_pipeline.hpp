@@ -8,7 +8,8 @@ who::frame_cap::WhoFrameCap *get_term_dvp_frame_cap_pipeline();
 who::frame_cap::WhoFrameCap *get_lcd_mipi_csi_frame_cap_pipeline();
 who::frame_cap::WhoFrameCap *get_lcd_mipi_csi_ppa_frame_cap_pipeline(
     who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node);
-who::frame_cap::WhoFrameCap *get_lcd_uvc_frame_cap_pipeline();
+who::frame_cap::WhoFrameCap *get_lcd_uvc_frame_cap_pipeline(who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node,
+                                                            who::frame_cap::WhoFrameCapNode **detect_frame_cap_node);
 who::frame_cap::WhoFrameCap *get_term_mipi_csi_frame_cap_pipeline();
 who::frame_cap::WhoFrameCap *get_term_mipi_csi_ppa_frame_cap_pipeline();
 who::frame_cap::WhoFrameCap *get_term_uvc_frame_cap_pipeline();
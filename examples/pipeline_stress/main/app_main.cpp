@@ -0,0 +1,225 @@
+#include "synth_detect.hpp"
+#include "who_cam.hpp"
+#if CONFIG_IDF_TARGET_LINUX
+#include "who_detect.hpp"
+#else
+#include "who_detect_app_lcd.hpp"
+#endif
+#include <algorithm>
+#include <cinttypes>
+
+using namespace who::cam;
+using namespace who::frame_cap;
+#if !CONFIG_IDF_TARGET_LINUX
+using namespace who::app;
+#endif
+
+static const char *TAG = "PipelineStress";
+
+#define CAM_W 240
+#define CAM_H 240
+#define MODEL_INPUT_W 64
+#define MODEL_INPUT_H 64
+
+// Each segment stresses one kind of timing, the stats are printed and reset when the cam moves to the next one.
+static const std::vector<WhoSynthCam::segment_t> s_script = {
+    // name, n_frames, fps, jitter, burst_len, stall_every, stall_us
+    {"steady", 150, 30, 0, 1, 0, 0},
+    {"jitter", 150, 30, 0.5f, 1, 0, 0},
+    {"burst", 160, 30, 0, 4, 0, 0},
+    {"stall", 150, 30, 0, 1, 30, 500000},
+    {"fps_jump", 300, 60, 0.1f, 1, 0, 0},
+    {"fps_drop", 25, 5, 0, 1, 0, 0},
+};
+
+static float get_iou(const int16_t *box, const std::vector<int> &target)
+{
+    int w = std::min<int>(box[2], target[2]) - std::max<int>(box[0], target[0]);
+    int h = std::min<int>(box[3], target[3]) - std::max<int>(box[1], target[1]);
+    int inter = std::max(w, 0) * std::max(h, 0);
+    int uni = (box[2] - box[0]) * (box[3] - box[1]) + (target[2] - target[0]) * (target[3] - target[1]) - inter;
+    return uni > 0 ? (float)inter / uni : 0;
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// The linux target has no lcd, the pipeline runs headless on the host. Every result is checked against the frame it
+// is detected on, which the result keeps a reference to: a box off the target box of that frame means its fb was
+// recycled while the model still ran on it.
+class StressApp {
+public:
+    // Detects on the last node of frame_cap.
+    StressApp(WhoFrameCap *frame_cap) :
+        m_frame_cap(frame_cap),
+        m_detect(new who::detect::WhoDetect("Detect", frame_cap->get_last_node())),
+        m_n_frames(0),
+        m_n_misses(0),
+        m_n_decode_errs(0),
+        m_iou_sum(0)
+    {
+        m_detect->set_detect_result_cb(std::bind(&StressApp::detect_result_cb, this, std::placeholders::_1));
+    }
+
+    void set_model(dl::detect::Detect *model) { m_detect->set_model(model); }
+
+    bool run()
+    {
+        bool ret = true;
+        for (const auto &frame_cap_node : m_frame_cap->get_all_nodes()) {
+            ret &= frame_cap_node->run(4096, 2, 0);
+        }
+        ret &= m_detect->run(2560, 2, 1);
+        return ret;
+    }
+
+    void print_stats(bool reset)
+    {
+        uint32_t n_frames = m_n_frames.exchange(reset ? 0 : m_n_frames.load());
+        uint32_t n_misses = m_n_misses.exchange(reset ? 0 : m_n_misses.load());
+        uint32_t n_decode_errs = m_n_decode_errs.exchange(reset ? 0 : m_n_decode_errs.load());
+        float iou_sum = m_iou_sum.exchange(reset ? 0 : m_iou_sum.load());
+        ESP_LOGI(TAG,
+                 "results %" PRIu32 ", box iou mean %.3f, iou < 0.5 %" PRIu32 ", decode errors %" PRIu32,
+                 n_frames,
+                 n_frames ? iou_sum / n_frames : 0,
+                 n_misses,
+                 n_decode_errs);
+        ESP_LOGI(TAG, "infer %" PRIu32 " skip %" PRIu32, m_detect->get_infer_cnt(), m_detect->get_skip_cnt());
+    }
+
+private:
+    void detect_result_cb(const who::detect::WhoDetect::result_t &result)
+    {
+        uint32_t frame_id;
+        if (!WhoSynthCam::decode_frame_id(result.img, frame_id)) {
+            m_n_decode_errs.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (result.det_res.empty()) {
+            return;
+        }
+        float iou = get_iou(result.det_res.box[0],
+                            WhoSynthCam::get_target_box(frame_id, result.img.width, result.img.height));
+        m_n_frames.fetch_add(1, std::memory_order_relaxed);
+        if (iou < 0.5f) {
+            m_n_misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Only the detect task adds to it.
+        m_iou_sum.store(m_iou_sum.load(std::memory_order_relaxed) + iou, std::memory_order_relaxed);
+    }
+
+    WhoFrameCap *m_frame_cap;
+    who::detect::WhoDetect *m_detect;
+    std::atomic<uint32_t> m_n_frames;
+    std::atomic<uint32_t> m_n_misses;
+    std::atomic<uint32_t> m_n_decode_errs;
+    std::atomic<float> m_iou_sum;
+};
+#else
+// Checks every displayed frame against the result drawn on it. Besides the seq lag measured by
+// WhoDetectResultLCDDisp, the drawn box is compared with the target box of the displayed frame, which shows how far
+// off the boxes are on the screen.
+class StressApp : public WhoDetectAppLCD {
+public:
+    StressApp(WhoFrameCap *frame_cap, WhoFrameCapNode *lcd_disp_frame_cap_node) :
+        WhoDetectAppLCD({{255, 0, 0}}, frame_cap, lcd_disp_frame_cap_node),
+        m_n_frames(0),
+        m_n_misses(0),
+        m_n_decode_errs(0),
+        m_iou_sum(0)
+    {
+    }
+
+    void print_stats(bool reset)
+    {
+        auto sync_stats = get_result_lcd_disp()->get_sync_stats(reset);
+        ESP_LOGI(TAG,
+                 "displayed %" PRIu32 " no result %" PRIu32 " synced %" PRIu32 " lag mean %.2f max %" PRIu32,
+                 sync_stats.n_frames,
+                 sync_stats.n_no_result,
+                 sync_stats.n_synced,
+                 sync_stats.mean_lag,
+                 sync_stats.max_lag);
+        uint32_t n_frames = m_n_frames.exchange(reset ? 0 : m_n_frames.load());
+        uint32_t n_misses = m_n_misses.exchange(reset ? 0 : m_n_misses.load());
+        uint32_t n_decode_errs = m_n_decode_errs.exchange(reset ? 0 : m_n_decode_errs.load());
+        float iou_sum = m_iou_sum.exchange(reset ? 0 : m_iou_sum.load());
+        ESP_LOGI(TAG,
+                 "box iou mean %.3f, iou < 0.5 %" PRIu32 ", decode errors %" PRIu32,
+                 n_frames ? iou_sum / n_frames : 0,
+                 n_misses,
+                 n_decode_errs);
+        ESP_LOGI(TAG, "infer %" PRIu32 " skip %" PRIu32, m_detect->get_infer_cnt(), m_detect->get_skip_cnt());
+    }
+
+protected:
+    void lcd_disp_cb(who::cam::cam_fb_t *fb) override
+    {
+        WhoDetectAppLCD::lcd_disp_cb(fb);
+        uint32_t frame_id;
+        if (!WhoSynthCam::decode_frame_id(*fb, frame_id)) {
+            m_n_decode_errs.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const auto &result = get_result_lcd_disp()->get_disp_result();
+        if (result.det_res.empty()) {
+            return;
+        }
+        float iou = get_iou(result.det_res.box[0], WhoSynthCam::get_target_box(frame_id, fb->width, fb->height));
+        m_n_frames.fetch_add(1, std::memory_order_relaxed);
+        if (iou < 0.5f) {
+            m_n_misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Only the lcd disp task adds to it.
+        m_iou_sum.store(m_iou_sum.load(std::memory_order_relaxed) + iou, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> m_n_frames;
+    std::atomic<uint32_t> m_n_misses;
+    std::atomic<uint32_t> m_n_decode_errs;
+    std::atomic<float> m_iou_sum;
+};
+#endif
+
+extern "C" void app_main(void)
+{
+    vTaskPrioritySet(xTaskGetCurrentTaskHandle(), 5);
+
+    auto cam = new WhoSynthCam(cam_fb_fmt_t::CAM_FB_FMT_RGB565, CAM_W, CAM_H, s_script, 6);
+    auto frame_cap = new WhoFrameCap();
+#if CONFIG_IDF_TARGET_LINUX
+    frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+#else
+    auto fetch_node = frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+#endif
+    frame_cap->add_node<WhoSWResizeNode>(
+        "FrameCapSWResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB888, 2);
+
+    auto model = new SynthDetect(25000, 0.5f);
+#if CONFIG_IDF_TARGET_LINUX
+    auto app = new StressApp(frame_cap);
+#else
+    auto app = new StressApp(frame_cap, fetch_node);
+#endif
+    app->set_model(model);
+    app->run();
+
+    int seg_idx = cam->get_segment_idx();
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        int cur_seg_idx = cam->get_segment_idx();
+        if (cur_seg_idx == seg_idx) {
+            continue;
+        }
+        ESP_LOGI(TAG, "======== segment %s ========", cam->get_segment(seg_idx).name);
+        WhoFrameTracer::get_instance()->print(frame_cap);
+        ESP_LOGI(TAG,
+                 "cam frames %" PRIu32 " dropped %" PRIu32 ", model decode errors %" PRIu32,
+                 cam->get_frame_cnt(),
+                 cam->get_drop_cnt(),
+                 model->get_decode_err_cnt());
+        app->print_stats(true);
+        WhoFrameTracer::get_instance()->reset();
+        seg_idx = cur_seg_idx;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "dl_detect_base.hpp"
+#include "who_synth_cam.hpp"
+#include <atomic>
+
+// Stands in for a detect model on the frames of WhoSynthCam. It reads the frame id from the bar code and returns the
+// target box of that frame after keeping the cpu busy for the inference time, so a result is always right for the
+// frame it is detected on and any error seen on the lcd comes from the pipeline.
+class SynthDetect : public dl::detect::Detect {
+public:
+    // The inference time varies uniformly within +-jitter of infer_us.
+    SynthDetect(int32_t infer_us, float jitter = 0, uint32_t seed = 1);
+    std::list<dl::detect::result_t> &run(const dl::image::img_t &img) override;
+    // Frames whose bar code did not decode, e.g. torn by a fb recycled too early.
+    uint32_t get_decode_err_cnt() { return m_decode_err_cnt.load(std::memory_order_relaxed); }
+
+private:
+    int32_t m_infer_us;
+    float m_jitter;
+    who::cam::WhoXorShift32 m_rand;
+    std::list<dl::detect::result_t> m_result;
+    std::atomic<uint32_t> m_decode_err_cnt;
+};
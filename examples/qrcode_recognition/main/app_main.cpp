@@ -16,13 +16,15 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(bsp_led_set(BSP_LED_GREEN, false));
 #endif
 
+    WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr;
 #if CONFIG_IDF_TARGET_ESP32S3
-    auto frame_cap = get_dvp_frame_cap_pipeline();
+    auto frame_cap = get_dvp_frame_cap_pipeline(&lcd_disp_frame_cap_node);
+    // auto frame_cap = get_uvc_frame_cap_pipeline(&lcd_disp_frame_cap_node);
 #elif CONFIG_IDF_TARGET_ESP32P4
-    auto frame_cap = get_mipi_csi_frame_cap_pipeline();
-    // auto frame_cap = get_uvc_frame_cap_pipeline();
+    auto frame_cap = get_mipi_csi_frame_cap_pipeline(&lcd_disp_frame_cap_node);
+    // auto frame_cap = get_uvc_frame_cap_pipeline(&lcd_disp_frame_cap_node);
 #endif
-    auto qrcode_app = new WhoQRCodeAppLCD(frame_cap);
+    auto qrcode_app = new WhoQRCodeAppLCD(frame_cap, lcd_disp_frame_cap_node);
     // try this if you don't have a lcd.
     // auto qrcode_app = new WhoQRCodeAppTerm(frame_cap);
     qrcode_app->run();
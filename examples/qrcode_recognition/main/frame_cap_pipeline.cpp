@@ -7,32 +7,55 @@ using namespace who::frame_cap;
 // num of frames the model take to get result
 #define MODEL_TIME 2
 
-// The size of the fb_count and ringbuf_len must be big enough. If you have no idea how to set them, try with 5 and
-// larger.
+// Displayed ringbuf MODEL_TIME + 1 = 3 frames, so a displayed cam has fb_count MODEL_TIME + 3, see WhoFetchNode.
+// The qrcode is scanned on the gray node, the frames before it are displayed.
 #if CONFIG_IDF_TARGET_ESP32S3
-WhoFrameCap *get_dvp_frame_cap_pipeline()
+WhoFrameCap *get_dvp_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
 {
-    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, FRAMESIZE_240X240, MODEL_TIME + 2);
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, FRAMESIZE_240X240, MODEL_TIME + 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+    frame_cap->add_node<WhoGrayNode>("FrameCapGray", BSP_LCD_H_RES, BSP_LCD_V_RES, 1);
+    *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapFetch");
+    return frame_cap;
+}
+
+WhoFrameCap *get_uvc_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
+{
+    // Each decode worker holds a jpeg while it decodes it, one more fb than with a single decoder.
+    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 320, 240, 15, 4);
+    auto frame_cap = new WhoFrameCap();
+    frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam, false);
+    auto decode_node = frame_cap->add_node<WhoDecodeNode>(
+        "FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME + 1, false);
+    // The middle of the frame fits the lcd, the decoder stops at the right edge of the crop.
+    decode_node->set_crop({40, 0, 280, 240});
+    // There is no hardware decoder, decode 2 frames at a time on both cores to keep up with the cam.
+    decode_node->set_n_workers(2);
+    frame_cap->add_node<WhoGrayNode>("FrameCapGray", BSP_LCD_H_RES, BSP_LCD_V_RES, 1, false);
+    *lcd_disp_frame_cap_node = decode_node;
     return frame_cap;
 }
 #elif CONFIG_IDF_TARGET_ESP32P4
-WhoFrameCap *get_mipi_csi_frame_cap_pipeline()
+WhoFrameCap *get_mipi_csi_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
 {
-    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, MODEL_TIME + 2);
+    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, MODEL_TIME + 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+    frame_cap->add_node<WhoGrayNode>("FrameCapGray", BSP_LCD_H_RES / 2, BSP_LCD_V_RES / 2, 1);
+    *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapFetch");
     return frame_cap;
 }
-WhoFrameCap *get_uvc_frame_cap_pipeline()
+WhoFrameCap *get_uvc_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
 {
-    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 4);
+    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam, false);
-    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 2, false);
+    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1, false);
     frame_cap->add_node<WhoPPAResizeNode>(
-        "FrameCapPPAResize", 800, 600, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME, false);
+        "FrameCapPPAResize", 800, 600, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME + 1, false);
+    frame_cap->add_node<WhoGrayNode>("FrameCapGray", BSP_LCD_H_RES / 2, BSP_LCD_V_RES / 2, 1, false);
+    *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapPPAResize");
     return frame_cap;
 }
 #endif
@@ -2,8 +2,9 @@
 #include "who_frame_cap.hpp"
 
 #if CONFIG_IDF_TARGET_ESP32S3
-who::frame_cap::WhoFrameCap *get_dvp_frame_cap_pipeline();
+who::frame_cap::WhoFrameCap *get_dvp_frame_cap_pipeline(who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node);
+who::frame_cap::WhoFrameCap *get_uvc_frame_cap_pipeline(who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node);
 #elif CONFIG_IDF_TARGET_ESP32P4
-who::frame_cap::WhoFrameCap *get_mipi_csi_frame_cap_pipeline();
-who::frame_cap::WhoFrameCap *get_uvc_frame_cap_pipeline();
+who::frame_cap::WhoFrameCap *get_mipi_csi_frame_cap_pipeline(who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node);
+who::frame_cap::WhoFrameCap *get_uvc_frame_cap_pipeline(who::frame_cap::WhoFrameCapNode **lcd_disp_frame_cap_node);
 #endif
@@ -0,0 +1,140 @@
+"""Generate the constexpr anchor header of a UHD model from the metadata shipped with its export.
+
+The anchors and wh_scale are read from <name>_anchors.npy and <name>_wh_scale.npy in the model directory, or from the
+"anchors" and "wh_scale" keys of <name>.json if the .npy files are missing. Both must hold the same number of (w, h)
+pairs, otherwise the build fails. Without any of them the output is removed, and uhd_detect falls back to the tables in
+uhd_constants.hpp.
+
+Run by the CMakeLists.txt of uhd_detect, e.g.
+    python gen_uhd_anchors.py models/uhd/<name> <name> -o build/uhd_anchors_gen.hpp
+"""
+import argparse
+import ast
+import json
+import os
+import struct
+import sys
+
+NPY_MAGIC = b"\x93NUMPY"
+# Float dtypes of the exports, no numpy needed in the idf python env.
+NPY_DTYPES = {"<f4": "<f", "<f8": "<d", "|f4": "<f", "|f8": "<d"}
+
+
+def fail(msg):
+    sys.exit(f"gen_uhd_anchors: {msg}")
+
+
+def read_npy(path):
+    with open(path, "rb") as f:
+        if f.read(6) != NPY_MAGIC:
+            fail(f"{path} is not a .npy file.")
+        major = f.read(2)[0]
+        header_len = struct.unpack("<H" if major == 1 else "<I", f.read(2 if major == 1 else 4))[0]
+        header = ast.literal_eval(f.read(header_len).decode("latin1"))
+        fmt = NPY_DTYPES.get(header["descr"])
+        if fmt is None:
+            fail(f"{path} has dtype {header['descr']}, float expected.")
+        if header["fortran_order"]:
+            fail(f"{path} is in fortran order.")
+        shape = tuple(header["shape"])
+        n = 1
+        for d in shape:
+            n *= d
+        data = f.read(n * struct.calcsize(fmt))
+        if len(data) != n * struct.calcsize(fmt):
+            fail(f"{path} is truncated.")
+        return shape, list(struct.unpack(f"<{n}{fmt[1]}", data))
+
+
+def read_json(path, key):
+    with open(path) as f:
+        meta = json.load(f)
+    if key not in meta:
+        return None
+    value = meta[key]
+    if not isinstance(value, list):
+        fail(f"{key} in {path} is not a list.")
+    try:
+        if value and isinstance(value[0], list):
+            if any(not isinstance(row, list) or len(row) != 2 for row in value):
+                fail(f"{key} in {path} has a row that is not a (w, h) pair, (n, 2) expected.")
+            return (len(value), 2), [float(v) for row in value for v in row]
+        return (len(value),), [float(v) for v in value]
+    except (TypeError, ValueError):
+        fail(f"{key} in {path} holds a value that is not a number.")
+
+
+def read_pairs(model_dir, name, key):
+    """Returns the source file and the flattened (w, h) pairs, None if the model ships no such metadata."""
+    npy = os.path.join(model_dir, f"{name}_{key}.npy")
+    src = os.path.join(model_dir, f"{name}.json")
+    if os.path.exists(npy):
+        src, (shape, values) = npy, read_npy(npy)
+    elif os.path.exists(src) and (meta := read_json(src, key)) is not None:
+        shape, values = meta
+    else:
+        return None
+    # (n, 2), or flattened, possibly with leading batch dims of 1.
+    dims = [d for d in shape if d != 1] or [1]
+    if not ((len(dims) == 2 and dims[1] == 2) or (len(dims) == 1 and dims[0] % 2 == 0)):
+        fail(f"{key} in {src} has shape {shape}, (n, 2) expected.")
+    return src, values
+
+
+def format_floats(values):
+    lines = []
+    for i in range(0, len(values), 2):
+        lines.append(f"    {values[i]:.8e}f, {values[i + 1]:.8e}f,")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("model_dir")
+    parser.add_argument("name", help="file name prefix of the metadata, the name of the model directory")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    anchors_meta = read_pairs(args.model_dir, args.name, "anchors")
+    wh_scale_meta = read_pairs(args.model_dir, args.name, "wh_scale")
+    if anchors_meta is None and wh_scale_meta is None:
+        if os.path.exists(args.output):
+            os.remove(args.output)
+        return
+    if anchors_meta is None or wh_scale_meta is None:
+        fail(f"{args.name} ships only one of anchors and wh_scale in {args.model_dir}.")
+    anchors_src, anchors = anchors_meta
+    wh_scale_src, wh_scale = wh_scale_meta
+    if len(anchors) != len(wh_scale):
+        fail(f"{len(anchors) // 2} anchors in {anchors_src} but {len(wh_scale) // 2} wh_scale in {wh_scale_src}.")
+    n = len(anchors) // 2
+    if not n:
+        fail(f"no anchors in {anchors_src}.")
+
+    header = f"""#pragma once
+// Generated by gen_uhd_anchors.py from {os.path.basename(anchors_src)} and {os.path.basename(wh_scale_src)}.
+#include "uhd_constants.hpp"
+
+namespace uhd_detect {{
+static inline constexpr float kGeneratedAnchors[] = {{
+{format_floats(anchors)}
+}};
+
+static inline constexpr float kGeneratedWhScale[] = {{
+{format_floats(wh_scale)}
+}};
+
+static inline constexpr auto kGeneratedAnchorWh = make_uhd_anchor_wh<{n}>(kGeneratedAnchors, kGeneratedWhScale);
+}} // namespace uhd_detect
+"""
+    # Keep the timestamp if nothing changed, so that uhd_detect.cpp is not rebuilt.
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            if f.read() == header:
+                return
+    with open(args.output, "w") as f:
+        f.write(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,14 +1,9 @@
 #pragma once
 
 #include <cstddef>
-#include <cstring>
+#include <string_view>
 
 namespace uhd_detect {
-struct UhdAnchorSet {
-    const float *anchors;
-    const float *wh_scale;
-    int count;
-};
 
 static inline constexpr float kAnchorsW32[] = {
     4.7440167e-06f, 1.0240427e-05f,
@@ -98,35 +93,71 @@ static inline constexpr float kWhScaleAnc16W32[] = {
     1.14782047e+00f, 1.22924173e+00f, 1.34597931e+01f, 1.57487030e+01f,
 };
 
-inline bool get_uhd_anchor_set(const char *model_name, UhdAnchorSet *out)
+// Anchor sizes with the learned wh scale folded in, the decode multiplies softplus of the box map by them.
+template <int N>
+struct UhdAnchorWh {
+    static inline constexpr int count = N;
+    float w[N];
+    float h[N];
+};
+
+template <int N>
+constexpr UhdAnchorWh<N> make_uhd_anchor_wh(const float (&anchors)[N * 2], const float (&wh_scale)[N * 2])
 {
-    if (!model_name || !out) {
-        return false;
+    UhdAnchorWh<N> out{};
+    for (int i = 0; i < N; i++) {
+        out.w[i] = anchors[i * 2] * wh_scale[i * 2];
+        out.h[i] = anchors[i * 2 + 1] * wh_scale[i * 2 + 1];
     }
-    if (std::strstr(model_name, "nopost_head") != nullptr) {
-        out->anchors = kAnchorsAnc8W32Head;
-        out->wh_scale = kWhScaleAnc8W32Head;
-        out->count = 8;
-        return true;
+    return out;
+}
+
+enum class UhdVariant {
+    UNKNOWN,
+    ANC8_W32_HEAD,
+    ANC16_W32,
+    W40,
+    W32,
+};
+
+// The keys are tested in this order, as the names of the variants contain each other's keys.
+constexpr UhdVariant get_uhd_variant(std::string_view model_name)
+{
+    if (model_name.find("nopost_head") != std::string_view::npos) {
+        return UhdVariant::ANC8_W32_HEAD;
     }
-    if (std::strstr(model_name, "anc16") != nullptr) {
-        out->anchors = kAnchorsAnc16W32;
-        out->wh_scale = kWhScaleAnc16W32;
-        out->count = 16;
-        return true;
+    if (model_name.find("anc16") != std::string_view::npos) {
+        return UhdVariant::ANC16_W32;
     }
-    if (std::strstr(model_name, "w40") != nullptr) {
-        out->anchors = kAnchorsW40;
-        out->wh_scale = kWhScaleW40;
-        out->count = 8;
-        return true;
+    if (model_name.find("w40") != std::string_view::npos) {
+        return UhdVariant::W40;
     }
-    if (std::strstr(model_name, "w32") != nullptr) {
-        out->anchors = kAnchorsW32;
-        out->wh_scale = kWhScaleW32;
-        out->count = 8;
-        return true;
+    if (model_name.find("w32") != std::string_view::npos) {
+        return UhdVariant::W32;
     }
-    return false;
+    return UhdVariant::UNKNOWN;
 }
+
+template <UhdVariant V>
+struct UhdAnchors;
+
+template <>
+struct UhdAnchors<UhdVariant::ANC8_W32_HEAD> {
+    static inline constexpr auto wh = make_uhd_anchor_wh<8>(kAnchorsAnc8W32Head, kWhScaleAnc8W32Head);
+};
+
+template <>
+struct UhdAnchors<UhdVariant::ANC16_W32> {
+    static inline constexpr auto wh = make_uhd_anchor_wh<16>(kAnchorsAnc16W32, kWhScaleAnc16W32);
+};
+
+template <>
+struct UhdAnchors<UhdVariant::W40> {
+    static inline constexpr auto wh = make_uhd_anchor_wh<8>(kAnchorsW40, kWhScaleW40);
+};
+
+template <>
+struct UhdAnchors<UhdVariant::W32> {
+    static inline constexpr auto wh = make_uhd_anchor_wh<8>(kAnchorsW32, kWhScaleW32);
+};
 } // namespace uhd_detect
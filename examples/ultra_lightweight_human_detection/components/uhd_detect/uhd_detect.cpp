@@ -4,13 +4,16 @@
 #include "dl_tensor_base.hpp"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
-#include "esp_timer.h"
 #include "uhd_constants.hpp"
+#include "who_activation_lut.hpp"
 
 #include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <type_traits>
+#if UHD_GENERATED_ANCHORS
+#include "uhd_anchors_gen.hpp"
+#endif
 
 namespace {
 constexpr char kTag[] = "uhd_detect";
@@ -19,7 +22,7 @@ constexpr char kTag[] = "uhd_detect";
 #define UHD_MODEL_SYMBOL ultratinyod_anc8_w32_64x64_opencv_inter_nearest_static_nopost_nocat_espdl
 #endif
 #ifndef UHD_MODEL_NAME
-#define UHD_MODEL_NAME "uhd_model"
+#define UHD_MODEL_NAME "ultratinyod_anc8_w32_64x64_opencv_inter_nearest_static_nopost_nocat"
 #endif
 
 #define SYMBOL_JOIN(a, b) a##b
@@ -73,27 +76,20 @@ ModelBlob load_model_blob()
     return blob;
 }
 
-static inline float sigmoid_f(float x)
-{
-    if (x >= 80.0f) {
-        return 1.0f;
-    }
-    if (x <= -80.0f) {
-        return 0.0f;
-    }
-    return 1.0f / (1.0f + std::exp(-x));
-}
+using who::detect::Int8ActivationLUT;
+using who::detect::sigmoid_f;
+using who::detect::softplus_f;
 
-static inline float softplus_f(float x)
-{
-    if (x > 20.0f) {
-        return x;
-    }
-    if (x < -20.0f) {
-        return std::exp(x);
-    }
-    return std::log1p(std::exp(x));
-}
+// The anchors of the model are picked at compile time, so that the decode has their count and sizes as constants.
+#if UHD_GENERATED_ANCHORS
+// From the metadata of the model, see gen_uhd_anchors.py.
+constexpr auto kAnchorWh = uhd_detect::kGeneratedAnchorWh;
+#else
+constexpr uhd_detect::UhdVariant kVariant = uhd_detect::get_uhd_variant(UHD_MODEL_NAME);
+static_assert(kVariant != uhd_detect::UhdVariant::UNKNOWN, "No anchors for UHD_MODEL_NAME in uhd_constants.hpp.");
+constexpr auto kAnchorWh = uhd_detect::UhdAnchors<kVariant>::wh;
+#endif
+constexpr int kNumAnchors = kAnchorWh.count;
 
 class UhdLitePostprocessor : public dl::detect::DetectPostprocessor {
 public:
@@ -101,145 +97,226 @@ public:
                          dl::image::ImagePreprocessor *image_preprocessor,
                          float score_thr,
                          float nms_thr,
-                         int top_k) :
-        dl::detect::DetectPostprocessor(model, image_preprocessor, score_thr, nms_thr, top_k)
+                         int top_k,
+                         dl::TensorBase *box = nullptr,
+                         dl::TensorBase *quality = nullptr) :
+        dl::detect::DetectPostprocessor(model, image_preprocessor, score_thr, nms_thr, top_k),
+        m_box(box),
+        m_quality(quality),
+        // A person gives several overlapping candidates, nms keeps top_k of them.
+        m_max_candidates(std::max(top_k * kCandidatesPerResult, kMinCandidates))
     {
-        if (!uhd_detect::get_uhd_anchor_set(UHD_MODEL_NAME, &m_anchor_set)) {
-            m_anchor_set = {nullptr, nullptr, 0};
+        // sigmoid(q) >= score_thr if and only if q >= logit(score_thr), sigmoid_f() saturates at 80.
+        if (score_thr <= 0) {
+            m_logit_thr = -INFINITY;
+        } else if (score_thr >= 1) {
+            m_logit_thr = 80.f;
+        } else {
+            m_logit_thr = std::log(score_thr / (1.f - score_thr));
         }
+        m_candidates.reserve(m_max_candidates);
+        // The copies of a slot have the shapes and dtypes of the outputs of the model.
+        select_decoder(model->get_output("box"), model->get_output("quality"));
     }
 
     void postprocess() override
     {
-        dl::TensorBase *box = m_model->get_output("box");
-        dl::TensorBase *quality = m_model->get_output("quality");
+        if (!m_decode) {
+            return;
+        }
+        // The copies of a slot in the staged mode, otherwise the outputs of the model.
+        dl::TensorBase *box = m_box ? m_box : m_model->get_output("box");
+        dl::TensorBase *quality = m_quality ? m_quality : m_model->get_output("quality");
+        (this->*m_decode)(box, quality);
+        nms();
+    }
+
+    // The preprocessor of the frame, another model's one if the preprocessing is shared, see adopt_preprocessed().
+    void set_image_preprocessor(dl::image::ImagePreprocessor *image_preprocessor)
+    {
+        m_image_preprocessor = image_preprocessor;
+    }
+
+private:
+    static constexpr int kCandidatesPerResult = 8;
+    static constexpr int kMinCandidates = 64;
+
+    using decode_fn = void (UhdLitePostprocessor::*)(dl::TensorBase *, dl::TensorBase *);
+
+    // A cell of the quality map which passed the threshold, its box is decoded only if it makes the top.
+    struct candidate_t {
+        // Quality in the domain of the map, integer for the quantized ones.
+        float raw;
+        int idx;
+    };
+
+    // Checks the outputs once and picks the parse_maps() of their dtype and layout, m_decode stays nullptr if the
+    // outputs can't be decoded.
+    void select_decoder(dl::TensorBase *box, dl::TensorBase *quality)
+    {
         if (!box || !quality) {
             ESP_LOGE(kTag, "missing output tensor(s)");
             return;
         }
-
         if (box->shape.size() != 4 || quality->shape.size() != 4) {
             ESP_LOGE(kTag, "unexpected output dims");
             return;
         }
-
-        bool nhwc = (box->shape[3] % 4 == 0) && (quality->shape[3] == box->shape[3] / 4);
-        bool nchw = (box->shape[1] % 4 == 0) && (quality->shape[1] == box->shape[1] / 4);
+        bool nhwc = box->shape[3] == kNumAnchors * 4 && quality->shape[3] == kNumAnchors;
+        bool nchw = box->shape[1] == kNumAnchors * 4 && quality->shape[1] == kNumAnchors;
         if (!nhwc && !nchw) {
-            ESP_LOGE(kTag, "output tensor shape mismatch (box=%s quality=%s)",
+            ESP_LOGE(kTag,
+                     "output tensor shape mismatch (box=%s quality=%s), %d anchors expected",
                      dl::vector_to_string(box->shape).c_str(),
-                     dl::vector_to_string(quality->shape).c_str());
+                     dl::vector_to_string(quality->shape).c_str(),
+                     kNumAnchors);
             return;
         }
-
-        if (!m_anchor_set.anchors || !m_anchor_set.wh_scale || m_anchor_set.count <= 0) {
-            ESP_LOGE(kTag, "anchors/wh_scale missing for model %s", UHD_MODEL_NAME);
+        if (box->dtype != quality->dtype) {
+            ESP_LOGE(kTag, "output dtype mismatch");
             return;
         }
-
         if (box->dtype == dl::DATA_TYPE_INT8) {
-            parse_maps<int8_t>(box, quality, nhwc);
+            m_box_lut = Int8ActivationLUT::get(box->exponent);
+            m_quality_lut = Int8ActivationLUT::get(quality->exponent);
+            if (!m_box_lut || !m_quality_lut) {
+                ESP_LOGE(kTag, "unsupported output exponent: box=%d quality=%d", box->exponent, quality->exponent);
+                return;
+            }
+            m_decode = nhwc ? &UhdLitePostprocessor::parse_maps<int8_t, true>
+                            : &UhdLitePostprocessor::parse_maps<int8_t, false>;
         } else if (box->dtype == dl::DATA_TYPE_INT16) {
-            parse_maps<int16_t>(box, quality, nhwc);
+            m_decode = nhwc ? &UhdLitePostprocessor::parse_maps<int16_t, true>
+                            : &UhdLitePostprocessor::parse_maps<int16_t, false>;
         } else if (box->dtype == dl::DATA_TYPE_FLOAT) {
-            parse_maps<float>(box, quality, nhwc);
+            m_decode = nhwc ? &UhdLitePostprocessor::parse_maps<float, true>
+                            : &UhdLitePostprocessor::parse_maps<float, false>;
         } else {
             ESP_LOGE(kTag, "unsupported output dtype: %s", dl::dtype_to_string(box->dtype));
-            return;
         }
-
-        nms();
     }
 
-private:
-    template <typename T>
-    void parse_maps(dl::TensorBase *box, dl::TensorBase *quality, bool nhwc)
+    // Specialized on the dtype and the layout of the maps, with the anchors as constants, so that the branches are
+    // resolved at compile time and the cell index splits by constant divisors.
+    template <typename T, bool NHWC>
+    void parse_maps(dl::TensorBase *box, dl::TensorBase *quality)
     {
-        const int H = nhwc ? box->shape[1] : box->shape[2];
-        const int W = nhwc ? box->shape[2] : box->shape[3];
-        const int na = nhwc ? quality->shape[3] : quality->shape[1];
-        const int box_c = nhwc ? box->shape[3] : box->shape[1];
-        if (box_c != na * 4) {
-            ESP_LOGE(kTag, "box channel mismatch: box_c=%d anchors=%d", box_c, na);
-            return;
-        }
-        if (na != m_anchor_set.count) {
-            ESP_LOGW(kTag, "anchor count mismatch: model=%d const=%d", na, m_anchor_set.count);
-        }
-
-        auto *box_ptr = static_cast<T *>(box->data);
-        auto *quality_ptr = static_cast<T *>(quality->data);
-
-        const bool is_float = std::is_floating_point_v<T>;
+        constexpr bool is_float = std::is_floating_point_v<T>;
+        const int H = NHWC ? box->shape[1] : box->shape[2];
+        const int W = NHWC ? box->shape[2] : box->shape[3];
+        const T *box_ptr = static_cast<T *>(box->data);
+        const T *quality_ptr = static_cast<T *>(quality->data);
         const float box_scale = is_float ? 1.f : DL_SCALE(box->exponent);
         const float quality_scale = is_float ? 1.f : DL_SCALE(quality->exponent);
 
+        // The threshold in the domain of the map, so that a cell is rejected by one compare, without dequantize and
+        // sigmoid. Rounded up, as the quantized values below it fail in float as well.
+        float thr = m_logit_thr / quality_scale;
+        if constexpr (!is_float) {
+            thr = std::ceil(std::clamp(thr, -65536.f, 65536.f));
+        }
+
+        // Min-heap of the m_max_candidates best cells, the cost is in the hits rather than in the size of the maps.
+        auto worse = [](const candidate_t &a, const candidate_t &b) { return a.raw > b.raw; };
+        m_candidates.clear();
+        const int n = H * W * kNumAnchors;
+        for (int i = 0; i < n; ++i) {
+            float raw = static_cast<float>(quality_ptr[i]);
+            if (raw < thr) {
+                continue;
+            }
+            if (m_candidates.size() < m_max_candidates) {
+                m_candidates.push_back({raw, i});
+                std::push_heap(m_candidates.begin(), m_candidates.end(), worse);
+            } else if (raw > m_candidates.front().raw) {
+                std::pop_heap(m_candidates.begin(), m_candidates.end(), worse);
+                m_candidates.back() = {raw, i};
+                std::push_heap(m_candidates.begin(), m_candidates.end(), worse);
+            }
+        }
+        // Descending score, m_box_list is appended in the order nms() expects.
+        std::sort_heap(m_candidates.begin(), m_candidates.end(), worse);
+
         float inv_resize_scale_x = m_image_preprocessor->get_resize_scale_x(true);
         float inv_resize_scale_y = m_image_preprocessor->get_resize_scale_y(true);
-        int top_left_x = m_image_preprocessor->get_crop_area_top_left_x();
-        int top_left_y = m_image_preprocessor->get_crop_area_top_left_y();
+        float top_left_x = m_image_preprocessor->get_crop_area_top_left_x();
+        float top_left_y = m_image_preprocessor->get_crop_area_top_left_y();
         dl::TensorBase *input = m_image_preprocessor->get_model_input();
-        float scale_w = static_cast<float>(input->shape[2]) * inv_resize_scale_x;
-        float scale_h = static_cast<float>(input->shape[1]) * inv_resize_scale_y;
-
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                for (int a = 0; a < na; ++a) {
-                    size_t idx_q = nhwc ? ((static_cast<size_t>(y) * W + x) * na + a)
-                                        : ((static_cast<size_t>(a) * H + y) * W + x);
-                    float q_raw = is_float ? static_cast<float>(quality_ptr[idx_q])
-                                           : dl::dequantize(quality_ptr[idx_q], quality_scale);
-                    float score = sigmoid_f(q_raw);
-                    if (score < m_score_thr) {
-                        continue;
-                    }
-
-                    size_t idx_b = nhwc ? ((static_cast<size_t>(y) * W + x) * na * 4 + a * 4)
-                                        : ((static_cast<size_t>(a) * 4) * H * W + (static_cast<size_t>(y) * W + x));
-                    float tx = is_float ? static_cast<float>(box_ptr[idx_b + (nhwc ? 0 : 0 * H * W)])
-                                        : dl::dequantize(box_ptr[idx_b + (nhwc ? 0 : 0 * H * W)], box_scale);
-                    float ty = is_float ? static_cast<float>(box_ptr[idx_b + (nhwc ? 1 : 1 * H * W)])
-                                        : dl::dequantize(box_ptr[idx_b + (nhwc ? 1 : 1 * H * W)], box_scale);
-                    float tw = is_float ? static_cast<float>(box_ptr[idx_b + (nhwc ? 2 : 2 * H * W)])
-                                        : dl::dequantize(box_ptr[idx_b + (nhwc ? 2 : 2 * H * W)], box_scale);
-                    float th = is_float ? static_cast<float>(box_ptr[idx_b + (nhwc ? 3 : 3 * H * W)])
-                                        : dl::dequantize(box_ptr[idx_b + (nhwc ? 3 : 3 * H * W)], box_scale);
-
-                    float anchor_w = m_anchor_set.anchors[a * 2] * m_anchor_set.wh_scale[a * 2];
-                    float anchor_h = m_anchor_set.anchors[a * 2 + 1] * m_anchor_set.wh_scale[a * 2 + 1];
-
-                    float cx = (sigmoid_f(tx) + static_cast<float>(x)) / static_cast<float>(W);
-                    float cy = (sigmoid_f(ty) + static_cast<float>(y)) / static_cast<float>(H);
-                    float bw = anchor_w * softplus_f(tw);
-                    float bh = anchor_h * softplus_f(th);
-
-                    float x1 = (cx - 0.5f * bw) * scale_w + static_cast<float>(top_left_x);
-                    float y1 = (cy - 0.5f * bh) * scale_h + static_cast<float>(top_left_y);
-                    float x2 = (cx + 0.5f * bw) * scale_w + static_cast<float>(top_left_x);
-                    float y2 = (cy + 0.5f * bh) * scale_h + static_cast<float>(top_left_y);
-
-                    if (!std::isfinite(x1) || !std::isfinite(y1) || !std::isfinite(x2) || !std::isfinite(y2)) {
-                        continue;
-                    }
-                    if (x2 <= x1 || y2 <= y1) {
-                        continue;
-                    }
-
-                    dl::detect::result_t new_box = {0, score, {(int)x1, (int)y1, (int)x2, (int)y2}, {}};
-                    m_box_list.insert(
-                        std::upper_bound(m_box_list.begin(), m_box_list.end(), new_box, dl::detect::greater_box),
-                        new_box);
-                }
+        // The cell and the anchor sizes are in units of the map, scaled to the frame in one multiply.
+        const float scale_w = static_cast<float>(input->shape[2]) * inv_resize_scale_x;
+        const float scale_h = static_cast<float>(input->shape[1]) * inv_resize_scale_y;
+        const float cell_w = scale_w / W;
+        const float cell_h = scale_h / H;
+        const size_t stride = NHWC ? 1 : static_cast<size_t>(H) * W;
+
+        for (const auto &c : m_candidates) {
+            int x, y, a;
+            size_t idx_b;
+            if constexpr (NHWC) {
+                a = c.idx % kNumAnchors;
+                int cell = c.idx / kNumAnchors;
+                x = cell % W;
+                y = cell / W;
+                idx_b = static_cast<size_t>(cell) * kNumAnchors * 4 + a * 4;
+            } else {
+                int cell = c.idx % (H * W);
+                a = c.idx / (H * W);
+                x = cell % W;
+                y = cell / W;
+                idx_b = static_cast<size_t>(a) * 4 * H * W + cell;
             }
+            const T *t = box_ptr + idx_b;
+            float score, sx, sy, px, py;
+            if constexpr (std::is_same_v<T, int8_t>) {
+                score = m_quality_lut->sigmoid(quality_ptr[c.idx]);
+                sx = m_box_lut->sigmoid(t[0]);
+                sy = m_box_lut->sigmoid(t[stride]);
+                px = m_box_lut->softplus(t[2 * stride]);
+                py = m_box_lut->softplus(t[3 * stride]);
+            } else {
+                auto value = [&](T v) { return is_float ? static_cast<float>(v) : dl::dequantize(v, box_scale); };
+                score = sigmoid_f(c.raw * quality_scale);
+                sx = sigmoid_f(value(t[0]));
+                sy = sigmoid_f(value(t[stride]));
+                px = softplus_f(value(t[2 * stride]));
+                py = softplus_f(value(t[3 * stride]));
+            }
+
+            float cx = (sx + x) * cell_w + top_left_x;
+            float cy = (sy + y) * cell_h + top_left_y;
+            float half_w = 0.5f * kAnchorWh.w[a] * px * scale_w;
+            float half_h = 0.5f * kAnchorWh.h[a] * py * scale_h;
+            float x1 = cx - half_w;
+            float y1 = cy - half_h;
+            float x2 = cx + half_w;
+            float y2 = cy + half_h;
+
+            if (!std::isfinite(x1) || !std::isfinite(y1) || !std::isfinite(x2) || !std::isfinite(y2)) {
+                continue;
+            }
+            if (x2 <= x1 || y2 <= y1) {
+                continue;
+            }
+
+            m_box_list.push_back({0, score, {(int)x1, (int)y1, (int)x2, (int)y2}, {}});
         }
     }
 
-    uhd_detect::UhdAnchorSet m_anchor_set;
+    dl::TensorBase *m_box;
+    dl::TensorBase *m_quality;
+    decode_fn m_decode = nullptr;
+    // Of the int8 outputs, nullptr otherwise.
+    const Int8ActivationLUT *m_box_lut = nullptr;
+    const Int8ActivationLUT *m_quality_lut = nullptr;
+    float m_logit_thr;
+    size_t m_max_candidates;
+    std::vector<candidate_t> m_candidates;
 };
 } // namespace
 
 namespace uhd_detect {
-UltraLightweightHumanDetect::UltraLightweightHumanDetect(float score_thr, float nms_thr, int top_k)
+UltraLightweightHumanDetect::UltraLightweightHumanDetect(float score_thr, float nms_thr, int top_k) :
+    m_score_thr(score_thr), m_nms_thr(nms_thr), m_top_k(top_k)
 {
     m_model = nullptr;
     m_image_preprocessor = nullptr;
@@ -275,12 +352,29 @@ UltraLightweightHumanDetect::UltraLightweightHumanDetect(float score_thr, float
     uint32_t caps = dl::image::DL_IMAGE_CAP_RGB_SWAP | dl::image::DL_IMAGE_CAP_RGB565_BIG_ENDIAN;
 #endif
 
+    m_caps = caps;
     m_image_preprocessor = new dl::image::ImagePreprocessor(m_model, {0, 0, 0}, {255, 255, 255}, caps);
     m_postprocessor = new UhdLitePostprocessor(m_model, m_image_preprocessor, score_thr, nms_thr, top_k);
+
+    // FNV-1a of everything that makes the input of a frame, the mean and std are the same for all the uhd models.
+    dl::TensorBase *input = m_image_preprocessor->get_model_input();
+    std::vector<int> desc = input->shape;
+    desc.insert(desc.end(), {(int)input->dtype, input->exponent, (int)caps});
+    m_preprocess_key = 2166136261u;
+    for (int v : desc) {
+        m_preprocess_key = (m_preprocess_key ^ (uint32_t)v) * 16777619u;
+    }
 }
 
 UltraLightweightHumanDetect::~UltraLightweightHumanDetect()
 {
+    for (auto &slot : m_slots) {
+        delete slot.postprocessor;
+        delete slot.preprocessor;
+        delete slot.input;
+        delete slot.box;
+        delete slot.quality;
+    }
     if (m_model_owned && m_model_data) {
         heap_caps_free(const_cast<uint8_t *>(m_model_data));
         m_model_data = nullptr;
@@ -289,31 +383,104 @@ UltraLightweightHumanDetect::~UltraLightweightHumanDetect()
 }
 
 std::list<dl::detect::result_t> &UltraLightweightHumanDetect::run(const dl::image::img_t &img)
+{
+    preprocess(img);
+    infer();
+    return postprocess(img);
+}
+
+// The stage latencies are traced by WhoDetect, see WhoFrameTracer.
+void UltraLightweightHumanDetect::preprocess(const dl::image::img_t &img)
+{
+    if (m_image_preprocessor) {
+        m_image_preprocessor->preprocess(img);
+        static_cast<UhdLitePostprocessor *>(m_postprocessor)->set_image_preprocessor(m_image_preprocessor);
+    }
+}
+
+void UltraLightweightHumanDetect::adopt_preprocessed(dl::image::ImagePreprocessor *src)
+{
+    if (!m_image_preprocessor) {
+        return;
+    }
+    dl::TensorBase *input = m_image_preprocessor->get_model_input();
+    dl::TensorBase *src_input = src->get_model_input();
+    if (src_input != input) {
+        std::memcpy(input->data, src_input->data, input->get_bytes());
+    }
+    static_cast<UhdLitePostprocessor *>(m_postprocessor)->set_image_preprocessor(src);
+}
+
+void UltraLightweightHumanDetect::infer()
+{
+    if (m_model) {
+        m_model->run();
+    }
+}
+
+std::list<dl::detect::result_t> &UltraLightweightHumanDetect::postprocess(const dl::image::img_t &img)
 {
     if (!m_model || !m_image_preprocessor || !m_postprocessor) {
         static std::list<dl::detect::result_t> empty;
         ESP_LOGE(kTag, "model not initialized");
         return empty;
     }
-
-    int64_t t0 = esp_timer_get_time();
-    m_image_preprocessor->preprocess(img);
-    int64_t t1 = esp_timer_get_time();
-
-    m_model->run();
-    int64_t t2 = esp_timer_get_time();
-
     m_postprocessor->clear_result();
     m_postprocessor->postprocess();
-    std::list<dl::detect::result_t> &result = m_postprocessor->get_result(img.width, img.height);
-    int64_t t3 = esp_timer_get_time();
+    return m_postprocessor->get_result(img.width, img.height);
+}
+
+int UltraLightweightHumanDetect::init_slots()
+{
+    if (!m_slots.empty()) {
+        return m_slots.size();
+    }
+    if (!m_model || !m_image_preprocessor) {
+        return 0;
+    }
+    dl::TensorBase *input = m_image_preprocessor->get_model_input();
+    dl::TensorBase *box = m_model->get_output("box");
+    dl::TensorBase *quality = m_model->get_output("quality");
+    if (!box || !quality) {
+        ESP_LOGE(kTag, "missing output tensor(s)");
+        return 0;
+    }
+    // Double buffered, the frame being preprocessed and the one being postprocessed share the slot of neither the
+    // other nor the frame being inferred.
+    m_slots.resize(2);
+    for (auto &slot : m_slots) {
+        slot.input = new dl::TensorBase(input->shape, nullptr, input->exponent, input->dtype);
+        slot.preprocessor = new dl::image::ImagePreprocessor(slot.input, {0, 0, 0}, {255, 255, 255}, m_caps);
+        slot.box = new dl::TensorBase(box->shape, nullptr, box->exponent, box->dtype);
+        slot.quality = new dl::TensorBase(quality->shape, nullptr, quality->exponent, quality->dtype);
+        slot.postprocessor = new UhdLitePostprocessor(
+            m_model, slot.preprocessor, m_score_thr, m_nms_thr, m_top_k, slot.box, slot.quality);
+    }
+    return m_slots.size();
+}
 
-    ESP_LOGI(kTag,
-             "latency(ms): pre=%.2f infer=%.2f post=%.2f",
-             (t1 - t0) / 1000.0f,
-             (t2 - t1) / 1000.0f,
-             (t3 - t2) / 1000.0f);
+void UltraLightweightHumanDetect::preprocess_slot(const dl::image::img_t &img, int slot)
+{
+    m_slots[slot].preprocessor->preprocess(img);
+}
 
-    return result;
+void UltraLightweightHumanDetect::infer_slot(int slot)
+{
+    // The model has one input and one set of outputs, copy the slot in and out around the run.
+    dl::TensorBase *input = m_image_preprocessor->get_model_input();
+    std::memcpy(input->data, m_slots[slot].input->data, input->get_bytes());
+    m_model->run();
+    dl::TensorBase *box = m_model->get_output("box");
+    dl::TensorBase *quality = m_model->get_output("quality");
+    std::memcpy(m_slots[slot].box->data, box->data, box->get_bytes());
+    std::memcpy(m_slots[slot].quality->data, quality->data, quality->get_bytes());
+}
+
+std::list<dl::detect::result_t> &UltraLightweightHumanDetect::postprocess_slot(const dl::image::img_t &img, int slot)
+{
+    auto postprocessor = m_slots[slot].postprocessor;
+    postprocessor->clear_result();
+    postprocessor->postprocess();
+    return postprocessor->get_result(img.width, img.height);
 }
 } // namespace uhd_detect
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "dl_detect_base.hpp"
+#include "who_detect_stages.hpp"
 
 #include <cstddef>
+#include <vector>
 
 namespace uhd_detect {
-class UltraLightweightHumanDetect : public dl::detect::DetectImpl {
+class UltraLightweightHumanDetect : public dl::detect::DetectImpl, public who::detect::DetectStages {
 public:
     static inline constexpr float default_score_thr = 0.15f;
     static inline constexpr float default_nms_thr = 0.45f;
@@ -16,9 +18,34 @@ public:
                                 int top_k = default_top_k);
     ~UltraLightweightHumanDetect() override;
     std::list<dl::detect::result_t> &run(const dl::image::img_t &img) override;
+    void preprocess(const dl::image::img_t &img) override;
+    void infer() override;
+    std::list<dl::detect::result_t> &postprocess(const dl::image::img_t &img) override;
+    int init_slots() override;
+    void preprocess_slot(const dl::image::img_t &img, int slot) override;
+    void infer_slot(int slot) override;
+    std::list<dl::detect::result_t> &postprocess_slot(const dl::image::img_t &img, int slot) override;
+    uint32_t get_preprocess_key() override { return m_preprocess_key; }
+    dl::image::ImagePreprocessor *get_image_preprocessor() override { return m_image_preprocessor; }
+    void adopt_preprocessed(dl::image::ImagePreprocessor *src) override;
 
 private:
+    // Copies of the model input and outputs for the staged mode of WhoDetect.
+    struct slot_t {
+        dl::TensorBase *input;
+        dl::image::ImagePreprocessor *preprocessor;
+        dl::TensorBase *box;
+        dl::TensorBase *quality;
+        dl::detect::DetectPostprocessor *postprocessor;
+    };
+
     const uint8_t *m_model_data = nullptr;
     bool m_model_owned = false;
+    float m_score_thr;
+    float m_nms_thr;
+    int m_top_k;
+    uint32_t m_caps = 0;
+    uint32_t m_preprocess_key = 0;
+    std::vector<slot_t> m_slots;
 };
 } // namespace uhd_detect
@@ -7,7 +7,7 @@
 using namespace who::frame_cap;
 using namespace who::app;
 
-static dl::detect::Detect *get_detect_model()
+static uhd_detect::UltraLightweightHumanDetect *get_detect_model()
 {
     return new uhd_detect::UltraLightweightHumanDetect();
 }
@@ -16,7 +16,8 @@ static void run_detect_lcd()
 {
     WhoFrameCapNode *lcd_disp_frame_cap_node = nullptr;
 #if CONFIG_IDF_TARGET_ESP32S3
-    auto frame_cap = get_lcd_dvp_frame_cap_pipeline();
+    auto frame_cap = get_lcd_dvp_sw_resize_frame_cap_pipeline(&lcd_disp_frame_cap_node);
+    // auto frame_cap = get_lcd_dvp_frame_cap_pipeline();
 #elif CONFIG_IDF_TARGET_ESP32P4
     auto frame_cap = get_lcd_mipi_csi_ppa_frame_cap_pipeline(&lcd_disp_frame_cap_node);
     // auto frame_cap = get_lcd_mipi_csi_frame_cap_pipeline();
@@ -24,13 +25,23 @@ static void run_detect_lcd()
 #endif
     auto detect_app = new WhoDetectAppLCD({{255, 0, 0}}, frame_cap, lcd_disp_frame_cap_node);
     detect_app->set_model(get_detect_model());
+#if CONFIG_UHD_DETECT_STAGED
+    // Preprocess and postprocess on core 0 while the model infers on core 1.
+    detect_app->set_staged();
+#endif
+#if CONFIG_UHD_DETECT_TRACK
+    detect_app->get_result_lcd_disp()->set_tracker(std::make_unique<who::tracker::WhoTracker>());
+    // try this to detect at a few fps, the tracker still moves the boxes on every displayed frame.
+    // detect_app->set_fps(5);
+#endif
     detect_app->run();
 }
 
 static void run_detect_term()
 {
 #if CONFIG_IDF_TARGET_ESP32S3
-    auto frame_cap = get_term_dvp_frame_cap_pipeline();
+    auto frame_cap = get_term_dvp_sw_resize_frame_cap_pipeline();
+    // auto frame_cap = get_term_dvp_frame_cap_pipeline();
 #elif CONFIG_IDF_TARGET_ESP32P4
     auto frame_cap = get_term_mipi_csi_ppa_frame_cap_pipeline();
     // auto frame_cap = get_term_mipi_csi_frame_cap_pipeline();
@@ -38,6 +49,10 @@ static void run_detect_term()
 #endif
     auto detect_app = new WhoDetectAppTerm(frame_cap);
     detect_app->set_model(get_detect_model());
+#if CONFIG_UHD_DETECT_STAGED
+    // Preprocess and postprocess on core 0 while the model infers on core 1.
+    detect_app->set_staged();
+#endif
     detect_app->run();
 }
 
@@ -9,8 +9,7 @@ using namespace who::frame_cap;
 #define MODEL_INPUT_W 64
 #define MODEL_INPUT_H 64
 
-// The size of the fb_count and ringbuf_len must be big enough. If you have no idea how to set them, try with 5 and
-// larger.
+// Displayed ringbuf MODEL_TIME + 1 = 3 frames, so a displayed cam has fb_count MODEL_TIME + 3, see WhoFetchNode.
 #if CONFIG_IDF_TARGET_ESP32S3
 WhoFrameCap *get_lcd_dvp_frame_cap_pipeline()
 {
@@ -25,18 +24,50 @@ WhoFrameCap *get_lcd_dvp_frame_cap_pipeline()
     return frame_cap;
 }
 
+// Capture at the lcd size and resize to the model input on core 0, so that the detect task on core 1 does not resize.
+WhoFrameCap *get_lcd_dvp_sw_resize_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
+{
+    framesize_t frame_size = FRAMESIZE_240X240;
+#ifdef BSP_BOARD_ESP32_S3_KORVO_2
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, MODEL_TIME + 4, true, true);
+#else
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, MODEL_TIME + 4);
+#endif
+    auto frame_cap = new WhoFrameCap();
+    frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+    frame_cap->add_node<WhoSWResizeNode>(
+        "FrameCapSWResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB888, 1);
+    *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapFetch");
+    return frame_cap;
+}
+
 WhoFrameCap *get_term_dvp_frame_cap_pipeline()
 {
     framesize_t frame_size = FRAMESIZE_96X96;
 #ifdef BSP_BOARD_ESP32_S3_KORVO_2
-    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, MODEL_TIME + 2, true, true);
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, 3, true, true);
 #else
-    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, MODEL_TIME + 2);
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, 3);
 #endif
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
     return frame_cap;
 }
+
+WhoFrameCap *get_term_dvp_sw_resize_frame_cap_pipeline()
+{
+    framesize_t frame_size = FRAMESIZE_240X240;
+#ifdef BSP_BOARD_ESP32_S3_KORVO_2
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, 3, true, true);
+#else
+    auto cam = new WhoS3Cam(PIXFORMAT_RGB565, frame_size, 3);
+#endif
+    auto frame_cap = new WhoFrameCap();
+    frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
+    frame_cap->add_node<WhoSWResizeNode>(
+        "FrameCapSWResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB888, 1);
+    return frame_cap;
+}
 #elif CONFIG_IDF_TARGET_ESP32P4
 WhoFrameCap *get_lcd_mipi_csi_frame_cap_pipeline()
 {
@@ -52,26 +83,26 @@ WhoFrameCap *get_lcd_mipi_csi_ppa_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
     frame_cap->add_node<WhoPPAResizeNode>(
-        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME);
+        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1);
     *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapFetch");
     return frame_cap;
 }
 
 WhoFrameCap *get_lcd_uvc_frame_cap_pipeline(WhoFrameCapNode **lcd_disp_frame_cap_node)
 {
-    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 4);
+    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam, false);
-    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 2, false);
+    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME + 1, false);
     frame_cap->add_node<WhoPPAResizeNode>(
-        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME + 1);
+        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1);
     *lcd_disp_frame_cap_node = frame_cap->get_node("FrameCapDecode");
     return frame_cap;
 }
 
 WhoFrameCap *get_term_mipi_csi_frame_cap_pipeline()
 {
-    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, MODEL_TIME + 2);
+    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
     return frame_cap;
@@ -79,22 +110,25 @@ WhoFrameCap *get_term_mipi_csi_frame_cap_pipeline()
 
 WhoFrameCap *get_term_mipi_csi_ppa_frame_cap_pipeline()
 {
-    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, MODEL_TIME + 3);
+    auto cam = new WhoP4Cam(V4L2_PIX_FMT_RGB565, 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam);
     frame_cap->add_node<WhoPPAResizeNode>(
-        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME);
+        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1);
     return frame_cap;
 }
 
 WhoFrameCap *get_term_uvc_frame_cap_pipeline()
 {
-    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 4);
+    auto cam = new WhoUVCCam(UVC_VS_FORMAT_MJPEG, 640, 480, 30, 3);
     auto frame_cap = new WhoFrameCap();
     frame_cap->add_node<WhoFetchNode>("FrameCapFetch", cam, false);
-    frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME);
+    auto decode_node =
+        frame_cap->add_node<WhoDecodeNode>("FrameCapDecode", dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1);
+    // Nothing is displayed, the model only needs a frame near its input size.
+    decode_node->set_scale(decode_scale_t::DECODE_SCALE_1_4);
     frame_cap->add_node<WhoPPAResizeNode>(
-        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, MODEL_TIME);
+        "FrameCapPPAResize", MODEL_INPUT_W, MODEL_INPUT_H, dl::image::DL_IMAGE_PIX_TYPE_RGB565, 1);
     return frame_cap;
 }
 #endif
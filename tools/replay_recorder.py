@@ -0,0 +1,112 @@
+"""Record a video or a directory of images into the recording format replayed by WhoReplayCam.
+
+Examples:
+    python replay_recorder.py walk.mp4 -o walk.bin --format jpeg --size 320x240
+    python replay_recorder.py frames/ -o frames.bin --format rgb565 --size 240x240 --big-endian
+
+Flash it to a data partition and replay it with WhoReplayCam::from_partition(), e.g.
+    parttool.py write_partition --partition-name replay --input walk.bin
+or replay it on the linux target with WhoReplayCam::from_file().
+"""
+import argparse
+import os
+import struct
+import sys
+
+import cv2
+import numpy as np
+
+MAGIC = b"WHOR"
+VERSION = 1
+# Values of who::cam::cam_fb_fmt_t.
+FORMATS = {"rgb565": 0, "rgb888": 1, "jpeg": 2, "gray": 3, "yuv422": 4}
+IMAGE_EXTS = (".jpg", ".jpeg", ".png", ".bmp")
+
+
+def read_frames(src, max_frames):
+    if os.path.isdir(src):
+        files = sorted(f for f in os.listdir(src) if f.lower().endswith(IMAGE_EXTS))
+        for f in files[:max_frames]:
+            img = cv2.imread(os.path.join(src, f), cv2.IMREAD_COLOR)
+            if img is None:
+                sys.exit(f"Failed to read {f}.")
+            yield img
+        return
+    cap = cv2.VideoCapture(src)
+    if not cap.isOpened():
+        sys.exit(f"Failed to open {src}.")
+    n = 0
+    while n < max_frames:
+        ok, img = cap.read()
+        if not ok:
+            break
+        yield img
+        n += 1
+    cap.release()
+
+
+def encode_frame(img, fmt, big_endian, quality):
+    if fmt == "jpeg":
+        ok, buf = cv2.imencode(".jpg", img, [cv2.IMWRITE_JPEG_QUALITY, quality])
+        if not ok:
+            sys.exit("Failed to encode jpeg.")
+        return buf.tobytes()
+    if fmt == "gray":
+        return cv2.cvtColor(img, cv2.COLOR_BGR2GRAY).tobytes()
+    if fmt == "yuv422":
+        # Packed YUYV in BT.601 limited range, as the uvc and dvp sensors output it. The pairs share the mean chroma.
+        ycrcb = cv2.cvtColor(img, cv2.COLOR_BGR2YCrCb).astype(np.float32)
+        y = ycrcb[..., 0] * 219 / 255 + 16
+        cr = (ycrcb[..., 1] - 128) * 224 / 255 + 128
+        cb = (ycrcb[..., 2] - 128) * 224 / 255 + 128
+        out = np.empty((img.shape[0], img.shape[1] * 2), np.float32)
+        out[:, 0::2] = y
+        out[:, 1::4] = (cb[:, 0::2] + cb[:, 1::2]) / 2
+        out[:, 3::4] = (cr[:, 0::2] + cr[:, 1::2]) / 2
+        return out.round().clip(0, 255).astype(np.uint8).tobytes()
+    rgb = cv2.cvtColor(img, cv2.COLOR_BGR2RGB)
+    if fmt == "rgb888":
+        return rgb.tobytes()
+    r, g, b = (rgb[..., i].astype(np.uint16) for i in range(3))
+    pix = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3)
+    return pix.astype(">u2" if big_endian else "<u2").tobytes()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("src", help="video file or directory of images")
+    parser.add_argument("-o", "--output", required=True)
+    parser.add_argument("--format", choices=FORMATS.keys(), default="jpeg")
+    parser.add_argument("--size", help="WxH, the size of the first frame by default")
+    parser.add_argument("--max-frames", type=int, default=1 << 31)
+    parser.add_argument("--quality", type=int, default=80, help="jpeg quality")
+    parser.add_argument(
+        "--big-endian", action="store_true", help="rgb565 in big endian, as the esp32-s3 camera produces it"
+    )
+    args = parser.parse_args()
+
+    size = tuple(int(v) for v in args.size.split("x")) if args.size else None
+    frames = []
+    for img in read_frames(args.src, args.max_frames):
+        if size is None:
+            size = (img.shape[1], img.shape[0])
+        if args.format == "yuv422" and size[0] % 2:
+            sys.exit("The width of a yuv422 recording must be even, set it with --size.")
+        if (img.shape[1], img.shape[0]) != size:
+            img = cv2.resize(img, size, interpolation=cv2.INTER_AREA)
+        frames.append(encode_frame(img, args.format, args.big_endian, args.quality))
+    if not frames:
+        sys.exit("No frame found.")
+
+    with open(args.output, "wb") as f:
+        f.write(MAGIC)
+        f.write(struct.pack("<BBHHHI", VERSION, FORMATS[args.format], size[0], size[1], 0, len(frames)))
+        for frame in frames:
+            f.write(struct.pack("<I", len(frame)))
+            f.write(frame)
+            f.write(b"\0" * (-len(frame) % 4))
+    print(f"{len(frames)} frames of {size[0]}x{size[1]} {args.format} written to {args.output}.")
+
+
+if __name__ == "__main__":
+    main()